@@ -0,0 +1,428 @@
+// esh-bench: micro and macro benchmarks of the exam shell's hot paths, with
+// fixed seeds and CPU pinning so runs on one host are comparable. Results
+// go out as JSON; bench/compare.py checks them against a stored baseline.
+//
+//   esh-bench [-o file] [-f filter] [-r rounds] [-m ms] [-t threads] [-c cpu|-1] [-s seed] [-x exam-shell]
+//
+// Each case is calibrated to about ms/rounds milliseconds per round and
+// reports the median and best ns per operation over the rounds, plus the
+// median MB/s for cases that consume input (the lexer).
+#include "../srcs/lexer.hpp"
+#include "../srcs/log.hpp"
+#include "../srcs/metrics.hpp"
+#include "../srcs/norm.hpp"
+#include "../srcs/shell.hpp"
+#include "../srcs/utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef ESH_VERSION
+#define ESH_VERSION "dev"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace esh {
+
+// Private members the cases time directly (friend of Logger and Shell)
+struct BenchAccess {
+    static std::string format(const Logger& logger, const std::string& msg) {
+        Logger::Record rec;
+        rec.tp = std::chrono::system_clock::time_point(std::chrono::seconds(1792329600));
+        rec.lvl = Logger::Level::Info;
+        rec.msg = msg;
+        rec.file = "srcs/shell.cpp";
+        rec.func = "handleTokens";
+        rec.line = 914;
+        rec.tid = 4242;
+        return logger.format(rec, false);
+    }
+    static void setup(Shell& shell) { shell.setupBuiltins(); }
+    static std::vector<std::string> split(const Shell& shell, const std::string& line) { return shell.split(line); }
+    static void dispatch(Shell& shell, const std::vector<std::string>& tokens) { shell.handleTokens(tokens); }
+};
+
+} // namespace esh
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using esh::BenchAccess;
+
+struct Options {
+    std::string output;
+    std::string filter;
+    int rounds = 7;
+    int ms = 700;            // per case, all rounds
+    int threads = 4;         // logger cases run 1, 2, 4... up to this
+    int cpu = 0;             // -1: no pinning
+    unsigned seed = 42;
+    std::string exe = "./exam-shell";
+};
+
+struct Result {
+    std::string name;
+    double median = 0;   // ns per op
+    double best = 0;
+    std::uint64_t ops = 0;   // per round
+    double mbps = 0;         // median throughput, for cases that process bytes
+};
+
+// body(n) performs n operations
+using Body = std::function<void(std::uint64_t)>;
+
+double seconds_of(const Body& body, std::uint64_t n) {
+    auto t0 = Clock::now();
+    body(n);
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// bytes: input consumed by one operation, 0 when throughput means nothing
+Result measure(const std::string& name, const Body& body, const Options& opt, std::size_t bytes) {
+    // Grow n until one call is long enough to time, then size the rounds
+    const double perRound = opt.ms / 1000.0 / opt.rounds;
+    std::uint64_t n = 1;
+    double s = seconds_of(body, n);
+    while (s < perRound / 10 && n < (1ull << 40)) {
+        n *= s > 0 ? std::max<std::uint64_t>(2, std::min<std::uint64_t>(100, static_cast<std::uint64_t>(perRound / 10 / s))) : 100;
+        s = seconds_of(body, n);
+    }
+    n = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(n * perRound / std::max(s, 1e-9)));
+
+    std::vector<double> ns;
+    for (int r = 0; r < opt.rounds; ++r) ns.push_back(seconds_of(body, n) * 1e9 / static_cast<double>(n));
+    std::sort(ns.begin(), ns.end());
+    Result res;
+    res.name = name;
+    res.median = ns[ns.size() / 2];
+    res.best = ns.front();
+    res.ops = n;
+    res.mbps = bytes ? static_cast<double>(bytes) * 1e3 / res.median : 0;
+    std::cerr << "  " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << res.median << " ns/op" << std::setw(14) << res.best << " best  (" << n << " ops";
+    if (bytes) std::cerr << ", " << res.mbps << " MB/s";
+    std::cerr << ")\n" << std::defaultfloat;
+    return res;
+}
+
+// CPUs the process may use, before pinning
+std::vector<int> g_cpus;
+// Results stored here are not optimized away
+volatile std::size_t g_sink;
+
+bool pin_to(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Worker i of a multi-threaded case gets its own CPU where there are enough
+void pin_worker(int i, const Options& opt) {
+    if (opt.cpu < 0 || g_cpus.empty()) return;
+    pin_to(g_cpus[static_cast<std::size_t>(i) % g_cpus.size()]);
+}
+
+// Synthetic exam tree: C sources with a few norm violations, headers and noise
+void make_tree(const std::string& root, unsigned seed) {
+    std::mt19937 rng(seed);
+    auto pick = [&](int n) { return static_cast<int>(rng() % static_cast<unsigned>(n)); };
+    for (int d = 0; d < 12; ++d) {
+        const std::string dir = root + "/ex" + std::to_string(d);
+        fs::create_directories(dir + "/sub");
+        for (int f = 0; f < 20; ++f) {
+            const int kind = pick(10);
+            const char* ext = kind < 5 ? ".c" : kind < 7 ? ".h" : kind < 9 ? ".txt" : ".o";
+            std::ofstream out(dir + (f % 4 == 0 ? "/sub/" : "/") + "file" + std::to_string(f) + ext);
+            if (kind >= 7) {
+                out << std::string(static_cast<std::size_t>(200 + pick(2000)), 'x') << "\n";
+                continue;
+            }
+            out << "/* header */\n#include <unistd.h>\n\n";
+            const int functions = 1 + pick(6);
+            for (int fn = 0; fn < functions; ++fn) {
+                out << "int\tfunc_" << fn << "(int a, int b)\n{\n\tint\tc;\n\n\tc = a + b;\n";
+                const int lines = 3 + pick(30);
+                for (int l = 0; l < lines; ++l) {
+                    switch (pick(12)) {
+                        case 0: out << "\tc += a * b; \n"; break;                               // trailing space
+                        case 1: out << "    c -= 1;\n"; break;                                  // spaces
+                        case 2: out << "\tc = c + a + b + c + a + b + c + a + b + c + a + b + c + a + b + c;\n"; break;
+                        case 3: out << "\tfor (c = 0; c < 10; c++)\n\t\ta++;\n"; break;       // forbidden keyword
+                        default: out << "\tif (c > " << pick(100) << ")\n\t\tc = c / 2;\n"; break;
+                    }
+                }
+                out << "\treturn (c);\n}\n\n";
+            }
+        }
+    }
+}
+
+// The files' contents back to back, in a stable order
+std::string read_all(std::vector<std::string> files) {
+    std::sort(files.begin(), files.end());
+    std::string all;
+    for (const auto& f : files) {
+        std::ifstream in(f, std::ios::binary);
+        all.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    return all;
+}
+
+int usage() {
+    std::cerr << "usage: esh-bench [-o file] [-f filter] [-r rounds] [-m ms] [-t threads] [-c cpu|-1] [-s seed] "
+                 "[-x exam-shell]\n";
+    return 2;
+}
+
+std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    int c;
+    while ((c = getopt(argc, argv, "o:f:r:m:t:c:s:x:")) != -1) {
+        switch (c) {
+            case 'o': opt.output = optarg; break;
+            case 'f': opt.filter = optarg; break;
+            case 'r': opt.rounds = std::atoi(optarg); break;
+            case 'm': opt.ms = std::atoi(optarg); break;
+            case 't': opt.threads = std::atoi(optarg); break;
+            case 'c': opt.cpu = std::atoi(optarg); break;
+            case 's': opt.seed = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10)); break;
+            case 'x': opt.exe = optarg; break;
+            default: return usage();
+        }
+    }
+    if (optind != argc || opt.rounds < 1 || opt.ms < 1 || opt.threads < 1) return usage();
+
+    // The log worker starts here, before pinning, and keeps every CPU
+    esh::Logger& L = esh::Logger::instance();
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &allowed)) g_cpus.push_back(i);
+        }
+    }
+    if (opt.cpu >= 0 && !pin_to(opt.cpu)) {
+        std::cerr << "esh-bench: cannot pin to CPU " << opt.cpu << ", running unpinned\n";
+        opt.cpu = -1;
+    }
+    const std::string exe = fs::absolute(opt.exe).string();
+
+    // Everything the cases write stays in a scratch directory
+    char scratch[] = "/tmp/esh-bench.XXXXXX";
+    if (!mkdtemp(scratch)) {
+        std::perror("esh-bench: mkdtemp");
+        return 1;
+    }
+    const std::string home = get_current_dir();
+    if (chdir(scratch) != 0) return 1;
+    make_tree("tree", opt.seed);
+
+    L.enableConsole(false);
+    L.setPattern("[{time}] {level} {file}:{line} {func} | {msg}");
+    L.setFile("bench.log", true);
+    L.setRotation(16 * 1024 * 1024, 2);
+    L.setLevel(esh::Logger::Level::Info);
+
+    // Command output goes nowhere; results are printed once it is restored
+    std::cout.flush();
+    const int savedOut = dup(STDOUT_FILENO);
+    const int devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    dup2(devNull, STDOUT_FILENO);
+
+    std::vector<Result> results;
+    auto run = [&](const std::string& name, const Body& body, std::size_t bytes = 0) {
+        if (opt.filter.empty() || name.find(opt.filter) != std::string::npos) {
+            results.push_back(measure(name, body, opt, bytes));
+        }
+    };
+
+    std::cerr << "esh-bench " << ESH_VERSION << ", seed " << opt.seed << ", "
+              << (opt.cpu >= 0 ? "pinned to CPU " + std::to_string(opt.cpu) : std::string("unpinned")) << "\n";
+
+    // Logger: caller-side cost (sync: formatted and written by the caller;
+    // async: queued, then drained so the worker's share is counted too)
+    for (int async = 0; async < 2; ++async) {
+        for (int t = 1; t <= opt.threads; t *= 2) {
+            run(std::string(async ? "logger.async/t" : "logger.sync/t") + std::to_string(t), [&, t, async](std::uint64_t n) {
+                L.setAsync(async != 0);
+                std::vector<std::thread> workers;
+                for (int w = 0; w < t; ++w) {
+                    workers.emplace_back([&, w] {
+                        if (t > 1) pin_worker(w, opt);
+                        const std::uint64_t mine = n / static_cast<std::uint64_t>(t) + (static_cast<std::uint64_t>(w) < n % static_cast<std::uint64_t>(t));
+                        for (std::uint64_t i = 0; i < mine; ++i) {
+                            ESH_LOG_INFO() << "Dispatch command=grademe argc=" << (i & 7) << " worker=" << w;
+                        }
+                    });
+                }
+                for (auto& w : workers) w.join();
+                L.drain();
+            });
+        }
+    }
+    L.setAsync(true);
+
+    run("logger.format", [&](std::uint64_t n) {
+        std::size_t total = 0;
+        for (std::uint64_t i = 0; i < n; ++i) total += BenchAccess::format(L, "Grade for ex03/ft_strlen: 100 (norm 0 issue(s))").size();
+        g_sink = total;
+    });
+
+    std::mt19937 rng(opt.seed);
+    std::map<std::string, std::string> vars;
+    for (const char* key : {"user", "exam", "exercise", "grade", "time_left", "mode", "cwd", "jobs"}) {
+        vars[key] = std::to_string(rng() % 100000);
+    }
+    const std::string tpl = "{{user}}@{{exam}}/{{exercise}} [{{mode}}] grade={{grade}} left={{time_left}} "
+                            "jobs={{jobs}} in {{cwd}} {{missing}}";
+    run("render_template", [&](std::uint64_t n) {
+        std::size_t total = 0;
+        for (std::uint64_t i = 0; i < n; ++i) total += render_template(tpl, vars).size();
+        g_sink = total;
+    });
+
+    run("list_files_recursive", [&](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) list_files_recursive("tree", {".c", ".h"});
+    });
+
+    run("norm.run", [&](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            norm::Checker checker;
+            checker.run("tree");
+        }
+    });
+
+    // Lexer throughput: the synthetic tree (same bytes for a given seed) and
+    // this repository's own C++ sources when run from the source tree; the
+    // latter change with every commit, compare them across hosts, not versions
+    auto lex = [&](const std::string& corpus) {
+        return [&corpus](std::uint64_t n) {
+            esh::Lexer lexer;
+            esh::Token tok;
+            std::size_t tokens = 0;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                lexer.reset(corpus);
+                while (lexer.next(tok)) ++tokens;
+            }
+            g_sink = tokens;
+        };
+    };
+    const std::string treeSources = read_all(list_files_recursive("tree", {".c", ".h"}));
+    run("lexer", lex(treeSources), treeSources.size());
+    std::vector<std::string> own;
+    for (const char* dir : {"/srcs", "/tools", "/bench"}) {
+        for (const auto& f : list_files_recursive(home + dir, {".cpp", ".hpp"})) own.push_back(f);
+    }
+    const std::string ownSources = read_all(own);
+    if (!ownSources.empty()) run("lexer.sources", lex(ownSources), ownSources.size());
+
+    {
+        Shell shell;
+        BenchAccess::setup(shell);
+        const std::string line = "grademe ex03   --norm  -v &";
+        run("shell.split", [&](std::uint64_t n) {
+            std::size_t total = 0;
+            for (std::uint64_t i = 0; i < n; ++i) total += BenchAccess::split(shell, line).size();
+            g_sink = total;
+        });
+        const std::vector<std::string> help = {"help"};
+        run("shell.dispatch", [&](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; ++i) BenchAccess::dispatch(shell, help);
+            std::cout.flush();
+        });
+    }
+
+    if (access(exe.c_str(), X_OK) == 0) {
+        // startup: exec and exit (--version); startup.shell: up to where the
+        // shell would draw its first menu (--init-only), in the scratch dir
+        auto startup = [&](const char* arg) {
+            return [&, arg](std::uint64_t n) {
+                for (std::uint64_t i = 0; i < n; ++i) {
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        dup2(devNull, STDIN_FILENO);
+                        dup2(devNull, STDOUT_FILENO);
+                        dup2(devNull, STDERR_FILENO);
+                        execl(exe.c_str(), exe.c_str(), arg, static_cast<char*>(nullptr));
+                        _exit(127);
+                    }
+                    int status;
+                    if (pid > 0) waitpid(pid, &status, 0);
+                }
+            };
+        };
+        run("startup", startup("--version"));
+        run("startup.shell", startup("--init-only"));
+    } else {
+        std::cerr << "  startup: " << exe << " not found, skipped\n";
+    }
+
+    std::cout.flush();
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedOut);
+    close(devNull);
+    L.drain();
+    L.clearFile();
+    esh::metrics::unpublish();
+    if (chdir(home.c_str()) != 0) return 1;
+    std::error_code ec;
+    fs::remove_all(scratch, ec);
+
+    utsname host{};
+    uname(&host);
+    std::ostringstream json;
+    json << "{\n  \"version\": \"" << json_escape(ESH_VERSION) << "\",\n  \"host\": \"" << json_escape(host.nodename)
+         << "\",\n  \"machine\": \"" << json_escape(host.machine) << "\",\n  \"cpus\": " << g_cpus.size()
+         << ",\n  \"pinned\": " << opt.cpu << ",\n  \"seed\": " << opt.seed << ",\n  \"rounds\": " << opt.rounds
+         << ",\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        json << "    {\"name\": \"" << json_escape(r.name) << "\", \"ns_per_op\": " << std::fixed << std::setprecision(1)
+             << r.median << ", \"best_ns_per_op\": " << r.best;
+        if (r.mbps > 0) json << ", \"mb_per_s\": " << r.mbps;
+        json << std::defaultfloat << ", \"ops\": " << r.ops << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    if (opt.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(opt.output);
+        if (!(out << json.str())) {
+            std::cerr << "esh-bench: cannot write " << opt.output << "\n";
+            return 1;
+        }
+        std::cerr << "results written to " << opt.output << "\n";
+    }
+    return 0;
+}
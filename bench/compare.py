@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Compare two esh-bench JSON results: prints the change of every case and
+# exits 1 when one got slower than the threshold allows.
+#
+#   bench/compare.py [-t percent] baseline.json current.json
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data, {r["name"]: r for r in data["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flag esh-bench regressions against a baseline")
+    parser.add_argument("-t", "--threshold", type=float, default=10.0,
+                        help="slowdown in percent that counts as a regression (default 10)")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    args = parser.parse_args()
+
+    base_meta, base = load(args.baseline)
+    cur_meta, cur = load(args.current)
+    for key in ("host", "machine", "pinned", "seed"):
+        if base_meta.get(key) != cur_meta.get(key):
+            print(f"warning: {key} differs ({base_meta.get(key)} vs {cur_meta.get(key)}), "
+                  "numbers may not be comparable")
+
+    print(f"{base_meta.get('version', '?')} -> {cur_meta.get('version', '?')}")
+    print(f"{'case':<28} {'baseline':>12} {'current':>12} {'change':>9}")
+    regressions = []
+    for name, c in cur.items():
+        b = base.get(name)
+        if b is None:
+            print(f"{name:<28} {'-':>12} {c['ns_per_op']:>12.1f} {'new':>9}")
+            continue
+        # The best round is the least noisy estimate; a regression must show
+        # in both the median and the best round
+        change = (c["ns_per_op"] / b["ns_per_op"] - 1) * 100
+        best_change = (c["best_ns_per_op"] / b["best_ns_per_op"] - 1) * 100
+        flag = ""
+        if change > args.threshold and best_change > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        elif change < -args.threshold and best_change < -args.threshold:
+            flag = "  faster"
+        print(f"{name:<28} {b['ns_per_op']:>12.1f} {c['ns_per_op']:>12.1f} {change:>+8.1f}%{flag}")
+    for name in base:
+        if name not in cur:
+            print(f"{name:<28} {base[name]['ns_per_op']:>12.1f} {'-':>12} {'gone':>9}")
+
+    if regressions:
+        print(f"{len(regressions)} regression(s) over {args.threshold:g}%: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
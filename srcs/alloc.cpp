@@ -0,0 +1,211 @@
+#include "alloc.hpp"
+
+#if defined(ESH_ALLOC_TRACKING)
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace esh {
+namespace alloc {
+
+namespace {
+
+const int kMaxTags = 128;
+const int kOtherTag = 1;
+const std::size_t kHeader = 16;   // keeps the default new alignment
+
+// Nothing here may allocate: it is used from inside operator new
+struct Tag {
+    char name[40];
+    std::atomic<std::uint64_t> allocs;
+    std::atomic<std::uint64_t> frees;
+    std::atomic<std::uint64_t> bytes;
+    std::atomic<std::uint64_t> freedBytes;
+};
+
+Tag g_tags[kMaxTags] = {{"-", {}, {}, {}, {}}, {"(other)", {}, {}, {}, {}}};
+std::atomic<int> g_tagCount{2};
+std::mutex g_internMx;
+std::atomic<std::uint64_t> g_live{0};
+std::atomic<std::uint64_t> g_peak{0};
+thread_local int t_tag = 0;
+
+// Stored just before the block handed out
+struct Header {
+    std::uint64_t size;
+    std::uint32_t tag;
+    std::uint32_t offset;   // from the malloc'd base to the block
+};
+static_assert(sizeof(Header) <= kHeader, "header too large");
+
+void* tracked_alloc(std::size_t size, std::size_t align) noexcept {
+    const std::size_t offset = std::max(kHeader, align);
+    if (size > SIZE_MAX - offset - align) return nullptr;
+    void* base = align > kHeader ? std::aligned_alloc(align, (offset + size + align - 1) / align * align)
+                                 : std::malloc(offset + size);
+    if (!base) return nullptr;
+    char* p = static_cast<char*>(base) + offset;
+    const int tag = t_tag;
+    Header* h = reinterpret_cast<Header*>(p - kHeader);
+    h->size = size;
+    h->tag = static_cast<std::uint32_t>(tag);
+    h->offset = static_cast<std::uint32_t>(offset);
+    g_tags[tag].allocs.fetch_add(1, std::memory_order_relaxed);
+    g_tags[tag].bytes.fetch_add(size, std::memory_order_relaxed);
+    std::uint64_t live = g_live.fetch_add(size, std::memory_order_relaxed) + size;
+    std::uint64_t peak = g_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return p;
+}
+
+void tracked_free(void* ptr) noexcept {
+    if (!ptr) return;
+    char* p = static_cast<char*>(ptr);
+    const Header* h = reinterpret_cast<const Header*>(p - kHeader);
+    g_tags[h->tag].frees.fetch_add(1, std::memory_order_relaxed);
+    g_tags[h->tag].freedBytes.fetch_add(h->size, std::memory_order_relaxed);
+    g_live.fetch_sub(h->size, std::memory_order_relaxed);
+    std::free(p - h->offset);
+}
+
+void* throwing_alloc(std::size_t size, std::size_t align) {
+    for (;;) {
+        if (void* p = tracked_alloc(size ? size : 1, align)) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+} // namespace
+
+bool enabled() noexcept {
+    return true;
+}
+
+int intern(std::string_view tag) noexcept {
+    std::lock_guard<std::mutex> lock(g_internMx);
+    const int n = g_tagCount.load(std::memory_order_relaxed);
+    const std::size_t len = std::min(tag.size(), sizeof(g_tags[0].name) - 1);
+    for (int i = 0; i < n; ++i) {
+        if (std::strlen(g_tags[i].name) == len && std::memcmp(g_tags[i].name, tag.data(), len) == 0) return i;
+    }
+    if (n == kMaxTags) return kOtherTag;
+    std::memcpy(g_tags[n].name, tag.data(), len);
+    g_tags[n].name[len] = '\0';
+    g_tagCount.store(n + 1, std::memory_order_release);
+    return n;
+}
+
+Scope::Scope(int tag) noexcept : _prev(t_tag) {
+    t_tag = tag;
+}
+
+Scope::~Scope() {
+    t_tag = _prev;
+}
+
+std::vector<TagStats> top(std::size_t n) {
+    const int count = g_tagCount.load(std::memory_order_acquire);
+    std::vector<TagStats> out;
+    out.reserve(static_cast<std::size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        TagStats s;
+        s.allocs = g_tags[i].allocs.load(std::memory_order_relaxed);
+        if (s.allocs == 0) continue;
+        s.tag = g_tags[i].name;
+        s.frees = g_tags[i].frees.load(std::memory_order_relaxed);
+        s.bytes = g_tags[i].bytes.load(std::memory_order_relaxed);
+        s.freedBytes = g_tags[i].freedBytes.load(std::memory_order_relaxed);
+        out.push_back(std::move(s));
+    }
+    std::sort(out.begin(), out.end(), [](const TagStats& a, const TagStats& b) { return a.bytes > b.bytes; });
+    if (out.size() > n) out.resize(n);
+    return out;
+}
+
+Totals totals() {
+    Totals t;
+    const int count = g_tagCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        t.allocs += g_tags[i].allocs.load(std::memory_order_relaxed);
+        t.frees += g_tags[i].frees.load(std::memory_order_relaxed);
+        t.bytes += g_tags[i].bytes.load(std::memory_order_relaxed);
+    }
+    t.live = g_live.load(std::memory_order_relaxed);
+    t.peak = g_peak.load(std::memory_order_relaxed);
+    return t;
+}
+
+// Blocks allocated before the reset and freed after it make freedBytes
+// exceed bytes for a while; live() is only meaningful between resets
+void reset() {
+    const int count = g_tagCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        g_tags[i].allocs.store(0, std::memory_order_relaxed);
+        g_tags[i].frees.store(0, std::memory_order_relaxed);
+        g_tags[i].bytes.store(0, std::memory_order_relaxed);
+        g_tags[i].freedBytes.store(0, std::memory_order_relaxed);
+    }
+    g_peak.store(g_live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+} // namespace alloc
+} // namespace esh
+
+// Replaceable global allocation functions
+
+void* operator new(std::size_t size) { return esh::alloc::throwing_alloc(size, 0); }
+void* operator new[](std::size_t size) { return esh::alloc::throwing_alloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t al) {
+    return esh::alloc::throwing_alloc(size, static_cast<std::size_t>(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al) {
+    return esh::alloc::throwing_alloc(size, static_cast<std::size_t>(al));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return esh::alloc::tracked_alloc(size ? size : 1, 0);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return esh::alloc::tracked_alloc(size ? size : 1, 0);
+}
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return esh::alloc::tracked_alloc(size ? size : 1, static_cast<std::size_t>(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return esh::alloc::tracked_alloc(size ? size : 1, static_cast<std::size_t>(al));
+}
+
+void operator delete(void* p) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p) noexcept { esh::alloc::tracked_free(p); }
+void operator delete(void* p, std::size_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { esh::alloc::tracked_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { esh::alloc::tracked_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { esh::alloc::tracked_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { esh::alloc::tracked_free(p); }
+
+#else
+
+namespace esh {
+namespace alloc {
+
+bool enabled() noexcept { return false; }
+std::vector<TagStats> top(std::size_t) { return {}; }
+Totals totals() { return {}; }
+void reset() {}
+int intern(std::string_view) noexcept { return 0; }
+Scope::Scope(int) noexcept : _prev(0) {}
+Scope::~Scope() {}
+
+} // namespace alloc
+} // namespace esh
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace esh {
+namespace alloc {
+
+// Allocation tracking, compiled in only with make ALLOC_TRACKING=1
+// (-DESH_ALLOC_TRACKING). It replaces the global operator new/delete and
+// charges every allocation, with its size, to the innermost scope tag of the
+// allocating thread; a free is charged back to the tag that allocated the
+// block. Direct malloc() calls (readline, C libraries) are not seen. Without
+// the flag the operators are untouched and the scope macros expand to
+// nothing.
+
+struct TagStats {
+    std::string tag;
+    std::uint64_t allocs = 0;
+    std::uint64_t frees = 0;
+    std::uint64_t bytes = 0;        // allocated in total
+    std::uint64_t freedBytes = 0;
+    std::uint64_t live() const noexcept { return bytes - freedBytes; }
+};
+
+struct Totals {
+    std::uint64_t allocs = 0;
+    std::uint64_t frees = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t live = 0;
+    std::uint64_t peak = 0;   // highest live byte count
+};
+
+bool enabled() noexcept;
+
+// The n tags that allocated the most bytes; untagged allocations are "-"
+std::vector<TagStats> top(std::size_t n);
+Totals totals();
+// Zeroes the counters; live and peak restart from the current live bytes
+void reset();
+
+// Tag ids; the table is fixed, once full every new tag is "(other)"
+int intern(std::string_view tag) noexcept;
+
+class Scope {
+public:
+    explicit Scope(int tag) noexcept;
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+private:
+    int _prev;
+};
+
+} // namespace alloc
+} // namespace esh
+
+#define ESH_ALLOC_CAT2(a, b) a##b
+#define ESH_ALLOC_CAT(a, b) ESH_ALLOC_CAT2(a, b)
+
+#if defined(ESH_ALLOC_TRACKING)
+// Constant tag: interned once per call site
+#define ESH_ALLOC_SCOPE(tag)                                                          \
+    static const int ESH_ALLOC_CAT(esh_alloc_tag_, __LINE__) = ::esh::alloc::intern(tag); \
+    ::esh::alloc::Scope ESH_ALLOC_CAT(esh_alloc_scope_, __LINE__)(ESH_ALLOC_CAT(esh_alloc_tag_, __LINE__))
+// Tag computed at run time, e.g. a command name
+#define ESH_ALLOC_SCOPE_DYNAMIC(tag) \
+    ::esh::alloc::Scope ESH_ALLOC_CAT(esh_alloc_scope_, __LINE__)(::esh::alloc::intern(tag))
+#else
+#define ESH_ALLOC_SCOPE(tag) ((void)0)
+#define ESH_ALLOC_SCOPE_DYNAMIC(tag) ((void)0)
+#endif
@@ -0,0 +1,91 @@
+#include "allowed_functions.hpp"
+#include "elf.hpp"
+#include <initializer_list>
+#include <unordered_set>
+
+namespace esh {
+
+// Pulled in by the compiler and the C runtime, never by the student's code
+static const char* const kRuntimeSymbols[] = {
+    "__libc_start_main", "__libc_start_call_main", "__libc_csu_init", "__libc_csu_fini",
+    "__cxa_finalize", "__cxa_atexit", "__stack_chk_fail", "__stack_chk_guard", "__gmon_start__",
+    "__errno_location", "__dso_handle", "_GLOBAL_OFFSET_TABLE_", "_ITM_registerTMCloneTable",
+    "_ITM_deregisterTMCloneTable", "__gxx_personality_v0", "_Unwind_Resume", "_init", "_fini",
+};
+
+// Calls the compiler or the libc headers put in place of the one written:
+// GCC turns printf("hi\n") into puts and printf("%c", c) into putchar, and
+// the <ctype.h> macros read glibc's tables through __ctype_*_loc. Such a
+// symbol is fine when any of the functions it stands for is allowed.
+struct Substitute {
+    const char* symbol;
+    std::initializer_list<const char*> writtenAs;
+};
+static const Substitute kSubstitutes[] = {
+    {"puts", {"printf"}},
+    {"putchar", {"printf"}},
+    {"fputs", {"fprintf"}},
+    {"fputc", {"fprintf"}},
+    {"fwrite", {"fprintf"}},
+    {"__ctype_b_loc", {"isalnum", "isalpha", "isblank", "iscntrl", "isdigit", "isgraph", "islower", "isprint",
+                       "ispunct", "isspace", "isupper", "isxdigit"}},
+    {"__ctype_toupper_loc", {"toupper"}},
+    {"__ctype_tolower_loc", {"tolower"}},
+};
+
+// __printf_chk -> printf, __isoc99_sscanf -> sscanf
+static std::string_view plain_name(std::string_view sym) {
+    if (sym.size() > 6 && sym.compare(0, 2, "__") == 0 && sym.compare(sym.size() - 4, 4, "_chk") == 0) {
+        return sym.substr(2, sym.size() - 6);
+    }
+    for (std::string_view prefix : {std::string_view("__isoc99_"), std::string_view("__isoc23_")}) {
+        if (sym.compare(0, prefix.size(), prefix) == 0) return sym.substr(prefix.size());
+    }
+    return sym;
+}
+
+std::size_t checkAllowedFunctions(const std::vector<std::string>& files, const std::vector<std::string>& allowed,
+                                  norm::Report& report, std::string* error) {
+    std::vector<ElfFile> elves(files.size());
+    std::vector<bool> opened(files.size(), false);
+    std::unordered_set<std::string_view> ok(std::begin(kRuntimeSymbols), std::end(kRuntimeSymbols));
+    for (const auto& a : allowed) ok.insert(a);
+    for (const Substitute& sub : kSubstitutes) {
+        for (const char* name : sub.writtenAs) {
+            if (ok.count(name)) {
+                ok.insert(sub.symbol);
+                break;
+            }
+        }
+    }
+    // A function defined in one of the files may be called from the others;
+    // a static binary defines all of libc, which would allow everything
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        std::string why;
+        opened[i] = elves[i].open(files[i], &why);
+        if (!opened[i]) {
+            if (error) *error = why;
+            continue;
+        }
+        if (!elves[i].staticallyLinked()) ok.insert(elves[i].defined().begin(), elves[i].defined().end());
+    }
+
+    std::size_t added = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (!opened[i]) continue;
+        std::uint32_t file = report.internFile(files[i]);
+        if (elves[i].staticallyLinked()) {
+            report.add(file, 0, norm::Rule::StaticBinary);
+            ++added;
+            continue;
+        }
+        for (std::string_view sym : elves[i].undefined()) {
+            if (ok.count(sym) || ok.count(plain_name(sym))) continue;
+            report.add(file, 0, norm::Rule::ForbiddenFunction, report.internName(sym));
+            ++added;
+        }
+    }
+    return added;
+}
+
+} // namespace esh
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "norm.hpp"
+
+namespace esh {
+
+// Adds a forbidden-function issue per file for every function it calls that
+// none of the files defines, that is not in allowed, and that is not part of
+// the C runtime (__libc_start_main, __stack_chk_fail, ...). Fortified and
+// ISO C variants count as their plain name (__printf_chk is printf), and so
+// do the calls the compiler substitutes (puts for printf, __ctype_b_loc for
+// isalpha, ...). A statically linked file gets a static-binary issue instead,
+// as none of its calls are visible. Files that are not ELF are skipped with
+// error set. Returns the issues added.
+std::size_t checkAllowedFunctions(const std::vector<std::string>& files, const std::vector<std::string>& allowed,
+                                  norm::Report& report, std::string* error = nullptr);
+
+} // namespace esh
@@ -0,0 +1,237 @@
+#include "crash.hpp"
+#include "log.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace esh {
+
+namespace {
+
+const int kSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+const std::size_t kAltStackSize = 64 * 1024;
+const int kMaxFrames = 64;
+
+int g_fd = -1;
+char g_path[PATH_MAX];
+char g_exe[PATH_MAX];
+char* g_altStack = nullptr;
+
+// Buffered writer for the handler: no allocation, no stdio
+class Out {
+public:
+    explicit Out(int fd) : _fd(fd) {}
+    ~Out() { flush(); }
+
+    Out& str(const char* s) {
+        while (*s) put(*s++);
+        return *this;
+    }
+    Out& hex(std::uint64_t v) {
+        char tmp[16];
+        int n = 0;
+        do {
+            tmp[n++] = "0123456789abcdef"[v & 15];
+            v >>= 4;
+        } while (v);
+        str("0x");
+        while (n) put(tmp[--n]);
+        return *this;
+    }
+    Out& dec(std::int64_t v) {
+        char tmp[20];
+        int n = 0;
+        std::uint64_t u = v < 0 ? 0 - static_cast<std::uint64_t>(v) : static_cast<std::uint64_t>(v);
+        do {
+            tmp[n++] = static_cast<char>('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) put('-');
+        while (n) put(tmp[--n]);
+        return *this;
+    }
+    void flush() {
+        const char* p = _buf;
+        while (_n > 0) {
+            ssize_t w = ::write(_fd, p, _n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            p += w;
+            _n -= static_cast<std::size_t>(w);
+        }
+        _n = 0;
+    }
+
+private:
+    void put(char c) {
+        if (_n == sizeof(_buf)) flush();
+        _buf[_n++] = c;
+    }
+
+    int _fd;
+    char _buf[512];
+    std::size_t _n = 0;
+};
+
+const char* signal_name(int sig) {
+    switch (sig) {
+        case SIGSEGV: return "SIGSEGV";
+        case SIGBUS: return "SIGBUS";
+        case SIGFPE: return "SIGFPE";
+        case SIGILL: return "SIGILL";
+        case SIGABRT: return "SIGABRT";
+        default: return "signal";
+    }
+}
+
+void write_registers(Out& out, const ucontext_t* uc) {
+#if defined(__x86_64__)
+    static const struct { const char* name; int reg; } kRegs[] = {
+        {"rip", REG_RIP}, {"rsp", REG_RSP}, {"rbp", REG_RBP}, {"rax", REG_RAX}, {"rbx", REG_RBX},
+        {"rcx", REG_RCX}, {"rdx", REG_RDX}, {"rsi", REG_RSI}, {"rdi", REG_RDI}, {"r8", REG_R8},
+        {"r9", REG_R9}, {"r10", REG_R10}, {"r11", REG_R11}, {"r12", REG_R12}, {"r13", REG_R13},
+        {"r14", REG_R14}, {"r15", REG_R15}, {"eflags", REG_EFL},
+    };
+    for (const auto& r : kRegs) {
+        out.str("  ").str(r.name).str(" ").hex(static_cast<std::uint64_t>(uc->uc_mcontext.gregs[r.reg])).str("\n");
+    }
+#elif defined(__aarch64__)
+    out.str("  pc ").hex(uc->uc_mcontext.pc).str("\n  sp ").hex(uc->uc_mcontext.sp).str("\n");
+    for (int i = 0; i < 31; ++i) out.str("  x").dec(i).str(" ").hex(uc->uc_mcontext.regs[i]).str("\n");
+#else
+    (void)uc;
+    out.str("  (not available on this architecture)\n");
+#endif
+}
+
+std::uint64_t fault_pc(const ucontext_t* uc) {
+#if defined(__x86_64__)
+    return static_cast<std::uint64_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    return uc->uc_mcontext.pc;
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+
+// open/read/write are async-signal-safe, so the maps are copied at crash time
+void copy_maps(int fd) {
+    int in = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (in < 0) return;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(in, buf, sizeof(buf))) > 0) {
+        if (::write(fd, buf, static_cast<std::size_t>(n)) < 0) break;
+    }
+    ::close(in);
+}
+
+void on_crash(int sig, siginfo_t* info, void* context) {
+    const int savedErrno = errno;
+    const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    {
+        Out out(g_fd);
+        out.str("*** exam-shell crash ***\nsignal: ").dec(sig).str(" ").str(signal_name(sig))
+           .str(" code ").dec(info->si_code).str(" addr ").hex(reinterpret_cast<std::uintptr_t>(info->si_addr))
+           .str("\npid: ").dec(getpid()).str(" tid: ").dec(syscall(SYS_gettid))
+           .str("\ntime: ").dec(ts.tv_sec).str("\nexe: ").str(g_exe).str("\npc: ").hex(fault_pc(uc))
+           .str("\nregisters:\n");
+        write_registers(out, uc);
+
+        // The unwinder was loaded by install(), so backtrace() does not allocate here
+        void* frames[kMaxFrames];
+        int n = backtrace(frames, kMaxFrames);
+        out.str("backtrace:\n");
+        for (int i = 0; i < n; ++i) out.str("  #").dec(i).str(" ").hex(reinterpret_cast<std::uintptr_t>(frames[i])).str("\n");
+        out.str("maps:\n");
+    }
+    copy_maps(g_fd);
+    {
+        Out out(g_fd);
+        out.str("pending log records:\n");
+    }
+    std::size_t pending = Logger::instance().writePendingForCrash(g_fd);
+    {
+        Out out(g_fd);
+        out.str("(").dec(static_cast<std::int64_t>(pending)).str(" record(s))\n*** end ***\n");
+    }
+    fsync(g_fd);
+    {
+        Out err(STDERR_FILENO);
+        err.str("\nexam-shell: fatal ").str(signal_name(sig)).str(", crash report appended to ").str(g_path)
+           .str("\n");
+    }
+    errno = savedErrno;
+    // SA_RESETHAND restored the default action: re-raise for the core dump /
+    // exit status (a fault simply re-executes the faulting instruction)
+    raise(sig);
+}
+
+} // namespace
+
+bool CrashHandler::install(const std::string& path, std::string* error) {
+    auto fail = [error](const std::string& why) {
+        if (error) *error = why;
+        return false;
+    };
+    if (g_fd >= 0) return true;
+    if (path.size() >= sizeof(g_path)) return fail("crash report path too long");
+    // Relative paths are resolved now: the shell changes directory later
+    if (path[0] == '/') {
+        std::memcpy(g_path, path.c_str(), path.size() + 1);
+    } else {
+        if (!getcwd(g_path, sizeof(g_path)) || std::strlen(g_path) + 1 + path.size() >= sizeof(g_path)) {
+            return fail("crash report path too long");
+        }
+        std::strcat(g_path, "/");
+        std::strcat(g_path, path.c_str());
+    }
+    g_fd = ::open(g_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (g_fd < 0) return fail(std::string("cannot open ") + g_path + ": " + std::strerror(errno));
+    ssize_t n = readlink("/proc/self/exe", g_exe, sizeof(g_exe) - 1);
+    g_exe[n > 0 ? n : 0] = '\0';
+
+    void* warmup[4];
+    backtrace(warmup, 4);
+    Logger::instance().enableCrashRing();
+
+    g_altStack = new char[kAltStackSize];
+    stack_t ss{};
+    ss.ss_sp = g_altStack;
+    ss.ss_size = kAltStackSize;
+    if (sigaltstack(&ss, nullptr) != 0) return fail(std::string("sigaltstack: ") + std::strerror(errno));
+
+    struct sigaction sa{};
+    sa.sa_sigaction = on_crash;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (int sig : kSignals) sigaction(sig, &sa, nullptr);
+    ESH_LOG_DEBUG() << "Crash handler installed, reports go to " << g_path;
+    return true;
+}
+
+void CrashHandler::uninstall() {
+    if (g_fd < 0) return;
+    struct sigaction sa{};
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    for (int sig : kSignals) sigaction(sig, &sa, nullptr);
+    struct stat st;
+    if (fstat(g_fd, &st) == 0 && st.st_size == 0) unlink(g_path);
+    ::close(g_fd);
+    g_fd = -1;
+}
+
+} // namespace esh
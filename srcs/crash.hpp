@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+
+namespace esh {
+
+// Crash reports for SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT. The handler
+// runs on an alternate stack (so stack overflows are caught on the thread
+// that installed it) and only uses async-signal-safe calls: it appends to a
+// file opened by install() the signal, registers, raw return addresses,
+// /proc/self/maps and the log records not yet flushed, then lets the signal
+// take its default action. tools/esh-symbolize turns the addresses into
+// function names.
+class CrashHandler {
+public:
+    // Call once from main(), after the logger is set up
+    static bool install(const std::string& path, std::string* error = nullptr);
+    // At a clean exit: closes the report and removes it if nothing was written
+    static void uninstall();
+};
+
+} // namespace esh
@@ -1,15 +1,26 @@
 #include "debug.hpp"
 #include "log.hpp"
+#include "alloc.hpp"
+#include <algorithm>
+#include <cerrno>
 #include <iomanip>
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
 #include <ctime>
+#include <string_view>
 #include <unistd.h>
 
 #if defined(__linux__)
-#include <execinfo.h>
+#include <atomic>
+#include <csignal>
 #include <fstream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
 #endif
 
 extern char **environ;
@@ -22,29 +33,101 @@ static unsigned long long now_ns() {
     return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ull + static_cast<unsigned long long>(ts.tv_nsec);
 }
 
-void DebugTools::hexdump(const void* data, std::size_t size, std::size_t width, const char* label) {
+// "00".."ff" and the |ascii| column, indexed by byte
+struct HexTables {
+    char hex[512];
+    char ascii[256];
+    constexpr HexTables() : hex(), ascii() {
+        const char digits[] = "0123456789abcdef";
+        for (int b = 0; b < 256; ++b) {
+            hex[2 * b] = digits[b >> 4];
+            hex[2 * b + 1] = digits[b & 15];
+            ascii[b] = b >= 0x20 && b < 0x7f ? static_cast<char>(b) : '.';
+        }
+    }
+};
+static constexpr HexTables kHexTables;
+
+// 8 hex digits, 16 once offsets no longer fit
+static char* put_offset(char* out, std::uint64_t offset, bool wide) {
+    for (int shift = wide ? 60 : 28; shift >= 0; shift -= 4) *out++ = "0123456789abcdef"[(offset >> shift) & 15];
+    return out;
+}
+
+bool DebugTools::hexdumpTo(const HexSink& sink, const void* data, std::size_t size, const HexdumpOptions& opt) {
     const unsigned char* p = static_cast<const unsigned char*>(data);
-    std::ostringstream out;
-    out << label << " (" << size << " bytes)\n";
+    const std::size_t width = std::min<std::size_t>(std::max<std::size_t>(opt.width, 1), 64);
+    const bool wide = opt.baseOffset + size > 0xffffffffull;
+    const std::size_t maxLine = 16 + 2 + width * 3 + width / 8 + 2 + width + 2;
+    char buf[64 * 1024];
+    char* out = buf;
+    auto flush = [&] {
+        bool ok = out == buf || sink(buf, static_cast<std::size_t>(out - buf));
+        out = buf;
+        return ok;
+    };
+
+    bool starred = false;
     for (std::size_t i = 0; i < size; i += width) {
-        out << std::setw(6) << std::setfill('0') << std::hex << i << "  ";
-        // hex
+        const std::size_t n = std::min(width, size - i);
+        if (opt.collapse && i >= width && n == width && std::memcmp(p + i, p + i - width, width) == 0) {
+            if (!starred) {
+                // A full line can leave less than the marker's two bytes
+                if (static_cast<std::size_t>(buf + sizeof(buf) - out) < 2 && !flush()) return false;
+                *out++ = '*';
+                *out++ = '\n';
+                starred = true;
+            }
+            continue;
+        }
+        starred = false;
+        if (static_cast<std::size_t>(buf + sizeof(buf) - out) < maxLine && !flush()) return false;
+        out = put_offset(out, opt.baseOffset + i, wide);
+        *out++ = ' ';
         for (std::size_t j = 0; j < width; ++j) {
-            if (i + j < size) {
-                out << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << (int)p[i + j] << ' ';
+            if (j % 8 == 0) *out++ = ' ';
+            if (j < n) {
+                std::memcpy(out, kHexTables.hex + 2 * p[i + j], 2);
             } else {
-                out << "   ";
+                out[0] = out[1] = ' ';
             }
+            out[2] = ' ';
+            out += 3;
         }
-        out << " ";
-        // ascii
-        for (std::size_t j = 0; j < width && i + j < size; ++j) {
-            unsigned char c = p[i + j];
-            out << (std::isprint(c) ? (char)c : '.');
-        }
-        out << '\n';
+        *out++ = ' ';
+        *out++ = '|';
+        for (std::size_t j = 0; j < n; ++j) *out++ = kHexTables.ascii[p[i + j]];
+        *out++ = '|';
+        *out++ = '\n';
     }
-    ESH_LOG_INFO() << out.str();
+    if (static_cast<std::size_t>(buf + sizeof(buf) - out) < maxLine && !flush()) return false;
+    out = put_offset(out, opt.baseOffset + size, wide);
+    *out++ = '\n';
+    return flush();
+}
+
+bool DebugTools::hexdumpTo(int fd, const void* data, std::size_t size, const HexdumpOptions& opt) {
+    return hexdumpTo([fd](const char* chunk, std::size_t len) {
+        while (len > 0) {
+            ssize_t n = ::write(fd, chunk, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            chunk += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }, data, size, opt);
+}
+
+void DebugTools::hexdump(const void* data, std::size_t size, std::size_t width, const char* label) {
+    ESH_LOG_INFO() << label << " (" << size << " bytes)";
+    HexdumpOptions opt;
+    opt.width = width;
+    hexdumpTo([](const char* chunk, std::size_t len) {
+        if (len && chunk[len - 1] == '\n') --len;
+        ESH_LOG_INFO() << std::string_view(chunk, len);
+        return true;
+    }, data, size, opt);
 }
 
 void DebugTools::logEnvironment() {
@@ -77,6 +160,29 @@ void DebugTools::logMemoryUsage() {
 #endif
 }
 
+void DebugTools::heapReport(std::ostream& out, std::size_t top) {
+    if (!alloc::enabled()) {
+        out << "Allocation tracking is not compiled in (make re ALLOC_TRACKING=1)\n";
+        return;
+    }
+    alloc::Totals t = alloc::totals();
+    out << "Heap: " << t.allocs << " allocation(s), " << t.frees << " free(s), " << t.bytes << " bytes allocated, "
+        << t.live << " live, " << t.peak << " peak\n";
+    out << std::left << std::setw(24) << "  tag" << std::right << std::setw(10) << "allocs" << std::setw(14) << "bytes"
+        << std::setw(8) << "avg" << std::setw(12) << "live" << "\n";
+    for (const auto& s : alloc::top(top)) {
+        out << "  " << std::left << std::setw(22) << s.tag << std::right << std::setw(10) << s.allocs
+            << std::setw(14) << s.bytes << std::setw(8) << (s.allocs ? s.bytes / s.allocs : 0) << std::setw(12)
+            << static_cast<long long>(s.live()) << "\n";
+    }
+}
+
+void DebugTools::logHeapStats(std::size_t top) {
+    std::ostringstream out;
+    heapReport(out, top);
+    ESH_LOG_INFO() << out.str();
+}
+
 void DebugTools::logCallstack(std::size_t maxFrames) {
 #if defined(__linux__)
     void* addrs[256];
@@ -141,4 +247,181 @@ DebugTools::ScopeTrace::~ScopeTrace() {
     ESH_LOG_DEBUG() << "Leave: " << _name;
 }
 
+#if defined(__linux__)
+namespace {
+
+const std::size_t kProfileSlots = 4096;
+const int kProfileSkip = 2;    // the handler and the signal trampoline
+const int kProfileDepth = 64;  // including the skipped frames
+
+// seq is the sample number + 1 once the slot is complete, 0 while written
+struct ProfileSlot {
+    std::atomic<std::uint64_t> seq;
+    int depth;
+    void* pcs[kProfileDepth];
+};
+
+ProfileSlot* g_ring = nullptr;
+std::atomic<std::uint64_t> g_taken{0};
+std::atomic<bool> g_profiling{false};
+bool g_handlerInstalled = false;
+timer_t g_timer;
+
+// Async-signal-safe: atomics and backtrace(), which start() has already
+// called once so the unwinder is loaded
+void on_sigprof(int) {
+    if (!g_profiling.load(std::memory_order_relaxed)) return;
+    int savedErrno = errno;
+    std::uint64_t n = g_taken.fetch_add(1, std::memory_order_relaxed);
+    ProfileSlot& slot = g_ring[n % kProfileSlots];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    slot.depth = backtrace(slot.pcs, kProfileDepth);
+    slot.seq.store(n + 1, std::memory_order_release);
+    errno = savedErrno;
+}
+
+// "Class::method" when the symbol is exported, else "module+0xoff"
+std::string frame_name(void* pc) {
+    Dl_info info;
+    std::string name;
+    if (dladdr(pc, &info) && info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        // Drop the parameter list: "f(int) const" -> "f"
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, " const") == 0) name.resize(name.size() - 6);
+        if (!name.empty() && name.back() == ')') {
+            int open = 0;
+            for (std::size_t i = name.size(); i-- > 0;) {
+                open += name[i] == ')' ? 1 : (name[i] == '(' ? -1 : 0);
+                if (open == 0) {
+                    name.resize(i);
+                    break;
+                }
+            }
+        }
+    } else if (info.dli_fname) {
+        std::ostringstream os;
+        const char* base = std::strrchr(info.dli_fname, '/');
+        os << (base ? base + 1 : info.dli_fname) << "+0x" << std::hex
+           << (reinterpret_cast<std::uintptr_t>(pc) - reinterpret_cast<std::uintptr_t>(info.dli_fbase));
+        name = os.str();
+    } else {
+        std::ostringstream os;
+        os << pc;
+        name = os.str();
+    }
+    std::replace(name.begin(), name.end(), ';', ':');   // the collapsed format's separator
+    return name;
+}
+
+} // namespace
+
+bool DebugTools::Profiler::start(unsigned hz, std::string* error) {
+    auto fail = [error](const std::string& why) {
+        if (error) *error = why;
+        return false;
+    };
+    if (g_profiling.load()) return fail("profiler already running");
+    if (hz == 0 || hz > 10000) return fail("rate must be 1-10000 Hz");
+    if (!g_ring) g_ring = new ProfileSlot[kProfileSlots]();
+    for (std::size_t i = 0; i < kProfileSlots; ++i) g_ring[i].seq.store(0, std::memory_order_relaxed);
+    g_taken.store(0);
+
+    void* warmup[4];
+    backtrace(warmup, 4);
+    // Installed once and kept: a SIGPROF still pending after stop() must not
+    // hit the default action, which terminates the process
+    if (!g_handlerInstalled) {
+        struct sigaction sa{};
+        sa.sa_handler = on_sigprof;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, nullptr) != 0) return fail(std::string("sigaction: ") + std::strerror(errno));
+        g_handlerInstalled = true;
+    }
+    struct sigevent sev{};
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &sev, &g_timer) != 0) {
+        return fail(std::string("timer_create: ") + std::strerror(errno));
+    }
+    long periodNs = 1000000000L / static_cast<long>(hz);
+    struct itimerspec its{};
+    its.it_interval.tv_sec = periodNs / 1000000000L;
+    its.it_interval.tv_nsec = periodNs % 1000000000L;
+    its.it_value = its.it_interval;
+    g_profiling.store(true);
+    if (timer_settime(g_timer, 0, &its, nullptr) != 0) {
+        g_profiling.store(false);
+        timer_delete(g_timer);
+        return fail(std::string("timer_settime: ") + std::strerror(errno));
+    }
+    ESH_LOG_INFO() << "Profiler started at " << hz << " Hz";
+    return true;
+}
+
+void DebugTools::Profiler::stop() {
+    if (!g_profiling.exchange(false)) return;
+    timer_delete(g_timer);
+    ESH_LOG_INFO() << "Profiler stopped after " << samples() << " sample(s)";
+}
+
+bool DebugTools::Profiler::running() noexcept {
+    return g_profiling.load();
+}
+
+std::size_t DebugTools::Profiler::samples() noexcept {
+    return static_cast<std::size_t>(g_taken.load());
+}
+
+std::size_t DebugTools::Profiler::dump(std::ostream& out) {
+    if (!g_ring) return 0;
+    std::map<std::vector<void*>, std::size_t> stacks;
+    std::vector<void*> stack;
+    for (std::size_t i = 0; i < kProfileSlots; ++i) {
+        const ProfileSlot& slot = g_ring[i];
+        std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0) continue;
+        int depth = std::min(slot.depth, kProfileDepth);
+        stack.assign(slot.pcs + std::min(depth, kProfileSkip), slot.pcs + depth);
+        if (slot.seq.load(std::memory_order_acquire) != seq || stack.empty()) continue;   // rewritten meanwhile
+        ++stacks[stack];
+    }
+
+    std::unordered_map<void*, std::string> names;
+    std::vector<std::pair<std::size_t, std::string>> lines;
+    lines.reserve(stacks.size());
+    std::size_t total = 0;
+    for (const auto& kv : stacks) {
+        std::string line;
+        for (std::size_t i = kv.first.size(); i-- > 0;) {
+            // Return addresses point past the call; look up the call itself
+            void* pc = kv.first[i];
+            void* lookup = i == 0 ? pc : static_cast<char*>(pc) - 1;
+            auto it = names.find(lookup);
+            if (it == names.end()) it = names.emplace(lookup, frame_name(lookup)).first;
+            if (!line.empty()) line += ';';
+            line += it->second;
+        }
+        lines.emplace_back(kv.second, std::move(line));
+        total += kv.second;
+    }
+    std::sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (const auto& l : lines) out << l.second << ' ' << l.first << '\n';
+    return total;
+}
+#else
+bool DebugTools::Profiler::start(unsigned, std::string* error) {
+    if (error) *error = "profiler not available on this platform";
+    return false;
+}
+void DebugTools::Profiler::stop() {}
+bool DebugTools::Profiler::running() noexcept { return false; }
+std::size_t DebugTools::Profiler::samples() noexcept { return 0; }
+std::size_t DebugTools::Profiler::dump(std::ostream&) { return 0; }
+#endif
+
 } // namespace esh
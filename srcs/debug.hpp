@@ -1,20 +1,44 @@
 #pragma once
 #include <string>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 
 namespace esh {
 
+struct HexdumpOptions {
+    std::size_t width = 16;         // bytes per line, 1-64
+    std::uint64_t baseOffset = 0;   // offset printed for data[0]
+    bool collapse = true;           // "*" for runs of lines equal to the one above
+};
+
 class DebugTools {
 public:
-    // Print a hexdump to logs (INFO)
+    // Print a hexdump to logs (INFO), one record per 64 KiB of output
     static void hexdump(const void* data, std::size_t size, std::size_t width = 16, const char* label = "hexdump");
 
+    // Receives whole lines, at most 64 KiB at a time; false stops the dump
+    using HexSink = std::function<bool(const char* data, std::size_t size)>;
+
+    // hexdump -C layout: offset, hex bytes in groups of 8, |ascii|, and a
+    // final line with the end offset. Encodes through lookup tables into a
+    // fixed buffer; memory use does not depend on size. False when the sink
+    // (or write()) failed.
+    static bool hexdumpTo(const HexSink& sink, const void* data, std::size_t size, const HexdumpOptions& opt = {});
+    static bool hexdumpTo(int fd, const void* data, std::size_t size, const HexdumpOptions& opt = {});
+
     // Log environment variables (DEBUG)
     static void logEnvironment();
 
     // Log current process memory usage (Linux /proc/self/status)
     static void logMemoryUsage();
 
+    // Allocation totals and the tags that allocated the most bytes (needs a
+    // build with ALLOC_TRACKING=1, see alloc.hpp)
+    static void heapReport(std::ostream& out, std::size_t top = 15);
+    static void logHeapStats(std::size_t top = 15);
+
     // Log a call stack if available (Linux/glibc)
     static void logCallstack(std::size_t maxFrames = 32);
 
@@ -24,6 +48,22 @@ public:
     // Assertion with logging
     static void assertTrue(bool cond, const std::string& message, const char* file, int line, const char* func);
 
+    // Sampling profiler: a process CPU-time timer raises SIGPROF hz times per
+    // CPU second, and the handler only copies the raw stack into a ring
+    // allocated by start() (oldest samples are overwritten). Symbols are
+    // looked up at dump time. Linux only.
+    class Profiler {
+    public:
+        static bool start(unsigned hz = 99, std::string* error = nullptr);
+        static void stop();
+        static bool running() noexcept;
+        // Samples taken since start, including overwritten ones
+        static std::size_t samples() noexcept;
+        // Collapsed stacks, root first ("main;Shell::run;... 42"), most
+        // frequent first, for flamegraph.pl. Returns the samples written.
+        static std::size_t dump(std::ostream& out);
+    };
+
     // RAII: measure scope time
     class ScopeTimer {
     public:
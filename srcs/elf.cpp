@@ -0,0 +1,156 @@
+#include "elf.hpp"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+
+namespace esh {
+
+static void sort_unique(std::vector<std::string_view>& v) {
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+// Every offset and size comes from the file: check each one against the mapping
+template <typename Ehdr, typename Shdr, typename Sym, typename Phdr>
+bool ElfFile::readSymbols(std::string* error) {
+    const char* base = _file.data();
+    const std::size_t size = _file.size();
+    auto fail = [error](const char* why) {
+        if (error) *error = why;
+        return false;
+    };
+    if (size < sizeof(Ehdr)) return fail("truncated ELF header");
+    Ehdr eh;
+    std::memcpy(&eh, base, sizeof(eh));
+    bool interp = false;
+    if (eh.e_phoff != 0 && eh.e_phnum != 0) {
+        if (eh.e_phentsize != sizeof(Phdr) || eh.e_phoff > size || (size - eh.e_phoff) / sizeof(Phdr) < eh.e_phnum) {
+            return fail("bad program header table");
+        }
+        const Phdr* phdrs = reinterpret_cast<const Phdr*>(base + eh.e_phoff);
+        for (std::size_t i = 0; i < eh.e_phnum; ++i) {
+            if (phdrs[i].p_type == PT_INTERP) interp = true;
+            if (_wantFunctions && phdrs[i].p_type == PT_LOAD) {
+                _segments.push_back({phdrs[i].p_offset, phdrs[i].p_vaddr, phdrs[i].p_filesz});
+            }
+        }
+    }
+    // Checked again once the symbols are read: a static PIE is ET_DYN like a
+    // shared object, but imports nothing
+    _static = !interp && (eh.e_type == ET_EXEC || eh.e_type == ET_DYN);
+    if (eh.e_shoff == 0 || eh.e_shnum == 0) return true;   // no section table: nothing to read
+    if (eh.e_shentsize != sizeof(Shdr) || eh.e_shoff > size ||
+        (size - eh.e_shoff) / sizeof(Shdr) < eh.e_shnum) {
+        return fail("bad section header table");
+    }
+    const Shdr* sections = reinterpret_cast<const Shdr*>(base + eh.e_shoff);
+
+    for (std::size_t i = 0; i < eh.e_shnum; ++i) {
+        const Shdr& sh = sections[i];
+        if (sh.sh_type != SHT_SYMTAB && sh.sh_type != SHT_DYNSYM) continue;
+        if (sh.sh_entsize != sizeof(Sym) || sh.sh_offset > size || sh.sh_size > size - sh.sh_offset ||
+            sh.sh_link >= eh.e_shnum) {
+            return fail("bad symbol table");
+        }
+        const Shdr& strtab = sections[sh.sh_link];
+        if (strtab.sh_offset > size || strtab.sh_size > size - strtab.sh_offset) return fail("bad string table");
+        const char* strings = base + strtab.sh_offset;
+        const std::size_t stringsSize = strtab.sh_size;
+
+        const Sym* syms = reinterpret_cast<const Sym*>(base + sh.sh_offset);
+        const std::size_t count = sh.sh_size / sizeof(Sym);
+        for (std::size_t k = 1; k < count; ++k) {   // entry 0 is the null symbol
+            const Sym& sym = syms[k];
+            const unsigned bind = ELF64_ST_BIND(sym.st_info);
+            const unsigned type = ELF64_ST_TYPE(sym.st_info);
+            const bool global = bind == STB_GLOBAL || bind == STB_WEAK;
+            if ((!global && !(_wantFunctions && type == STT_FUNC)) || sym.st_name == 0 || sym.st_name >= stringsSize) {
+                continue;
+            }
+            const char* name = strings + sym.st_name;
+            const void* nul = std::memchr(name, '\0', stringsSize - sym.st_name);
+            std::string_view view(name, nul ? static_cast<std::size_t>(static_cast<const char*>(nul) - name)
+                                            : stringsSize - sym.st_name);
+            view = view.substr(0, view.find('@'));
+            if (view.empty()) continue;
+            if (_wantFunctions && type == STT_FUNC && sym.st_shndx != SHN_UNDEF && sym.st_value != 0) {
+                _functions.push_back({sym.st_value, sym.st_size, view});
+            }
+            if (!global) continue;
+            if (sym.st_shndx != SHN_UNDEF) {
+                _defined.push_back(view);
+            } else if (bind == STB_GLOBAL && (type == STT_FUNC || type == STT_NOTYPE)) {
+                _undefined.push_back(view);
+            }
+        }
+    }
+    return true;
+}
+
+bool ElfFile::open(const std::string& path, std::string* error, bool functions) {
+    _undefined.clear();
+    _defined.clear();
+    _functions.clear();
+    _segments.clear();
+    _static = false;
+    _wantFunctions = functions;
+    if (!_file.open(path)) {
+        if (error) *error = "cannot read " + path;
+        return false;
+    }
+    const unsigned char* ident = reinterpret_cast<const unsigned char*>(_file.data());
+    if (_file.size() < EI_NIDENT || std::memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        if (error) *error = path + " is not an ELF file";
+        return false;
+    }
+    const bool native = ident[EI_DATA] == (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? ELFDATA2LSB : ELFDATA2MSB);
+    if (!native) {
+        if (error) *error = path + ": foreign byte order";
+        return false;
+    }
+    std::string why;
+    bool ok = ident[EI_CLASS] == ELFCLASS64 ? readSymbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, Elf64_Phdr>(&why)
+            : ident[EI_CLASS] == ELFCLASS32 ? readSymbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, Elf32_Phdr>(&why)
+            : (why = "unknown ELF class", false);
+    if (!ok) {
+        if (error) *error = path + ": " + why;
+        _undefined.clear();
+        _defined.clear();
+        _functions.clear();
+        _segments.clear();
+        _static = false;
+        return false;
+    }
+    sort_unique(_undefined);
+    sort_unique(_defined);
+    if (!_undefined.empty()) _static = false;
+    // .symtab and .dynsym list the same exported functions twice
+    std::sort(_functions.begin(), _functions.end(), [](const Function& a, const Function& b) {
+        return a.addr != b.addr ? a.addr < b.addr : a.size > b.size;
+    });
+    _functions.erase(std::unique(_functions.begin(), _functions.end(),
+                                 [](const Function& a, const Function& b) { return a.addr == b.addr; }),
+                     _functions.end());
+    return true;
+}
+
+const ElfFile::Function* ElfFile::functionAt(std::uint64_t vaddr) const noexcept {
+    auto it = std::upper_bound(_functions.begin(), _functions.end(), vaddr,
+                               [](std::uint64_t a, const Function& f) { return a < f.addr; });
+    if (it == _functions.begin()) return nullptr;
+    const Function& f = *--it;
+    if (f.size != 0 && vaddr >= f.addr + f.size) return nullptr;
+    return &f;
+}
+
+bool ElfFile::vaddrOf(std::uint64_t fileOffset, std::uint64_t& vaddr) const noexcept {
+    for (const auto& seg : _segments) {
+        if (fileOffset >= seg.offset && fileOffset - seg.offset < seg.size) {
+            vaddr = seg.vaddr + (fileOffset - seg.offset);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace esh
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mapped_file.hpp"
+
+namespace esh {
+
+// Global symbols of one ELF file (relocatable object, executable or shared
+// object), read straight from the mapped .symtab and .dynsym sections.
+// Names are views into the mapping, with any "@VERSION" suffix cut off;
+// both lists are sorted and free of duplicates. With functions=true, open()
+// also keeps every function symbol (local ones included) with its address
+// and the loadable segments, for symbolizing addresses from a crash.
+class ElfFile {
+public:
+    struct Function {
+        std::uint64_t addr;
+        std::uint64_t size;
+        std::string_view name;   // mangled
+    };
+
+    bool open(const std::string& path, std::string* error = nullptr, bool functions = false);
+
+    // Functions referenced but not defined here (weak references excluded)
+    const std::vector<std::string_view>& undefined() const noexcept { return _undefined; }
+    const std::vector<std::string_view>& defined() const noexcept { return _defined; }
+    // An executable without a program interpreter: libc is linked in, so
+    // nothing is left undefined and undefined() says nothing about its calls
+    bool staticallyLinked() const noexcept { return _static; }
+
+    // The function whose [addr, addr + size) holds vaddr (the nearest one
+    // below it when sizes are missing), or nullptr
+    const Function* functionAt(std::uint64_t vaddr) const noexcept;
+    // Virtual address of a file offset inside a PT_LOAD segment, as found in
+    // /proc/<pid>/maps
+    bool vaddrOf(std::uint64_t fileOffset, std::uint64_t& vaddr) const noexcept;
+
+private:
+    struct Segment {
+        std::uint64_t offset;
+        std::uint64_t vaddr;
+        std::uint64_t size;
+    };
+
+    template <typename Ehdr, typename Shdr, typename Sym, typename Phdr>
+    bool readSymbols(std::string* error);
+
+    MappedFile _file;
+    bool _wantFunctions = false;
+    bool _static = false;
+    std::vector<std::string_view> _undefined;
+    std::vector<std::string_view> _defined;
+    std::vector<Function> _functions;   // sorted by address
+    std::vector<Segment> _segments;
+};
+
+} // namespace esh
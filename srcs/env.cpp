@@ -0,0 +1,82 @@
+#include "env.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+extern char **environ;
+
+namespace esh {
+
+EnvSnapshot EnvSnapshot::capture() {
+    EnvSnapshot snap;
+    std::size_t count = 0;
+    for (char **envp = environ; envp && *envp; ++envp) {
+        snap._bytes += std::strlen(*envp) + 1;
+        ++count;
+    }
+    snap._arena.reset(new char[snap._bytes ? snap._bytes : 1]);
+    snap._entries.reserve(count);
+
+    char* p = snap._arena.get();
+    for (char **envp = environ; envp && *envp; ++envp) {
+        std::size_t len = std::strlen(*envp);
+        std::memcpy(p, *envp, len + 1);
+        const char* eq = static_cast<const char*>(std::memchr(p, '=', len));
+        if (eq) {
+            std::size_t klen = static_cast<std::size_t>(eq - p);
+            snap._entries.push_back({std::string_view(p, klen), std::string_view(eq + 1, len - klen - 1)});
+        }
+        p += len + 1;
+    }
+
+    // getenv() returns the first definition of a duplicated key: keep that one
+    std::stable_sort(snap._entries.begin(), snap._entries.end(),
+                     [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    snap._entries.erase(std::unique(snap._entries.begin(), snap._entries.end(),
+                                    [](const Entry& a, const Entry& b) { return a.key == b.key; }),
+                        snap._entries.end());
+    return snap;
+}
+
+const EnvSnapshot::Entry* EnvSnapshot::find(std::string_view key) const {
+    auto it = std::lower_bound(_entries.begin(), _entries.end(), key,
+                               [](const Entry& e, std::string_view k) { return e.key < k; });
+    if (it == _entries.end() || it->key != key) return nullptr;
+    return &*it;
+}
+
+// Both entry lists are sorted, so one merge walk finds every difference
+EnvSnapshot::Diff EnvSnapshot::diffFrom(const EnvSnapshot& current) const {
+    Diff d;
+    auto a = _entries.begin(), ae = _entries.end();
+    auto b = current._entries.begin(), be = current._entries.end();
+    while (a != ae || b != be) {
+        if (b == be || (a != ae && a->key < b->key)) {
+            d.set.push_back(*a++);
+        } else if (a == ae || b->key < a->key) {
+            d.unset.push_back((b++)->key);
+        } else {
+            if (a->value != b->value) d.set.push_back(*a);
+            ++a;
+            ++b;
+        }
+    }
+    return d;
+}
+
+std::size_t EnvSnapshot::restore() const {
+    EnvSnapshot current = capture();
+    Diff d = diffFrom(current);
+    std::string key;
+    for (const auto& e : d.set) {
+        key.assign(e.key.data(), e.key.size());
+        setenv(key.c_str(), e.value.data(), 1);
+    }
+    for (const auto& k : d.unset) {
+        key.assign(k.data(), k.size());
+        unsetenv(key.c_str());
+    }
+    return d.set.size() + d.unset.size();
+}
+
+} // namespace esh
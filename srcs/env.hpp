@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace esh {
+
+// Immutable copy of the process environment: every "KEY=VALUE" string lives
+// in one arena block, indexed by views sorted on the key for binary search.
+class EnvSnapshot {
+public:
+    struct Entry {
+        std::string_view key;
+        std::string_view value;   // NUL-terminated in the arena
+    };
+
+    struct Diff {
+        std::vector<Entry> set;               // changed or missing variables
+        std::vector<std::string_view> unset;  // variables added since the snapshot
+        bool empty() const noexcept { return set.empty() && unset.empty(); }
+    };
+
+    EnvSnapshot() = default;
+    static EnvSnapshot capture();
+
+    const Entry* find(std::string_view key) const;
+    const std::vector<Entry>& entries() const noexcept { return _entries; }
+    std::size_t size() const noexcept { return _entries.size(); }
+    std::size_t bytes() const noexcept { return _bytes; }
+
+    // What has to be applied to `current` to turn it back into this snapshot
+    Diff diffFrom(const EnvSnapshot& current) const;
+
+    // Apply the diff against the live environment; returns variables touched
+    std::size_t restore() const;
+
+private:
+    std::unique_ptr<char[]> _arena;
+    std::size_t _bytes = 0;
+    std::vector<Entry> _entries;
+};
+
+} // namespace esh
@@ -0,0 +1,235 @@
+#include "exporter.hpp"
+#include "log.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace esh {
+
+namespace {
+
+const int kRequestWaitMs = 200;   // how long to wait for an HTTP request line
+
+template <typename Int>
+void append_int(std::string& out, Int v) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, res.ptr);
+}
+
+void append_header(std::string& out, const metrics::Sample& s, const char* type) {
+    out += "# HELP ";
+    out += s.name;
+    out += ' ';
+    out += s.help;
+    out += "\n# TYPE ";
+    out += s.name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// Label values escape \, " and newlines
+void append_label_value(std::string& out, const char* s, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        if (s[i] == '\\' || s[i] == '"') out += '\\';
+        if (s[i] == '\n') out += "\\n";
+        else out += s[i];
+    }
+}
+
+bool send_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool parse_port(const std::string& s, unsigned short& port) {
+    if (s.empty() || s.size() > 5 || s.find_first_not_of("0123456789") != std::string::npos) return false;
+    unsigned long n = std::stoul(s);
+    if (n == 0 || n > 65535) return false;
+    port = static_cast<unsigned short>(n);
+    return true;
+}
+
+} // namespace
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const std::string& endpoint, std::string* error) {
+    auto fail = [&](const std::string& why) {
+        if (error) *error = endpoint + ": " + why;
+        if (_listenFd >= 0) close(_listenFd);
+        _listenFd = -1;
+        _unixPath.clear();
+        return false;
+    };
+    if (running()) return fail("exporter already running");
+
+    std::string path;
+    std::string port;
+    if (endpoint.compare(0, 5, "unix:") == 0) path = endpoint.substr(5);
+    else if (endpoint.compare(0, 4, "tcp:") == 0) port = endpoint.substr(4);
+    else if (endpoint.compare(0, 10, "127.0.0.1:") == 0) port = endpoint.substr(10);
+    else if (endpoint.find('/') != std::string::npos) path = endpoint;
+    else return fail("expected unix:PATH, tcp:PORT or 127.0.0.1:PORT");
+
+    if (!path.empty()) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return fail("socket path too long");
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        struct stat st;
+        // A socket left by a previous shell is replaced; one that still
+        // accepts belongs to a live process, and anything else is not ours
+        if (lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) return fail("exists and is not a socket");
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe < 0) return fail(std::strerror(errno));
+            int rc = connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            int err = errno;
+            close(probe);
+            if (rc == 0) return fail("in use by another process");
+            if (err != ECONNREFUSED) return fail(std::strerror(err));
+            unlink(path.c_str());
+        }
+        _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (_listenFd < 0 || bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            return fail(std::strerror(errno));
+        }
+        _unixPath = path;
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        unsigned short p = 0;
+        if (!parse_port(port, p)) return fail("bad port");
+        addr.sin_port = htons(p);
+        _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        int one = 1;
+        if (_listenFd < 0 || setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            return fail(std::strerror(errno));
+        }
+    }
+    if (listen(_listenFd, 16) != 0) return fail(std::strerror(errno));
+
+    _loop.reset(new EventLoop());
+    _loop->watchFd(_listenFd, [this] { onAccept(); });
+    _thread = std::thread([this] { _loop->run(); });
+    ESH_LOG_INFO() << "Metrics exporter listening on " << endpoint;
+    return true;
+}
+
+void MetricsExporter::stop() {
+    if (!running()) return;
+    _loop->post([this] { _loop->stop(); });
+    _thread.join();
+    _loop.reset();
+    close(_listenFd);
+    _listenFd = -1;
+    if (!_unixPath.empty()) unlink(_unixPath.c_str());
+    _unixPath.clear();
+}
+
+void MetricsExporter::onAccept() {
+    for (;;) {
+        int client = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESH_LOG_WARN() << "Metrics exporter: accept failed: " << std::strerror(errno);
+            }
+            return;
+        }
+        serve(client);
+        close(client);
+    }
+}
+
+// Scrapes are served one at a time; a stalled client costs at most the
+// request wait plus the send timeout
+void MetricsExporter::serve(int client) {
+    timeval sendTimeout{1, 0};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+    char request[1024];
+    ssize_t n = 0;
+    pollfd pfd{client, POLLIN, 0};
+    if (poll(&pfd, 1, kRequestWaitMs) > 0) n = recv(client, request, sizeof(request), 0);
+    const bool http = n >= 4 && std::memcmp(request, "GET ", 4) == 0;
+
+    _body.clear();
+    if (const metrics::Segment* seg = metrics::self()) render(*seg, _samples, _body);
+    if (!http) {
+        send_all(client, _body.data(), _body.size());
+        return;
+    }
+    _response.clear();
+    _response += "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: ";
+    append_int(_response, _body.size());
+    _response += "\r\nConnection: close\r\n\r\n";
+    if (send_all(client, _response.data(), _response.size())) send_all(client, _body.data(), _body.size());
+}
+
+void MetricsExporter::render(const metrics::Segment& seg, std::vector<metrics::Sample>& samples, std::string& out) {
+    metrics::snapshot(seg, samples);
+    out += "# HELP esh_info Exam shell process\n# TYPE esh_info gauge\nesh_info{pid=\"";
+    append_int(out, seg.pid);
+    out += "\",label=\"";
+    append_label_value(out, seg.label, strnlen(seg.label, sizeof(seg.label)));
+    out += "\"} 1\n";
+    out += "# HELP esh_start_time_seconds Process start, seconds since the epoch\n"
+           "# TYPE esh_start_time_seconds gauge\nesh_start_time_seconds ";
+    append_int(out, seg.startNs / 1000000000ull);
+    out += '\n';
+
+    for (const auto& s : samples) {
+        if (s.type == metrics::Type::Counter) {
+            append_header(out, s, "counter");
+        } else if (s.type == metrics::Type::Gauge) {
+            append_header(out, s, "gauge");
+        } else {
+            append_header(out, s, "histogram");
+            std::uint64_t cumulative = 0;
+            for (std::size_t i = 0; i < s.buckets.size(); ++i) {
+                cumulative += s.buckets[i];
+                out += s.name;
+                out += "_bucket{le=\"";
+                if (i < s.bounds.size()) append_int(out, s.bounds[i]);
+                else out += "+Inf";
+                out += "\"} ";
+                append_int(out, cumulative);
+                out += '\n';
+            }
+            out += s.name;
+            out += "_sum ";
+            append_int(out, s.sum);
+            out += '\n';
+            out += s.name;
+            out += "_count ";
+            append_int(out, static_cast<std::uint64_t>(s.value));
+            out += '\n';
+            continue;
+        }
+        out += s.name;
+        out += ' ';
+        append_int(out, static_cast<std::int64_t>(s.value));
+        out += '\n';
+    }
+}
+
+} // namespace esh
@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "loop.hpp"
+#include "metrics.hpp"
+
+namespace esh {
+
+// Serves this process's metrics segment in the Prometheus text format
+// (0.0.4) on a Unix socket or a loopback TCP port, for local scrapers. It
+// runs its own event loop on a dedicated thread, so scrapes never touch the
+// REPL, and renders into buffers kept across scrapes. A client sending an
+// HTTP GET gets an HTTP response; anything else gets the bare text.
+class MetricsExporter {
+public:
+    MetricsExporter() = default;
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // endpoint: "unix:PATH", a path containing '/', "tcp:PORT" or
+    // "127.0.0.1:PORT" (only loopback is accepted)
+    bool start(const std::string& endpoint, std::string* error = nullptr);
+    void stop();
+    bool running() const noexcept { return _thread.joinable(); }
+
+    // Appends the exposition of seg to out; samples is scratch space
+    static void render(const metrics::Segment& seg, std::vector<metrics::Sample>& samples, std::string& out);
+
+private:
+    void onAccept();
+    void serve(int client);
+
+    int _listenFd = -1;
+    std::string _unixPath;
+    std::unique_ptr<EventLoop> _loop;
+    std::thread _thread;
+
+    // Owned by the exporter thread
+    std::vector<metrics::Sample> _samples;
+    std::string _body;
+    std::string _response;
+};
+
+} // namespace esh
@@ -0,0 +1,331 @@
+#include "jobs.hpp"
+#include "log.hpp"
+#include "loop.hpp"
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace esh {
+
+JobContext::JobContext(std::shared_ptr<Job> job, const std::atomic<EventLoop*>* loop, const SpawnHook* onSpawn)
+: _job(std::move(job)), _loop(loop), _onSpawn(onSpawn) {}
+
+std::ostream& JobContext::out() {
+    if (_job->background) return _job->output;
+    return std::cout;
+}
+
+void JobContext::progress(int percent, const std::string& label) {
+    _job->progress.store(std::max(-1, std::min(100, percent)));
+    std::lock_guard<std::mutex> lock(_job->labelMx);
+    _job->label = label;
+}
+
+bool JobContext::cancelled() const noexcept {
+    return _job->cancelRequested.load();
+}
+
+int JobContext::spawn(const std::vector<std::string>& argv, std::string* output, std::size_t maxOutput) {
+    if (argv.empty() || cancelled()) return -1;
+
+    // Build argv before fork: the child may only call async-signal-safe functions
+    std::vector<char*> args;
+    args.reserve(argv.size() + 1);
+    for (const auto& a : argv) args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+
+    const bool capture = _job->background || output;
+    int pipefd[2] = {-1, -1};
+    if (capture && pipe2(pipefd, O_CLOEXEC) != 0) {
+        ESH_LOG_ERROR() << "pipe2 failed for job " << _job->id;
+        return -1;
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        if (capture) { close(pipefd[0]); close(pipefd[1]); }
+        ESH_LOG_ERROR() << "fork failed for job " << _job->id;
+        return -1;
+    }
+    if (pid == 0) {
+        // The shell blocks its signals to read them from a signalfd; exec keeps the mask
+        EventLoop::unblockAllSignals();
+        setpgid(0, 0);
+        // The child's group never owns the terminal, so reading it would stop on SIGTTIN
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) dup2(devnull, STDIN_FILENO);
+        if (capture) {
+            dup2(pipefd[1], STDOUT_FILENO);
+            dup2(pipefd[1], STDERR_FILENO);
+        }
+        execvp(args[0], args.data());
+        _exit(127);
+    }
+
+    // Both sides call setpgid so the group exists before anyone signals it
+    setpgid(pid, pid);
+    _job->child.store(pid);
+    if (cancelled()) kill(-pid, SIGTERM);
+    ESH_LOG_DEBUG() << "Job " << _job->id << " spawned pid=" << pid << " cmd=" << argv[0];
+
+    if (capture) {
+        close(pipefd[1]);
+        char buf[4096];
+        for (;;) {
+            ssize_t n = read(pipefd[0], buf, sizeof(buf));
+            if (n > 0) {
+                if (!output) {
+                    _job->output.write(buf, n);
+                    continue;
+                }
+                output->append(buf, static_cast<std::size_t>(n));
+                if (maxOutput && output->size() > maxOutput) {
+                    output->resize(maxOutput + 1);
+                    kill(-pid, SIGKILL);
+                    ESH_LOG_WARN() << "Job " << _job->id << " killed pid=" << pid << " cmd=" << argv[0]
+                                   << ": more than " << maxOutput << " bytes of output";
+                    break;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        close(pipefd[0]);
+    }
+
+    int status = waitChild(pid);
+    _job->child.store(0);
+
+    int result = -1;
+    if (status != -1 && WIFEXITED(status)) result = WEXITSTATUS(status);
+    else if (status != -1 && WIFSIGNALED(status)) result = 128 + WTERMSIG(status);
+    if (_onSpawn && *_onSpawn) (*_onSpawn)(argv, result, std::chrono::steady_clock::now() - started);
+    return result;
+}
+
+static const int kNotWatched = -1;  // never a valid waitpid() status
+
+// Hand the pid to the event loop, which reaps it when its pidfd becomes
+// readable. Falls back to a blocking waitpid() without a loop, when pidfd is
+// unsupported, or when the loop is detached while we wait.
+int JobContext::waitChild(pid_t pid) {
+    EventLoop* loop = _loop ? _loop->load() : nullptr;
+    if (loop) {
+        auto result = std::make_shared<std::promise<int>>();
+        std::future<int> status = result->get_future();
+        loop->post([loop, pid, result] {
+            bool watched = loop->watchProcess(pid, [result](int st) { result->set_value(st); });
+            if (!watched) result->set_value(kNotWatched);
+        });
+        while (status.wait_for(std::chrono::milliseconds(200)) != std::future_status::ready) {
+            if (_loop->load() != loop) break;
+        }
+        if (status.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            int st = status.get();
+            if (st != kNotWatched) return st;
+        }
+    }
+    int st = 0;
+    while (waitpid(pid, &st, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return st;
+}
+
+JobManager::JobManager(unsigned workers) {
+    workers = std::max(1u, workers);
+    for (unsigned i = 0; i < workers; ++i) {
+        _workers.emplace_back(&JobManager::workerLoop, this);
+    }
+}
+
+JobManager::~JobManager() {
+    _loop.store(nullptr);
+    cancelAll();
+    _stop = true;
+    _qCv.notify_all();
+    for (auto& t : _workers) {
+        if (t.joinable()) t.join();
+    }
+    if (_foregroundThread.joinable()) _foregroundThread.join();
+}
+
+void JobManager::setOnFinished(std::function<void()> fn) {
+    _onFinished = std::move(fn);
+}
+
+const char* JobManager::stateName(Job::State s) noexcept {
+    switch (s) {
+        case Job::State::Queued:    return "Queued";
+        case Job::State::Running:   return "Running";
+        case Job::State::Done:      return "Done";
+        case Job::State::Failed:    return "Failed";
+        case Job::State::Cancelled: return "Cancelled";
+    }
+    return "?";
+}
+
+void JobManager::execute(const std::shared_ptr<Job>& job, const Task& task) {
+    job->started = std::chrono::steady_clock::now();
+    if (job->cancelRequested.load()) {
+        job->finished = job->started;
+        job->state = Job::State::Cancelled;
+        return;
+    }
+    job->state = Job::State::Running;
+    JobContext ctx(job, &_loop, &_onSpawn);
+    Job::State end = Job::State::Done;
+    try {
+        task(ctx);
+    } catch (const std::exception& e) {
+        ctx.out() << "\033[1;31merror:\033[0m " << e.what() << "\n";
+        ESH_LOG_ERROR() << "Job " << job->id << " (" << job->command << ") threw: " << e.what();
+        end = Job::State::Failed;
+    }
+    if (end == Job::State::Done && job->cancelRequested.load()) end = Job::State::Cancelled;
+    job->finished = std::chrono::steady_clock::now();
+    job->state = end;
+}
+
+void JobManager::workerLoop() {
+    for (;;) {
+        std::unique_lock<std::mutex> lock(_qMx);
+        _qCv.wait(lock, [&] { return _stop.load() || !_queue.empty(); });
+        if (_stop.load() && _queue.empty()) break;
+        Pending p = std::move(_queue.front());
+        _queue.pop_front();
+        lock.unlock();
+
+        execute(p.job, p.task);
+        ESH_LOG_INFO() << "Job " << p.job->id << " finished state=" << stateName(p.job->state.load());
+        finished(p.job);
+    }
+}
+
+void JobManager::finished(const std::shared_ptr<Job>&) {
+    if (_onFinished) _onFinished();
+}
+
+int JobManager::submit(const std::string& command, Task task) {
+    auto job = std::make_shared<Job>();
+    job->command = command;
+    job->background = true;
+    {
+        std::lock_guard<std::mutex> lock(_jobsMx);
+        job->id = _nextId++;
+        _jobs[job->id] = job;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_qMx);
+        _queue.push_back(Pending{job, std::move(task)});
+    }
+    _qCv.notify_one();
+    ESH_LOG_INFO() << "Job " << job->id << " queued: " << command;
+    return job->id;
+}
+
+std::shared_ptr<Job> JobManager::runForeground(const std::string& command, Task task) {
+    // Only one foreground task at a time; the previous thread has already finished its task
+    if (_foregroundThread.joinable()) _foregroundThread.join();
+    auto job = std::make_shared<Job>();
+    job->command = command;
+    {
+        std::lock_guard<std::mutex> lock(_jobsMx);
+        _foreground = job;
+    }
+    _foregroundThread = std::thread([this, job, task] {
+        execute(job, task);
+        {
+            std::lock_guard<std::mutex> lock(_jobsMx);
+            if (_foreground == job) _foreground.reset();
+        }
+        finished(job);
+    });
+    return job;
+}
+
+std::shared_ptr<Job> JobManager::find(int id) const {
+    std::lock_guard<std::mutex> lock(_jobsMx);
+    auto it = _jobs.find(id);
+    return it == _jobs.end() ? nullptr : it->second;
+}
+
+std::vector<std::shared_ptr<Job>> JobManager::list() const {
+    std::lock_guard<std::mutex> lock(_jobsMx);
+    std::vector<std::shared_ptr<Job>> out;
+    out.reserve(_jobs.size());
+    for (const auto& kv : _jobs) out.push_back(kv.second);
+    return out;
+}
+
+bool JobManager::cancel(int id, int sig) {
+    return cancel(find(id), sig);
+}
+
+bool JobManager::cancel(const std::shared_ptr<Job>& job, int sig) {
+    if (!job || job->finishedState()) return false;
+    job->cancelRequested.store(true);
+    pid_t pgid = job->child.load();
+    if (pgid > 0) kill(-pgid, sig);
+    ESH_LOG_INFO() << "Job " << job->id << " cancel requested sig=" << sig;
+    return true;
+}
+
+void JobManager::cancelAll(int sig) {
+    std::shared_ptr<Job> fg;
+    {
+        std::lock_guard<std::mutex> lock(_jobsMx);
+        fg = _foreground;
+    }
+    cancel(fg, sig);
+    for (const auto& job : list()) {
+        if (!job->finishedState()) cancel(job, sig);
+    }
+}
+
+std::size_t JobManager::activeCount() const {
+    std::lock_guard<std::mutex> lock(_jobsMx);
+    std::size_t n = _foreground ? 1 : 0;
+    for (const auto& kv : _jobs) {
+        if (!kv.second->finishedState()) ++n;
+    }
+    return n;
+}
+
+std::vector<std::shared_ptr<Job>> JobManager::takeFinished() {
+    std::vector<std::shared_ptr<Job>> out;
+    for (const auto& job : list()) {
+        if (job->finishedState() && !job->reported.exchange(true)) out.push_back(job);
+    }
+    return out;
+}
+
+std::string JobManager::promptSummary() const {
+    std::string out;
+    for (const auto& job : list()) {
+        Job::State s = job->state.load();
+        if (s != Job::State::Running && s != Job::State::Queued) continue;
+        out += "[" + std::to_string(job->id) + ":";
+        int pct = job->progress.load();
+        if (s == Job::State::Queued) out += "queued";
+        else if (pct >= 0) out += std::to_string(pct) + "%";
+        else out += "run";
+        out += "]";
+    }
+    return out;
+}
+
+void JobManager::reap(int id) {
+    std::lock_guard<std::mutex> lock(_jobsMx);
+    auto it = _jobs.find(id);
+    if (it != _jobs.end() && it->second->finishedState()) _jobs.erase(it);
+}
+
+} // namespace esh
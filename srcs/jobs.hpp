@@ -0,0 +1,150 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <sstream>
+#include <signal.h>
+#include <sys/types.h>
+
+namespace esh {
+
+class EventLoop;
+
+struct Job {
+    enum class State { Queued, Running, Done, Failed, Cancelled };
+
+    int id = 0;
+    std::string command;
+    bool background = false;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+
+    std::atomic<State> state{State::Queued};
+    std::atomic<int> progress{-1};           // 0..100, -1 when unknown
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<pid_t> child{0};             // process group of the running child, 0 if none
+    std::atomic<bool> reported{false};       // completion notice already printed
+
+    // Written by the task thread only, read once the job has finished
+    std::ostringstream output;
+    std::string label;
+    std::mutex labelMx;
+
+    bool finishedState() const noexcept {
+        State s = state.load();
+        return s == State::Done || s == State::Failed || s == State::Cancelled;
+    }
+};
+
+// Told about every child a task ran: its argv, the result spawn() returned
+// and how long it took. Called on the task's thread.
+using SpawnHook = std::function<void(const std::vector<std::string>&, int, std::chrono::nanoseconds)>;
+
+// Handle given to a task: where to print, how to report progress, how to
+// run child processes so that cancellation reaches them.
+class JobContext {
+public:
+    JobContext(std::shared_ptr<Job> job, const std::atomic<EventLoop*>* loop = nullptr,
+               const SpawnHook* onSpawn = nullptr);
+
+    std::ostream& out();
+    void progress(int percent, const std::string& label = "");
+    bool cancelled() const noexcept;
+
+    // Run argv in its own process group and wait for it, stdin from /dev/null.
+    // Background jobs get their output captured. Returns the exit status,
+    // 128+signal when killed, or -1 if the program could not be started.
+    // With an event loop attached the exit is collected through a pidfd.
+    // With output, stdout and stderr go there instead. With maxOutput too, a
+    // child that writes more is killed with its group and output holds
+    // maxOutput + 1 bytes.
+    int spawn(const std::vector<std::string>& argv, std::string* output = nullptr, std::size_t maxOutput = 0);
+
+    const Job& job() const noexcept { return *_job; }
+
+private:
+    int waitChild(pid_t pid);
+
+    std::shared_ptr<Job> _job;
+    const std::atomic<EventLoop*>* _loop;
+    const SpawnHook* _onSpawn;
+};
+
+class JobManager {
+public:
+    using Task = std::function<void(JobContext&)>;
+
+    explicit JobManager(unsigned workers = 2);
+    ~JobManager();
+    JobManager(const JobManager&) = delete;
+    JobManager& operator=(const JobManager&) = delete;
+
+    // Queue a task on the executor; returns the job id
+    int submit(const std::string& command, Task task);
+
+    // Child exits are reaped on this loop while it is attached; detach (nullptr)
+    // before the loop stops running
+    void setLoop(EventLoop* loop) noexcept { _loop.store(loop); }
+    // Called from the finishing thread whenever a job ends
+    void setOnFinished(std::function<void()> fn);
+    // Set before any task runs
+    void setOnSpawn(SpawnHook fn) { _onSpawn = std::move(fn); }
+
+    // Run a task on its own thread with the terminal (output is not captured).
+    // The job is not listed; the caller waits on it and cancels it on SIGINT.
+    std::shared_ptr<Job> runForeground(const std::string& command, Task task);
+
+    std::shared_ptr<Job> find(int id) const;
+    std::vector<std::shared_ptr<Job>> list() const;
+
+    bool cancel(int id, int sig);
+    bool cancel(const std::shared_ptr<Job>& job, int sig);
+    void cancelAll(int sig = SIGTERM);
+    // Jobs (including the foreground one) that have not finished yet
+    std::size_t activeCount() const;
+
+    // Finished background jobs whose completion was not announced yet
+    std::vector<std::shared_ptr<Job>> takeFinished();
+    // Compact "[id:pct]" summary of running background jobs for the prompt
+    std::string promptSummary() const;
+    // Drop finished jobs from the table
+    void reap(int id);
+
+    static const char* stateName(Job::State s) noexcept;
+
+private:
+    void workerLoop();
+    void execute(const std::shared_ptr<Job>& job, const Task& task);
+    void finished(const std::shared_ptr<Job>& job);
+
+    struct Pending {
+        std::shared_ptr<Job> job;
+        Task task;
+    };
+
+    std::map<int, std::shared_ptr<Job>> _jobs;
+    mutable std::mutex _jobsMx;
+    int _nextId = 1;
+
+    std::deque<Pending> _queue;
+    std::mutex _qMx;
+    std::condition_variable _qCv;
+    std::atomic<bool> _stop{false};
+    std::vector<std::thread> _workers;
+
+    std::atomic<EventLoop*> _loop{nullptr};
+    std::function<void()> _onFinished;
+    SpawnHook _onSpawn;
+    std::shared_ptr<Job> _foreground;
+    std::thread _foregroundThread;
+};
+
+} // namespace esh
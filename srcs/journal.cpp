@@ -0,0 +1,318 @@
+#include "journal.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+
+const char Journal::kMagic[8] = {'E', 'S', 'H', 'J', 'R', 'N', 'L', '1'};
+
+static const std::size_t kHeaderBytes = 8;            // size + crc
+static const std::size_t kFixedBytes = 1 + 8;         // type + time
+static const std::size_t kMaxRecordBytes = 16u << 20; // sanity bound when replaying
+
+const char* auditEventName(std::uint8_t type) noexcept {
+    switch (static_cast<AuditEvent>(type)) {
+        case AuditEvent::SessionStart: return "session-start";
+        case AuditEvent::SessionEnd:   return "session-end";
+        case AuditEvent::FileChange:   return "file";
+        case AuditEvent::EnvChange:    return "env";
+        case AuditEvent::Mode:         return "mode";
+        case AuditEvent::Command:      return "command";
+    }
+    return "unknown";
+}
+
+static void put_u32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+static void put_u64(std::string& out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+static std::uint32_t get_u32(const unsigned char* p) {
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+           (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+static std::uint64_t get_u64(const unsigned char* p) {
+    std::uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+std::uint32_t Journal::crc32(const void* data, std::size_t len, std::uint32_t crc) noexcept {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            t[i] = c;
+        }
+        return t;
+    }();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < len; ++i) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void Journal::encode(std::string& out, std::uint8_t type, std::uint64_t timeNs, const std::string& payload) {
+    std::size_t start = out.size();
+    put_u32(out, static_cast<std::uint32_t>(kFixedBytes + payload.size()));
+    put_u32(out, 0); // crc placeholder
+    out += static_cast<char>(type);
+    put_u64(out, timeNs);
+    out += payload;
+    std::uint32_t crc = crc32(out.data() + start + kHeaderBytes, out.size() - start - kHeaderBytes);
+    for (int i = 0; i < 4; ++i) out[start + 4 + i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+}
+
+Journal::Journal() {}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::open(const std::string& path) {
+    close();
+    // A few rounds at most: only esh-audit compact replaces the file
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            ESH_LOG_ERROR() << "Cannot open journal " << path << ": " << std::strerror(errno);
+            return false;
+        }
+        bool usable = true;
+        if (flock(_fd, LOCK_EX | LOCK_NB) == 0) {
+            // No other shell has it open: check it and repair it
+            usable = repair(path);
+        }
+        if (usable) flock(_fd, LOCK_SH);
+        // Waiting for the lock may have let a compaction rename a new file over path
+        struct stat mine, current;
+        if (usable && fstat(_fd, &mine) == 0 && ::stat(path.c_str(), &current) == 0 &&
+            mine.st_dev == current.st_dev && mine.st_ino == current.st_ino) {
+            _path = path;
+            _stop = false;
+            _flusher = std::thread(&Journal::flusherLoop, this);
+            return true;
+        }
+        ::close(_fd);
+        _fd = -1;
+    }
+    ESH_LOG_ERROR() << "Cannot open journal " << path << ": the file keeps being replaced";
+    return false;
+}
+
+// Called with the exclusive lock held. Returns false when the file was moved
+// aside and a new one has to be opened in its place.
+bool Journal::repair(const std::string& path) {
+    struct stat st;
+    if (fstat(_fd, &st) != 0) return false;
+    if (st.st_size == 0) return writeAll(std::string(kMagic, sizeof(kMagic)));
+
+    Damage damage;
+    if (!replay(path, nullptr, &damage)) {
+        std::string legacy = path + ".legacy";
+        std::rename(path.c_str(), legacy.c_str());
+        ESH_LOG_WARN() << "Audit file " << path << " is not a journal, moved to " << legacy;
+        return false;
+    }
+    if (damage.corruptBytes > 0) {
+        // Records after the damage are still intact: keep the whole file for esh-audit
+        std::string aside = path + ".corrupt-" + std::to_string(std::time(nullptr));
+        std::rename(path.c_str(), aside.c_str());
+        ESH_LOG_ERROR() << "Journal " << path << " has " << damage.corruptBytes
+                        << " corrupt byte(s) between records, moved to " << aside << "; starting a new one";
+        return false;
+    }
+    if (damage.tornTail) {
+        ESH_LOG_WARN() << "Journal " << path << " has a torn tail, truncating "
+                       << (st.st_size - static_cast<off_t>(damage.validBytes)) << " byte(s)";
+        if (ftruncate(_fd, static_cast<off_t>(damage.validBytes)) != 0) {
+            ESH_LOG_ERROR() << "ftruncate failed on " << path;
+        }
+    }
+    return true;
+}
+
+void Journal::close() {
+    if (_fd < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if (_flusher.joinable()) _flusher.join();
+    ::close(_fd);
+    _fd = -1;
+    _path.clear();
+}
+
+void Journal::setGroupCommit(std::chrono::milliseconds interval, std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mx);
+    _interval = interval;
+    _groupBytes = bytes;
+}
+
+void Journal::append(std::uint8_t type, const std::string& payload) {
+    if (_fd < 0) return;
+    std::uint64_t ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        wake = _pending.empty();
+        encode(_pending, type, ns, payload);
+        ++_appended;
+        wake = wake || _pending.size() >= _groupBytes;
+    }
+    if (wake) _cv.notify_one();
+}
+
+void Journal::sync() {
+    if (_fd < 0) return;
+    std::unique_lock<std::mutex> lock(_mx);
+    std::uint64_t target = _appended;
+    _syncWanted = true;
+    _cv.notify_one();
+    _syncedCv.wait(lock, [&] { return _synced >= target || _stop; });
+}
+
+bool Journal::writeAll(const std::string& data) {
+    const char* p = data.data();
+    std::size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(_fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ESH_LOG_ERROR() << "Journal write failed: " << std::strerror(errno);
+            return false;
+        }
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void Journal::flusherLoop() {
+    std::unique_lock<std::mutex> lock(_mx);
+    for (;;) {
+        // Sleep until there is something to write, then give the group time to fill up
+        _cv.wait(lock, [&] { return _stop || !_pending.empty(); });
+        if (_pending.empty()) break;
+        _cv.wait_for(lock, _interval, [&] {
+            return _stop || _syncWanted || _pending.size() >= _groupBytes;
+        });
+
+        std::string batch;
+        batch.swap(_pending);
+        std::uint64_t seq = _appended;
+        _syncWanted = false;
+        lock.unlock();
+
+        if (writeAll(batch)) fdatasync(_fd);
+
+        lock.lock();
+        _synced = seq;
+        _syncedCv.notify_all();
+    }
+    _syncedCv.notify_all();
+}
+
+enum class RecordCheck { Intact, Short, Corrupt };
+
+// The record at pos: intact, cut off by the end of the file, or corrupt. A
+// torn write only ever loses the end of a record, so a header with an
+// impossible size is corruption, not a torn tail.
+static RecordCheck check_record(const unsigned char* base, std::size_t end, std::size_t pos, std::uint32_t& size) {
+    if (end - pos < kHeaderBytes) return RecordCheck::Short;
+    size = get_u32(base + pos);
+    if (size < kFixedBytes || size > kMaxRecordBytes) return RecordCheck::Corrupt;
+    if (end - pos - kHeaderBytes < size) return RecordCheck::Short;
+    return Journal::crc32(base + pos + kHeaderBytes, size) == get_u32(base + pos + 4) ? RecordCheck::Intact
+                                                                                      : RecordCheck::Corrupt;
+}
+
+bool Journal::replay(const std::string& path,
+                     const std::function<void(const Record&)>& fn,
+                     Damage* damage) {
+    Damage d;
+    if (damage) *damage = d;
+    MappedFile file(path);
+    const std::size_t end = file.size();
+    if (!file.ok() || end < sizeof(kMagic) || std::memcmp(file.data(), kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(file.data());
+    std::size_t pos = sizeof(kMagic);
+    d.validBytes = pos;
+    while (pos < end) {
+        std::uint32_t size = 0;
+        RecordCheck check = check_record(base, end, pos, size);
+        if (check == RecordCheck::Intact) {
+            if (fn) {
+                const unsigned char* body = base + pos + kHeaderBytes;
+                Record rec;
+                rec.type = body[0];
+                rec.timeNs = get_u64(body + 1);
+                rec.payload.assign(reinterpret_cast<const char*>(body + kFixedBytes), size - kFixedBytes);
+                fn(rec);
+            }
+            pos += kHeaderBytes + size;
+            d.validBytes = pos;
+            continue;
+        }
+        // Resynchronize on the next record that checks out
+        std::size_t next = pos + 1;
+        std::uint32_t skipped;
+        while (next < end && check_record(base, end, next, skipped) != RecordCheck::Intact) ++next;
+        if (next >= end) {
+            if (check == RecordCheck::Short) d.tornTail = true;
+            else d.corruptBytes += end - pos;
+            break;
+        }
+        d.corruptBytes += next - pos;
+        pos = next;
+    }
+    if (damage) *damage = d;
+    return true;
+}
+
+bool Journal::rewrite(const std::string& path, const std::vector<Record>& records) {
+    std::string data(kMagic, sizeof(kMagic));
+    for (const auto& r : records) encode(data, r.type, r.timeNs, r.payload);
+
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const char* p = data.data();
+    std::size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { ::close(fd); std::remove(tmp.c_str()); return false; }
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace esh
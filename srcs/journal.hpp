@@ -0,0 +1,113 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+namespace esh {
+
+// Event types stored in the audit journal (.shell_audit)
+enum class AuditEvent : std::uint8_t {
+    SessionStart = 1,
+    SessionEnd   = 2,
+    FileChange   = 3,   // payload: path
+    EnvChange    = 4,   // payload: KEY=VALUE
+    Mode         = 5,   // payload: mode name
+    Command      = 6    // payload: command line
+};
+
+const char* auditEventName(std::uint8_t type) noexcept;
+
+// Append-only record log.
+// File layout: 8-byte magic, then records of
+//   [u32 size][u32 crc32][u8 type][u64 unix time ns][payload]
+// where size counts type+time+payload and the crc covers the same bytes.
+// append() only copies into a memory buffer; a flusher thread writes and
+// fdatasync()s pending records in groups, so callers never wait on the disk.
+class Journal {
+public:
+    struct Record {
+        std::uint8_t type = 0;
+        std::uint64_t timeNs = 0;
+        std::string payload;
+    };
+
+    Journal();
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // What replay() found besides intact records
+    struct Damage {
+        std::size_t validBytes = 0;     // end of the last intact record
+        std::size_t corruptBytes = 0;   // skipped between intact records
+        bool tornTail = false;          // the last record runs past the end of the file
+    };
+
+    // Opens (or creates) the journal and holds a shared flock on it while open,
+    // so esh-audit compact cannot swap the file under a running shell. A torn
+    // tail left by a crash is cut off. Corruption anywhere else moves the file
+    // aside to path + ".corrupt-<time>" and starts a new one, so no intact
+    // record is ever lost; a file without the magic (old text format) is moved
+    // aside to path + ".legacy". Repairs are only made when no other shell has
+    // the journal open.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const noexcept { return _fd >= 0; }
+    const std::string& path() const noexcept { return _path; }
+
+    // Group commit: sync at most every `interval`, or sooner once `bytes` are pending
+    void setGroupCommit(std::chrono::milliseconds interval, std::size_t bytes);
+
+    void append(std::uint8_t type, const std::string& payload);
+    void append(AuditEvent type, const std::string& payload) {
+        append(static_cast<std::uint8_t>(type), payload);
+    }
+
+    // Write and fdatasync everything appended so far; blocks until durable
+    void sync();
+
+    // Read records in order from a read-only mapping of the file. A corrupt
+    // record is skipped up to the next one that checks out, so one bad
+    // record does not hide the rest. Returns false when path is not a journal.
+    static bool replay(const std::string& path,
+                       const std::function<void(const Record&)>& fn,
+                       Damage* damage = nullptr);
+
+    // Write records to path atomically (temp file + rename)
+    static bool rewrite(const std::string& path, const std::vector<Record>& records);
+
+    static std::uint32_t crc32(const void* data, std::size_t len, std::uint32_t crc = 0) noexcept;
+    static void encode(std::string& out, std::uint8_t type, std::uint64_t timeNs, const std::string& payload);
+
+    static const char kMagic[8];
+
+private:
+    void flusherLoop();
+    bool writeAll(const std::string& data);
+    bool repair(const std::string& path);
+
+    int _fd = -1;
+    std::string _path;
+
+    std::string _pending;           // encoded records not yet written
+    std::uint64_t _appended = 0;    // sequence of the last appended record
+    std::uint64_t _synced = 0;      // sequence of the last durable record
+    std::mutex _mx;
+    std::condition_variable _cv;        // wakes the flusher
+    std::condition_variable _syncedCv;  // wakes sync() callers
+
+    std::chrono::milliseconds _interval{200};
+    std::size_t _groupBytes = 64 * 1024;
+    bool _syncWanted = false;
+    bool _stop = false;
+    std::thread _flusher;
+};
+
+} // namespace esh
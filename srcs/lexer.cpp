@@ -0,0 +1,353 @@
+#include "lexer.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace esh {
+
+enum : std::uint8_t {
+    kSpace = 1,   // blanks other than '\n'
+    kIdent = 2,   // letters, '_', '$'
+    kDigit = 4,
+    kWord = 8,    // kIdent or kDigit: the rest of an identifier
+    kQuoteStop = 16,  // quotes, '\\' and '\n': end a run of plain literal body
+    kSingle = 32      // punctuators that never start a longer operator
+};
+
+static const struct CharTable {
+    std::uint8_t cls[256];
+    bool op2[128][128];   // two-character operators, by first and second char
+    CharTable() : cls{}, op2{} {
+        for (const char* op : {"->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "+=",
+                               "-=", "*=", "/=", "%=", "&=", "|=", "^=", "::", "##", ".*"}) {
+            op2[static_cast<int>(op[0])][static_cast<int>(op[1])] = true;
+        }
+        for (int c = 'a'; c <= 'z'; ++c) cls[c] = kIdent | kWord;
+        for (int c = 'A'; c <= 'Z'; ++c) cls[c] = kIdent | kWord;
+        for (int c = '0'; c <= '9'; ++c) cls[c] = kDigit | kWord;
+        cls[static_cast<unsigned char>('_')] = kIdent | kWord;
+        cls[static_cast<unsigned char>('$')] = kIdent | kWord;
+        for (char c : {' ', '\t', '\r', '\f', '\v'}) cls[static_cast<unsigned char>(c)] = kSpace;
+        for (char c : {'"', '\'', '\\', '\n'}) cls[static_cast<unsigned char>(c)] = kQuoteStop;
+        for (char c : {'(', ')', '[', ']', '{', '}', ';', ',', '?', '~'}) cls[static_cast<unsigned char>(c)] = kSingle;
+        // UTF-8 in identifiers (C99/C++ extended characters)
+        for (int c = 0x80; c < 0x100; ++c) cls[c] = kIdent | kWord;
+    }
+} kChars;
+
+static inline std::uint8_t char_class(char c) noexcept {
+    return kChars.cls[static_cast<unsigned char>(c)];
+}
+
+#if defined(__SSE2__)
+// Bit i set when p[i] continues an identifier: letters, digits, '_', '$', UTF-8
+static inline unsigned word_mask16(const char* p) noexcept {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    const __m128i other = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                                                    _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))),
+                                       _mm_cmplt_epi8(v, _mm_setzero_si128()));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), other)));
+}
+
+// Bit i set when p[i] is a blank other than '\n'
+static inline unsigned space_mask16(const char* p) noexcept {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // '\t' '\v' '\f' '\r' are 9, 11, 12, 13: 9..13 without 10
+    const __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(8)), _mm_cmplt_epi8(v, _mm_set1_epi8(14)));
+    const __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                       _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), ctl));
+    return static_cast<unsigned>(_mm_movemask_epi8(blank));
+}
+#endif
+
+// Past the run of characters of class cls (kSpace or kWord). With SSE2 a
+// run ends with one count-trailing-zeros over 16 characters instead of a
+// mispredicted loop exit after each identifier and indentation.
+static inline const char* skip_run(const char* p, const char* end, std::uint8_t cls) noexcept {
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        const unsigned stop = ~(cls == kSpace ? space_mask16(p) : word_mask16(p)) & 0xFFFF;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+#endif
+    while (p < end && char_class(*p) & cls) ++p;
+    return p;
+}
+
+static const std::string_view kKeywords[] = {
+    "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
+    "_Noreturn", "_Static_assert", "_Thread_local",
+    "alignas", "alignof", "asm", "auto", "bool", "break", "case", "catch", "char",
+    "char16_t", "char32_t", "char8_t", "class", "const", "const_cast", "consteval",
+    "constexpr", "constinit", "continue", "decltype", "default", "delete", "do",
+    "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+    "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+    "namespace", "new", "noexcept", "nullptr", "operator", "private", "protected",
+    "public", "register", "reinterpret_cast", "restrict", "return", "short", "signed",
+    "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "template",
+    "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+    "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while",
+};
+
+// Open-addressing table over kKeywords, hashed on length and two characters:
+// most identifiers are rejected by one probe and one length compare
+static const struct KeywordTable {
+    static const std::size_t kSize = 512;
+    std::int16_t slot[kSize];
+    static std::size_t hash(std::string_view w) noexcept {
+        return (static_cast<unsigned char>(w[0]) * 31u + static_cast<unsigned char>(w[w.size() - 1]) * 7u +
+                static_cast<unsigned>(w.size())) & (kSize - 1);
+    }
+    KeywordTable() {
+        for (auto& s : slot) s = -1;
+        for (std::size_t i = 0; i < sizeof(kKeywords) / sizeof(kKeywords[0]); ++i) {
+            std::size_t h = hash(kKeywords[i]);
+            while (slot[h] >= 0) h = (h + 1) & (kSize - 1);
+            slot[h] = static_cast<std::int16_t>(i);
+        }
+    }
+} kKeywordTable;
+
+bool Lexer::isKeyword(std::string_view word) noexcept {
+    // Every keyword starts with a lowercase letter or '_'
+    if (word.size() < 2 || word.size() > 16 || (word[0] != '_' && (word[0] < 'a' || word[0] > 'z'))) return false;
+    for (std::size_t h = KeywordTable::hash(word);; h = (h + 1) & (KeywordTable::kSize - 1)) {
+        int i = kKeywordTable.slot[h];
+        if (i < 0) return false;
+        if (kKeywords[i] == word) return true;
+    }
+}
+
+Lexer::Lexer(std::string_view src, bool keepComments)
+: _comments(keepComments) {
+    reset(src);
+}
+
+void Lexer::reset(std::string_view src) {
+    _begin = _p = _lineStart = src.data();
+    _end = src.data() + src.size();
+    _line = 1;
+    _atLineStart = true;
+}
+
+void Lexer::newline(const char* after) noexcept {
+    ++_line;
+    _lineStart = after;
+    _atLineStart = true;
+}
+
+void Lexer::skipBlockComment() {
+    // _p is on the '/' of "/*"
+    _p += 2;
+    for (;;) {
+        const char* star = static_cast<const char*>(std::memchr(_p, '*', static_cast<std::size_t>(_end - _p)));
+        const char* stop = star ? star : _end;
+        for (const char* nl = _p; (nl = static_cast<const char*>(std::memchr(nl, '\n', static_cast<std::size_t>(stop - nl)))); ++nl) {
+            newline(nl + 1);
+        }
+        if (!star) {
+            _p = _end;
+            return;
+        }
+        _p = star + 1;
+        if (_p < _end && *_p == '/') {
+            ++_p;
+            return;
+        }
+    }
+}
+
+// To the end of the line, following backslash continuations
+void Lexer::skipLine() {
+    for (;;) {
+        const char* nl = static_cast<const char*>(std::memchr(_p, '\n', static_cast<std::size_t>(_end - _p)));
+        if (!nl) {
+            _p = _end;
+            return;
+        }
+        const char* last = nl;
+        if (last > _p && last[-1] == '\r') --last;
+        if (last > _p && last[-1] == '\\') {
+            newline(nl + 1);
+            _p = nl + 1;
+            continue;
+        }
+        _p = nl;
+        return;
+    }
+}
+
+// A directive ends at an unescaped newline; a block comment inside it may
+// span lines and is part of the directive
+void Lexer::skipDirective() {
+    while (_p < _end) {
+        const char* nl = static_cast<const char*>(std::memchr(_p, '\n', static_cast<std::size_t>(_end - _p)));
+        if (!nl) nl = _end;
+        // Comments are rare in directives: look for a '/' that starts one
+        const char* slash = static_cast<const char*>(std::memchr(_p, '/', static_cast<std::size_t>(nl - _p)));
+        while (slash && (slash + 1 >= nl || (slash[1] != '*' && slash[1] != '/'))) {
+            slash = static_cast<const char*>(std::memchr(slash + 1, '/', static_cast<std::size_t>(nl - slash - 1)));
+        }
+        if (slash && slash[1] == '*') {
+            _p = slash;
+            skipBlockComment();
+            continue;
+        }
+        if (slash) {
+            _p = slash;
+            skipLine();
+            return;
+        }
+        const char* last = nl;
+        if (last > _p && last[-1] == '\r') --last;
+        if (nl < _end && last > _p && last[-1] == '\\') {
+            _p = nl + 1;
+            newline(_p);
+            continue;
+        }
+        _p = nl;
+        return;
+    }
+}
+
+// _p is on the opening quote; stops after the closing one or at end of line
+void Lexer::skipQuoted(char quote) {
+    const char* p = _p + 1;
+    while (p < _end) {
+        // The body between escapes is skipped by class, not compared char by char
+        while (p < _end && !(char_class(*p) & kQuoteStop)) ++p;
+        if (p >= _end) break;
+        const char c = *p;
+        if (c == '\\' && p + 1 < _end) {
+            if (p[1] == '\n') newline(p + 2);
+            p += 2;
+            continue;
+        }
+        if (c == '\n') break;
+        ++p;
+        if (c == quote) break;
+    }
+    _p = p;
+}
+
+bool Lexer::next(Token& tok) {
+    for (;;) {
+        // Blanks, newlines and line splices, on a local pointer the compiler
+        // keeps in a register
+        const char* p = _p;
+        const char* const end = _end;
+        for (;;) {
+            while (p < end && char_class(*p) & kSpace) ++p;
+            if (p >= end) break;
+            if (*p == '\n') {
+                newline(++p);
+                // Indentation is the one long run of blanks
+                p = skip_run(p, end, kSpace);
+            } else if (*p == '\\' && p + 1 < end && p[1] == '\n') {
+                p += 2;
+                newline(p);
+            } else {
+                break;
+            }
+        }
+        _p = p;
+        if (p >= end) return false;
+
+        const char* start = _p;
+        const std::uint32_t line = _line;
+        const std::size_t col = static_cast<std::size_t>(start - _lineStart) + 1;
+        tok.offset = static_cast<std::uint32_t>(start - _begin);
+        tok.line = line;
+        tok.column = static_cast<std::uint16_t>(std::min<std::size_t>(col, 0xFFFF));
+
+        const char c = *p;
+        const char n = p + 1 < end ? p[1] : '\0';
+        Token::Kind kind;
+
+        if (char_class(c) & kSingle) {
+            // Half of all tokens: brackets, ';' and ','
+            _p = p + 1;
+            kind = Token::Kind::Punct;
+        } else if (c == '/' && (n == '/' || n == '*')) {
+            if (n == '/') skipLine();
+            else skipBlockComment();
+            if (!_comments) continue;
+            kind = Token::Kind::Comment;
+        } else if (c == '#' && _atLineStart) {
+            skipDirective();
+            kind = Token::Kind::Preprocessor;
+        } else if (char_class(c) & kIdent) {
+            p = skip_run(p + 1, end, kWord);
+            _p = p;
+            std::string_view word(start, static_cast<std::size_t>(p - start));
+            // Encoding prefixes glue onto the literal: L"x", u8'c', R"(...)" is treated as a plain string
+            if (word.size() <= 3 && _p < _end && (*_p == '"' || *_p == '\'') &&
+                (word == "L" || word == "u" || word == "U" || word == "u8" || word == "R" || word == "LR" ||
+                 word == "uR" || word == "UR" || word == "u8R")) {
+                char q = *_p;
+                skipQuoted(q);
+                kind = q == '"' ? Token::Kind::String : Token::Kind::Char;
+            } else {
+                kind = isKeyword(word) ? Token::Kind::Keyword : Token::Kind::Identifier;
+            }
+        } else if (char_class(c) & kDigit || (c == '.' && char_class(n) & kDigit)) {
+            ++p;
+            while (p < end) {
+                char d = *p;
+                if (char_class(d) & kWord || d == '.' || d == '\'') {
+                    ++p;
+                } else if ((d == '+' || d == '-') &&
+                           (p[-1] == 'e' || p[-1] == 'E' || p[-1] == 'p' || p[-1] == 'P')) {
+                    ++p;
+                } else {
+                    break;
+                }
+            }
+            _p = p;
+            kind = Token::Kind::Number;
+        } else if (c == '"' || c == '\'') {
+            skipQuoted(c);
+            kind = c == '"' ? Token::Kind::String : Token::Kind::Char;
+        } else {
+            // Longest match over the multi-character operators
+            std::size_t len = 1;
+            std::size_t left = static_cast<std::size_t>(_end - _p);
+            if (left >= 2 && static_cast<unsigned char>(c) < 128 && static_cast<unsigned char>(n) < 128 &&
+                kChars.op2[static_cast<int>(c)][static_cast<int>(n)]) {
+                len = 2;
+                if (left >= 3) {
+                    static const char* const kOps3[] = {"<<=", ">>=", "->*", "<=>"};
+                    for (const char* op : kOps3) {
+                        if (std::memcmp(_p, op, 3) == 0) { len = 3; break; }
+                    }
+                }
+            } else if (left >= 3 && c == '.' && n == '.' && _p[2] == '.') {
+                len = 3;
+            }
+            _p += len;
+            kind = Token::Kind::Punct;
+        }
+
+        _atLineStart = false;
+        tok.kind = kind;
+        tok.length = static_cast<std::uint32_t>(_p - start);
+        return true;
+    }
+}
+
+void Lexer::tokenize(std::string_view src, std::vector<Token>& out, bool keepComments) {
+    out.clear();
+    Lexer lex(src, keepComments);
+    Token tok;
+    while (lex.next(tok)) out.push_back(tok);
+}
+
+} // namespace esh
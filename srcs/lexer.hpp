@@ -0,0 +1,65 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace esh {
+
+struct Token {
+    enum class Kind : std::uint8_t {
+        Identifier,
+        Keyword,       // C and C++ reserved words
+        Number,
+        String,        // including prefixes: L"", u8"", ...
+        Char,
+        Punct,         // operators and separators, longest match
+        Preprocessor,  // a whole directive, continuation lines included
+        Comment        // only when the lexer keeps comments
+    };
+
+    std::uint32_t offset;   // into the source buffer
+    std::uint32_t length;
+    std::uint32_t line;     // 1-based
+    std::uint16_t column;   // 1-based, saturates at 65535
+    Kind kind;
+
+    std::string_view text(std::string_view src) const noexcept { return src.substr(offset, length); }
+    bool is(std::string_view src, char c) const noexcept {
+        return length == 1 && src[offset] == c;
+    }
+};
+
+// C/C++ tokenizer over a caller-owned buffer (typically a MappedFile).
+// Tokens are offsets into the buffer; next() never allocates, so the same
+// Lexer can be reset() and reused for every file of a run.
+class Lexer {
+public:
+    explicit Lexer(std::string_view src = std::string_view(), bool keepComments = false);
+
+    void reset(std::string_view src);
+    void keepComments(bool on) noexcept { _comments = on; }
+
+    // false at the end of the buffer
+    bool next(Token& tok);
+
+    // All tokens of src into out (cleared first, capacity kept)
+    static void tokenize(std::string_view src, std::vector<Token>& out, bool keepComments = false);
+    static bool isKeyword(std::string_view word) noexcept;
+
+private:
+    void newline(const char* after) noexcept;
+    void skipBlockComment();
+    void skipLine();
+    void skipDirective();
+    void skipQuoted(char quote);
+
+    const char* _begin = nullptr;
+    const char* _p = nullptr;
+    const char* _end = nullptr;
+    const char* _lineStart = nullptr;
+    std::uint32_t _line = 1;
+    bool _atLineStart = true;   // only blanks since the last newline ('#' starts a directive)
+    bool _comments = false;
+};
+
+} // namespace esh
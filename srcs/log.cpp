@@ -1,4 +1,5 @@
 #include "log.hpp"
+#include "metrics.hpp"
 #include <algorithm>
 #include <cstdio>
 #include <fstream>
@@ -10,6 +11,21 @@
 
 namespace esh {
 
+namespace {
+struct LogMetrics {
+    metrics::Counter records = metrics::counter("esh_log_records_total", "Log records accepted");
+    metrics::Counter dropped = metrics::counter("esh_log_records_dropped_total",
+                                                "Log records that reached no sink or failed to write");
+    metrics::Counter rotations = metrics::counter("esh_log_rotations_total", "Log file rotations");
+    metrics::Gauge depth = metrics::gauge("esh_log_queue_depth", "Records waiting for the log worker");
+};
+
+LogMetrics& log_metrics() {
+    static LogMetrics m;
+    return m;
+}
+} // namespace
+
 Logger& Logger::instance() {
     static Logger inst;
     return inst;
@@ -109,6 +125,46 @@ void Logger::flush() {
     if (_file && _file->is_open()) {
         _file->flush();
     }
+    _crashFlushed.store(_crashWrittenLocked, std::memory_order_release);
+}
+
+void Logger::drain() {
+    std::unique_lock<std::mutex> lock(_qMx);
+    _idleCv.wait(lock, [&] { return _queue.empty() && !_writing; });
+}
+
+void Logger::enableCrashRing() {
+    if (_crashRing) return;
+    _crashRing.reset(new CrashSlot[kCrashSlots]);
+    _crashRingOn.store(true, std::memory_order_release);
+}
+
+// "1792329600.123 INFO  file.cpp:42 | message", cut to the slot size
+void Logger::recordForCrash(Record& rec) noexcept {
+    rec.seq = _crashNext.fetch_add(1, std::memory_order_relaxed) + 1;
+    CrashSlot& slot = _crashRing[rec.seq % kCrashSlots];
+    slot.seq.store(0, std::memory_order_relaxed);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(rec.tp.time_since_epoch()).count();
+    int n = std::snprintf(slot.text, sizeof(slot.text), "%lld.%03lld %-5s %s:%d | %s",
+                          static_cast<long long>(ms / 1000), static_cast<long long>(ms % 1000), levelName(rec.lvl),
+                          rec.file.c_str(), rec.line, rec.msg.c_str());
+    slot.len = n < 0 ? 0 : std::min<std::uint32_t>(static_cast<std::uint32_t>(n), sizeof(slot.text) - 1);
+    slot.seq.store(rec.seq, std::memory_order_release);
+}
+
+std::size_t Logger::writePendingForCrash(int fd) const noexcept {
+    if (!_crashRingOn.load(std::memory_order_acquire)) return 0;
+    const std::uint64_t last = _crashNext.load(std::memory_order_acquire);
+    std::uint64_t first = _crashFlushed.load(std::memory_order_acquire) + 1;
+    if (last >= kCrashSlots && first < last - kCrashSlots + 1) first = last - kCrashSlots + 1;
+    std::size_t written = 0;
+    for (std::uint64_t seq = first; seq <= last; ++seq) {
+        const CrashSlot& slot = _crashRing[seq % kCrashSlots];
+        if (slot.seq.load(std::memory_order_acquire) != seq) continue;   // being written when we crashed
+        if (::write(fd, slot.text, slot.len) < 0 || ::write(fd, "\n", 1) < 0) break;
+        ++written;
+    }
+    return written;
 }
 
 unsigned long Logger::currentTid() {
@@ -211,6 +267,7 @@ void Logger::rotateIfNeededLocked(size_t incomingBytes)
     _file.reset(new std::ofstream());
     _file->open(_filePath.c_str(), std::ios::out | std::ios::trunc);
     _fileSize = 0;
+    log_metrics().rotations.inc();
 }
 
 void Logger::writeRecord(const Record& rec) {
@@ -222,19 +279,28 @@ void Logger::writeRecord(const Record& rec) {
     }
 
     std::lock_guard<std::mutex> lock(_fileMx);
+    if (rec.seq > _crashWrittenLocked) _crashWrittenLocked = rec.seq;
     if (_file && _file->is_open()) {
         rotateIfNeededLocked(lineFile.size() + 1);
         (*_file) << lineFile << '\n';
         _fileSize += lineFile.size() + 1;
+        if (!*_file) {
+            log_metrics().dropped.inc();
+            _file->clear();
+        }
+    } else if (!_console.load()) {
+        log_metrics().dropped.inc();
     }
 }
 
 void Logger::enqueue(Record&& rec) {
+    log_metrics().records.inc();
     if (_async.load()) {
         {
             std::lock_guard<std::mutex> lock(_qMx);
             _queue.emplace_back(std::move(rec));
         }
+        log_metrics().depth.add(1);
         _qCv.notify_one();
     } else {
         writeRecord(rec);
@@ -242,6 +308,7 @@ void Logger::enqueue(Record&& rec) {
 }
 
 void Logger::workerLoop() {
+    ESH_ALLOC_SCOPE("log.worker");
     while (!_stop.load())
 	{
         std::unique_lock<std::mutex> lock(_qMx);
@@ -250,8 +317,13 @@ void Logger::workerLoop() {
             break;
         Record rec = std::move(_queue.front());
         _queue.pop_front();
+        _writing = true;
         lock.unlock();
+        log_metrics().depth.add(-1);
         writeRecord(rec);
+        lock.lock();
+        _writing = false;
+        if (_queue.empty()) _idleCv.notify_all();
     }
 
     for (;;) {
@@ -262,6 +334,7 @@ void Logger::workerLoop() {
         Record rec = std::move(_queue.front());
         _queue.pop_front();
         lock.unlock();
+        log_metrics().depth.add(-1);
         writeRecord(rec);
     }
 }
@@ -275,6 +348,7 @@ void Logger::log(Level lvl,
         return;
     }
 
+    ESH_ALLOC_SCOPE("log.record");
     Record rec;
     rec.tp = std::chrono::system_clock::now();
     rec.lvl = lvl;
@@ -283,6 +357,7 @@ void Logger::log(Level lvl,
     rec.func = func ? func : "";
     rec.line = line;
     rec.tid = currentTid();
+    if (_crashRingOn.load(std::memory_order_acquire)) recordForCrash(rec);
 
     enqueue(std::move(rec));
 
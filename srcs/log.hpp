@@ -10,6 +10,9 @@
 #include <thread>
 #include <deque>
 #include <sstream>
+#include <memory>
+#include <cstdint>
+#include "alloc.hpp"
 
 namespace esh {
 
@@ -52,6 +55,15 @@ public:
 
     // Flush sinks
     void flush();
+    // Async mode: block until the worker has written every record queued so far
+    void drain();
+
+    // Keep a short copy of the last records in a fixed ring so that a crash
+    // handler can write out those still queued (see CrashHandler)
+    void enableCrashRing();
+    // Async-signal-safe: writes the records accepted but not yet written by
+    // the sinks, oldest first; returns how many
+    std::size_t writePendingForCrash(int fd) const noexcept;
 
     // Core logging API
     void log(Level lvl,
@@ -69,20 +81,27 @@ public:
 
         ~Line() {
             if (_enabled) {
+                ESH_ALLOC_SCOPE("log.line");
                 Logger::instance().log(_lvl, _ss.str(), _file, _line, _func);
             }
         }
 
         template <typename T>
         Line& operator<<(const T& v) {
-            if (_enabled) _ss << v;
+            if (_enabled) {
+                ESH_ALLOC_SCOPE("log.line");
+                _ss << v;
+            }
             return *this;
         }
 
         // Support manipulators like std::endl
         using Manip = std::ostream& (*)(std::ostream&);
         Line& operator<<(Manip m) {
-            if (_enabled) m(_ss);
+            if (_enabled) {
+                ESH_ALLOC_SCOPE("log.line");
+                m(_ss);
+            }
             return *this;
         }
 
@@ -109,7 +128,17 @@ private:
         std::string func;
         int line;
         unsigned long tid;
+        std::uint64_t seq = 0;   // crash ring sequence, 0 when the ring is off
+    };
+
+    // seq is the record's sequence once text is complete, 0 while written
+    struct CrashSlot {
+        std::atomic<std::uint64_t> seq{0};
+        std::uint32_t len = 0;
+        char text[244];
     };
+    static const std::size_t kCrashSlots = 256;
+    void recordForCrash(Record& rec) noexcept;
 
     // Internal
     void workerLoop();
@@ -143,6 +172,18 @@ private:
     std::deque<Record> _queue;
     std::mutex _qMx;
     std::condition_variable _qCv;
+    std::condition_variable _idleCv;   // queue empty and nothing being written
+    bool _writing = false;             // under _qMx
+
+    // Crash ring
+    std::unique_ptr<CrashSlot[]> _crashRing;
+    std::atomic<bool> _crashRingOn{false};
+    std::atomic<std::uint64_t> _crashNext{0};
+    std::atomic<std::uint64_t> _crashFlushed{0};   // last seq flushed to the sinks
+    std::uint64_t _crashWrittenLocked = 0;          // last seq written, under _fileMx
+
+    // bench/bench.cpp times format() directly
+    friend struct BenchAccess;
 
     // Helpers
     void rotateIfNeededLocked(size_t incomingBytes);
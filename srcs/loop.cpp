@@ -0,0 +1,209 @@
+#include "loop.hpp"
+#include "log.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace esh {
+
+static sigset_t g_blocked;
+
+void EventLoop::blockSignals(std::initializer_list<int> signals) {
+    sigemptyset(&g_blocked);
+    for (int s : signals) sigaddset(&g_blocked, s);
+    pthread_sigmask(SIG_BLOCK, &g_blocked, nullptr);
+}
+
+void EventLoop::unblockAllSignals() noexcept {
+    // The shell may itself have been started with them ignored (background of a
+    // non-interactive shell); children get the default action like before
+    for (int s = 1; s < NSIG; ++s) {
+        if (sigismember(&g_blocked, s) == 1) signal(s, SIG_DFL);
+    }
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+}
+
+EventLoop::EventLoop() {
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_epfd < 0 || _wakeFd < 0) {
+        ESH_LOG_FATAL() << "Event loop setup failed: " << std::strerror(errno);
+        return;
+    }
+    watchFd(_wakeFd, [this] { drainPosted(); });
+}
+
+EventLoop::~EventLoop() {
+    // Timers, the signalfd and the wakeup fd are ours; callers close their own fds
+    for (int fd : _timers) close(fd);
+    if (_sigFd >= 0) close(_sigFd);
+    if (_wakeFd >= 0) close(_wakeFd);
+    if (_epfd >= 0) close(_epfd);
+}
+
+bool EventLoop::watchFd(int fd, Callback onReadable) {
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    bool known = _fds.count(fd) != 0;
+    if (epoll_ctl(_epfd, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ESH_LOG_WARN() << "epoll_ctl failed for fd " << fd << ": " << std::strerror(errno);
+        return false;
+    }
+    _fds[fd] = std::move(onReadable);
+    return true;
+}
+
+void EventLoop::unwatchFd(int fd) {
+    if (!_fds.erase(fd)) return;
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::addTimerFd(int fd, std::chrono::milliseconds interval, Callback cb) {
+    const bool oneShot = interval.count() == 0;
+    watchFd(fd, [this, fd, oneShot, cb] {
+        std::uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) <= 0) return;
+        if (oneShot) removeTimer(fd);
+        cb();
+    });
+}
+
+int EventLoop::addTimer(std::chrono::milliseconds first, std::chrono::milliseconds interval, Callback cb) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) return -1;
+    auto to_ts = [](std::chrono::milliseconds ms) {
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(ms.count() / 1000);
+        ts.tv_nsec = static_cast<long>((ms.count() % 1000) * 1000000);
+        return ts;
+    };
+    struct itimerspec spec{};
+    spec.it_value = to_ts(first.count() > 0 ? first : std::chrono::milliseconds(1));
+    spec.it_interval = to_ts(interval);
+    timerfd_settime(fd, 0, &spec, nullptr);
+    _timers.insert(fd);
+    addTimerFd(fd, interval, std::move(cb));
+    return fd;
+}
+
+int EventLoop::addSecondTick(Callback cb) {
+    int fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct itimerspec spec{};
+    spec.it_value.tv_sec = now.tv_sec + 1;
+    spec.it_interval.tv_sec = 1;
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    _timers.insert(fd);
+    addTimerFd(fd, std::chrono::seconds(1), std::move(cb));
+    return fd;
+}
+
+void EventLoop::removeTimer(int id) {
+    if (!_timers.erase(id)) return;
+    unwatchFd(id);
+    close(id);
+}
+
+bool EventLoop::watchSignal(int signo, Callback cb) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    _signals[signo] = std::move(cb);
+    for (const auto& kv : _signals) sigaddset(&mask, kv.first);
+    int fd = signalfd(_sigFd, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd < 0) {
+        ESH_LOG_WARN() << "signalfd failed: " << std::strerror(errno);
+        _signals.erase(signo);
+        return false;
+    }
+    if (_sigFd < 0) {
+        _sigFd = fd;
+        watchFd(_sigFd, [this] { onSignalFd(); });
+    }
+    return true;
+}
+
+void EventLoop::onSignalFd() {
+    struct signalfd_siginfo si;
+    while (read(_sigFd, &si, sizeof(si)) == static_cast<ssize_t>(sizeof(si))) {
+        auto it = _signals.find(static_cast<int>(si.ssi_signo));
+        if (it == _signals.end()) continue;
+        Callback cb = it->second;
+        cb();
+    }
+}
+
+bool EventLoop::watchProcess(pid_t pid, std::function<void(int)> cb) {
+#ifdef SYS_pidfd_open
+    int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (fd < 0) return false;
+    return watchFd(fd, [this, fd, pid, cb] {
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == 0) return;
+        unwatchFd(fd);
+        close(fd);
+        cb(status);
+    });
+#else
+    (void)pid;
+    (void)cb;
+    return false;
+#endif
+}
+
+void EventLoop::post(Callback cb) {
+    {
+        std::lock_guard<std::mutex> lock(_postMx);
+        _posted.push_back(std::move(cb));
+    }
+    std::uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        ESH_LOG_WARN() << "Event loop wakeup failed: " << std::strerror(errno);
+    }
+}
+
+void EventLoop::drainPosted() {
+    std::uint64_t n;
+    while (read(_wakeFd, &n, sizeof(n)) > 0) {}
+    std::vector<Callback> batch;
+    {
+        std::lock_guard<std::mutex> lock(_postMx);
+        batch.swap(_posted);
+    }
+    for (auto& cb : batch) cb();
+}
+
+void EventLoop::runOnce(int timeoutMs) {
+    struct epoll_event events[32];
+    int n = epoll_wait(_epfd, events, 32, timeoutMs);
+    for (int i = 0; i < n; ++i) {
+        // A callback may have unwatched a later fd of this batch
+        auto it = _fds.find(events[i].data.fd);
+        if (it == _fds.end()) continue;
+        Callback cb = it->second;
+        cb();
+    }
+}
+
+void EventLoop::runUntil(const std::function<bool()>& done) {
+    while (!_stopped && !done()) runOnce(-1);
+}
+
+void EventLoop::run() {
+    _stopped = false;
+    while (!_stopped) runOnce(-1);
+}
+
+} // namespace esh
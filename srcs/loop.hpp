@@ -0,0 +1,79 @@
+#pragma once
+#include <functional>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <initializer_list>
+#include <sys/types.h>
+
+namespace esh {
+
+// Single-threaded epoll reactor: fds, timers (timerfd), signals (signalfd),
+// child exits (pidfd) and cross-thread wakeups (eventfd) all dispatch on the
+// thread that calls run(). Only post() may be called from other threads.
+class EventLoop {
+public:
+    using Callback = std::function<void()>;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Block signals in the calling thread and every thread it starts later.
+    // Call from main() before any thread exists, then use watchSignal().
+    static void blockSignals(std::initializer_list<int> signals);
+    // Undo blockSignals() in a freshly forked child before exec (mask and
+    // dispositions); async-signal-safe
+    static void unblockAllSignals() noexcept;
+
+    // Level-triggered readability callback
+    bool watchFd(int fd, Callback onReadable);
+    void unwatchFd(int fd);
+
+    // interval 0 makes a one-shot timer that removes itself after firing.
+    // Returns a timer id, -1 on failure.
+    int addTimer(std::chrono::milliseconds first, std::chrono::milliseconds interval, Callback cb);
+    // 1 Hz timer aligned on wall-clock seconds
+    int addSecondTick(Callback cb);
+    void removeTimer(int id);
+
+    // The signal must have been blocked with blockSignals()
+    bool watchSignal(int signo, Callback cb);
+
+    // Child exit through pidfd; cb gets the waitpid() status. Returns false
+    // when pidfd is unsupported, in which case the caller has to reap.
+    bool watchProcess(pid_t pid, std::function<void(int status)> cb);
+
+    // Thread-safe: run cb on the loop thread and wake it up
+    void post(Callback cb);
+
+    // Dispatch one batch of events; timeoutMs -1 blocks
+    void runOnce(int timeoutMs = -1);
+    // Dispatch until done() is true; may be nested from inside a callback
+    void runUntil(const std::function<bool()>& done);
+    void run();
+    void stop() noexcept { _stopped = true; }
+    bool stopped() const noexcept { return _stopped; }
+
+private:
+    void drainPosted();
+    void onSignalFd();
+    void addTimerFd(int fd, std::chrono::milliseconds interval, Callback cb);
+
+    int _epfd = -1;
+    int _wakeFd = -1;
+    int _sigFd = -1;
+    bool _stopped = false;
+
+    std::unordered_map<int, Callback> _fds;
+    std::unordered_map<int, Callback> _signals;
+    std::unordered_set<int> _timers;   // timerfds owned by the loop
+
+    std::mutex _postMx;
+    std::vector<Callback> _posted;
+};
+
+} // namespace esh
@@ -1,7 +1,143 @@
 #include "shell.hpp"
 #include "log.hpp"
+#include "loop.hpp"
+#include "crash.hpp"
+#include "utils.hpp"
+#include "metrics.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef ESH_VERSION
+#define ESH_VERSION "dev"
+#endif
+
+// The session's commands may write, delete or roll back files: they run in
+// a scratch copy of the recorded workspace, without the shell's own files
+static bool copy_workspace(const std::string& from, std::string& into, std::string& error) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path tmp = fs::temp_directory_path(ec);
+    std::string tmpl = ((ec ? fs::path("/tmp") : tmp) / "esh-replay.XXXXXX").string();
+    if (!mkdtemp(&tmpl[0])) {
+        error = tmpl + ": " + std::strerror(errno);
+        return false;
+    }
+    into = tmpl;
+    for (fs::directory_iterator it(from, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (name == ".git" || name == ".esh-snapshot" || name.compare(0, 12, ".shell_audit") == 0 ||
+            name.compare(0, 12, ".exam-shell.") == 0) {
+            continue;
+        }
+        fs::copy(it->path(), fs::path(into) / name, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
+        if (ec) {
+            error = it->path().string() + ": " + ec.message();
+            return false;
+        }
+    }
+    if (ec) error = from + ": " + ec.message();
+    return !ec;
+}
+
+// exam-shell --replay <recording> [session]: runs a recorded session without
+// a terminal, as fast as it goes, and prints how it compares. No audit
+// journal, watcher, metrics segment or exporter: only the copy is touched.
+static int replay_main(const char* file, int index) {
+    namespace fs = std::filesystem;
+    esh::Logger& L = esh::Logger::instance();
+    L.setLevel(esh::Logger::Level::Info);
+    L.enableConsole(false);
+    L.setPattern("[{time}] {level} {file}:{line} {func} | {msg}");
+    L.setFile(".exam-shell.replay.log");
+    L.setAsync(true);
+
+    std::error_code ec;
+    const std::string path = fs::absolute(file, ec).string();
+    std::vector<esh::RecordedSession> sessions;
+    std::string error;
+    if (!esh::load_sessions(path, sessions, &error)) {
+        std::cout << error << "\n";
+        return 2;
+    }
+    if (sessions.empty() || index < 0 || index > static_cast<int>(sessions.size())) {
+        std::cout << path << ": no session " << index << " (" << sessions.size() << " recorded)\n";
+        return 2;
+    }
+    if (index == 0) index = static_cast<int>(sessions.size());
+    const esh::RecordedSession& recorded = sessions[index - 1];
+
+    // The recording is written where the shell ran; use that when the
+    // recorded directory is gone
+    std::string source = recorded.cwd;
+    if (!fs::is_directory(source, ec)) source = fs::path(path).parent_path().string();
+    const std::string home = get_current_dir();
+    std::string scratch;
+    if (!copy_workspace(source, scratch, error) || chdir(scratch.c_str()) != 0) {
+        std::cout << "Cannot copy the workspace: " << error << "\n";
+        if (!scratch.empty()) fs::remove_all(scratch, ec);
+        return 2;
+    }
+    ESH_LOG_INFO() << "Replaying session " << index << " of " << path << " in a copy of " << source << " at "
+                   << scratch;
+
+    // Commands and children print to /dev/null and read EOF; the report
+    // goes to the real stdout
+    std::cout.flush();
+    const int savedOut = dup(STDOUT_FILENO);
+    const int devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    dup2(devNull, STDIN_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    std::ostringstream report;
+    report << "Replay of session " << index << "/" << sessions.size() << " of " << path << " (" << recorded.user
+           << " in " << recorded.cwd << ", replayed on a copy of " << source << ")\n";
+    int rc;
+    {
+        Shell shell(true);
+        rc = shell.replay(recorded, report);
+    }
+    std::cout.flush();
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedOut);
+    close(devNull);
+    if (chdir(home.c_str()) != 0) ESH_LOG_WARN() << "Cannot return to " << home;
+    fs::remove_all(scratch, ec);
+    std::cout << report.str() << std::flush;
+    L.flush();
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    // Also what bench/ times as the bare cost of an exec
+    if (argc > 1 && std::strcmp(argv[1], "--version") == 0) {
+        std::cout << "exam-shell " << ESH_VERSION << "\n";
+        return 0;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--replay") == 0) {
+        if (argc < 3 || argc > 4) {
+            std::cerr << "usage: exam-shell --replay <recording> [session]\n";
+            return 2;
+        }
+        esh::EventLoop::blockSignals({SIGINT, SIGTERM, SIGHUP});
+        return replay_main(argv[2], argc == 4 ? std::atoi(argv[3]) : 0);
+    }
+
+    // Before any thread starts, so every thread inherits the mask and the
+    // shell's event loop is the only place these signals are seen
+    esh::EventLoop::blockSignals({SIGINT, SIGTERM, SIGHUP});
+
+    // Only the interactive shell shows up in esh-top; before anything registers a metric
+    esh::metrics::publish();
 
-int main() {
     // Configure logger
     esh::Logger& L = esh::Logger::instance();
     L.setLevel(esh::Logger::Level::Info);
@@ -11,11 +147,21 @@ int main() {
     L.setAsync(true);
 
     ESH_LOG_INFO() << "Exam shell starting";
+    std::string error;
+    if (!esh::CrashHandler::install(".exam-shell.crash", &error)) ESH_LOG_WARN() << "No crash reports: " << error;
 
     Shell shell;
+    // exam-shell --init-only: the whole startup up to the first prompt, then
+    // exit; bench/ times it as startup.shell
+    if (argc > 1 && std::strcmp(argv[1], "--init-only") == 0) {
+        L.flush();
+        esh::CrashHandler::uninstall();
+        return 0;
+    }
     shell.run();
 
     ESH_LOG_INFO() << "Exam shell exited";
     L.flush();
+    esh::CrashHandler::uninstall();
     return 0;
 }
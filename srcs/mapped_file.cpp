@@ -0,0 +1,66 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+: _data(other._data), _size(other._size), _ok(other._ok) {
+    other._data = nullptr;
+    other._size = 0;
+    other._ok = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        _data = other._data;
+        _size = other._size;
+        _ok = other._ok;
+        other._data = nullptr;
+        other._size = 0;
+        other._ok = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+    if (_size > 0) {
+        void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            _size = 0;
+            return false;
+        }
+        // Files are read front to back once
+        madvise(p, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const char*>(p);
+    }
+    ::close(fd);
+    _ok = true;
+    return true;
+}
+
+void MappedFile::close() noexcept {
+    if (_data) munmap(const_cast<char*>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+    _ok = false;
+}
+
+} // namespace esh
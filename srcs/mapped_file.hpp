@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace esh {
+
+// Read-only mmap of a whole file. Empty files and failures give an empty
+// view; ok() tells them apart.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close() noexcept;
+
+    bool ok() const noexcept { return _ok; }
+    const char* data() const noexcept { return _data; }
+    std::size_t size() const noexcept { return _size; }
+    std::string_view view() const noexcept { return std::string_view(_data, _size); }
+
+private:
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+    bool _ok = false;
+};
+
+} // namespace esh
@@ -3,6 +3,8 @@
 #include "log.hpp"
 #include <iostream>
 #include <ctime>
+#include <cstdio>
+#include <cstdlib>
 
 using namespace std::chrono_literals;
 
@@ -40,39 +42,106 @@ void Menu::startupAnimation() const {
     esh::Logger::instance().log(esh::Logger::Level::Info, "Startup animation shown", __FILE__, __LINE__, __func__);
 }
 
-void Menu::showDashboard(const std::string& modeName, long sessionSeconds) const {
-    clear_screen();
-    std::cout << "\033[1;96m╔══════════════════════════════════════════════════╗\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m            \033[1;32mExam Shell Dashboard\033[0m               \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m╠══════════════════════════════════════════════════╣\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m Current user: \033[1;94m" << username() << "\033[0m";
-    std::cout << "                             \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m Current mode: \033[1;94m" << modeName << "\033[0m";
-    std::cout << "                             \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m Session time: \033[1;90m" << sessionSeconds << "s\033[0m";
-    std::cout << "                            \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m╠══════════════════════════════════════════════════╣\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m Quick actions:                                  \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - help     Show help                            \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - mode     Switch mode                          \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - status   Show this dashboard                  \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - clock    Show current time                    \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - grademe  Simulate grading                     \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m║\033[0m  - finish   Exit the shell                       \033[1;96m║\033[0m\n";
-    std::cout << "\033[1;96m╚══════════════════════════════════════════════════╝\033[0m\n\n";
+// Dashboard rows are padded to the box width so in-place updates line up
+static const std::size_t kBoxWidth = 50;
+
+static std::string box_row(const std::string& content) {
+    std::string row = "\033[1;96m║\033[0m" + content;
+    std::size_t w = Screen::width(content);
+    if (w < kBoxWidth) row.append(kBoxWidth - w, ' ');
+    row += "\033[1;96m║\033[0m";
+    return row;
+}
+
+static std::string box_rule(const char* left, const char* right) {
+    std::string row = std::string("\033[1;96m") + left;
+    for (std::size_t i = 0; i < kBoxWidth; ++i) row += "═";
+    row += right;
+    row += "\033[0m";
+    return row;
+}
+
+std::string format_duration(long seconds) {
+    if (seconds < 0) seconds = 0;
+    char buf[32];
+    if (seconds >= 3600) {
+        std::snprintf(buf, sizeof(buf), "%ld:%02ld:%02ld", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%ld:%02ld", seconds / 60, seconds % 60);
+    }
+    return buf;
 }
 
-ModeChoice Menu::pickMode() const {
+void Menu::composeDashboard(const DashboardInfo& info) const {
+    _dashboard.clear();
+    _dashboard.push_back(box_rule("╔", "╗"));
+    _dashboard.push_back(box_row("            \033[1;32mExam Shell Dashboard\033[0m"));
+    _dashboard.push_back(box_rule("╠", "╣"));
+    _dashboard.push_back(box_row(" Current user: \033[1;94m" + username() + "\033[0m"));
+    _dashboard.push_back(box_row(" Current mode: \033[1;94m" + info.modeName + "\033[0m"));
+    _dashboard.push_back(box_row(" Session time: \033[1;90m" + format_duration(info.sessionSeconds) + "\033[0m"));
+    if (info.remainingSeconds >= 0) {
+        const char* color = info.remainingSeconds < 600 ? "\033[1;31m" : "\033[1;33m";
+        _dashboard.push_back(box_row(" Time left:    " + std::string(color) + format_duration(info.remainingSeconds) + "\033[0m"));
+    }
+    _dashboard.push_back(box_row(" Jobs:         \033[1;35m" + (info.jobs.empty() ? std::string("none") : info.jobs) + "\033[0m"));
+    _dashboard.push_back(box_row(" Last grade:   " + (info.lastGrade.empty() ? std::string("-") : info.lastGrade)));
+    _dashboard.push_back(box_rule("╠", "╣"));
+    _dashboard.push_back(box_row(" Quick actions:"));
+    _dashboard.push_back(box_row("  - help     Show help"));
+    _dashboard.push_back(box_row("  - mode     Switch mode"));
+    _dashboard.push_back(box_row("  - status   Show this dashboard (-w: live)"));
+    _dashboard.push_back(box_row("  - clock    Show current time"));
+    _dashboard.push_back(box_row("  - grademe  Grade the current directory"));
+    _dashboard.push_back(box_row("  - finish   Exit the shell"));
+    _dashboard.push_back(box_rule("╚", "╝"));
+    _dashboard.push_back("");
+}
+
+bool Menu::readLine(const std::string& prompt, std::string& out) const {
+    return _reader ? _reader(prompt, out) : read_line(prompt, out);
+}
+
+void Menu::drawDashboard() const {
+    _screen.begin();
+    for (const auto& l : _dashboard) _screen.line(l);
+    _screen.present();
+}
+
+void Menu::showDashboard(const DashboardInfo& info) const {
+    composeDashboard(info);
+    // The REPL printed since the last frame: start from a clean screen
+    _screen.invalidate();
+    drawDashboard();
+}
+
+void Menu::refreshDashboard(const DashboardInfo& info) const {
+    composeDashboard(info);
+    drawDashboard();
+}
+
+// Drawn as a continuation of the dashboard frame, so a retry after an
+// invalid choice only rewrites the lines that changed
+ModeChoice Menu::pickMode(const DashboardInfo& info) const {
+    composeDashboard(info);
+    // The REPL printed since the last frame: start from a clean screen
+    _screen.invalidate();
+    std::string error;
     while (true) {
-        std::cout << "\n\033[1;95mSelect a mode:\033[0m\n";
-        std::cout << "  1) Project evaluation\n";
-        std::cout << "  2) Exam evaluation\n";
-        std::cout << "  3) Sandbox / practice\n";
-        std::cout << "  4) Back to menu / cancel\n";
+        _screen.begin();
+        for (const auto& l : _dashboard) _screen.line(l);
+        _screen.line("\033[1;95mSelect a mode:\033[0m");
+        _screen.line("  1) Project evaluation");
+        _screen.line("  2) Exam evaluation");
+        _screen.line("  3) Sandbox / practice");
+        _screen.line("  4) Back to menu / cancel");
+        _screen.line(error);
+        _screen.present();
+
         std::string choice;
-        if (!read_line("Choice [1-4]: ", choice)) {
+        if (!readLine("Choice [1-4]: ", choice)) {
             std::cout << "\n";
-            esh::Logger::instance().log(esh::Logger::Level::Info, "Mode selection cancelled (EOF)", __FILE__, __LINE__, __func__);
+            esh::Logger::instance().log(esh::Logger::Level::Info, "Mode selection cancelled (EOF or Ctrl+C)", __FILE__, __LINE__, __func__);
             return ModeChoice::Cancel;
         }
         choice = trim(choice);
@@ -80,54 +149,56 @@ ModeChoice Menu::pickMode() const {
         if (choice == "2") return ModeChoice::Evaluation;
         if (choice == "3") return ModeChoice::Sandbox;
         if (choice == "4") return ModeChoice::Cancel;
-        std::cout << "Invalid choice. Try again.\n";
+        error = "\033[1;31mInvalid choice '" + choice + "'. Try again.\033[0m";
         esh::Logger::instance().log(esh::Logger::Level::Warn, "Invalid mode choice: " + choice, __FILE__, __LINE__, __func__);
     }
 }
 
-int Menu::piscineMenu() const {
-    std::string choice = "-2";
-    while (choice == "-1" || choice == "-2") {
-        clear_screen();
-        std::cout << "\033[1m         42EXAM \n\033[31m   BACK\033[0m\033[1m to menu with \033[31m0\033[0m\n";
-        std::cout << "\033[32m            \033[0m\n\n\033[32m            •           \033[0m\n\033[1m    |  Piscine PART  |\033[0m\n\n";
-        std::cout << "\033[32m            1\033[0m\033[1m\n       EXAM WEEK 01\033[0m\n\n";
-        std::cout << "\033[32m            2\033[0m\033[1m\n       EXAM WEEK 02\033[0m\n\n";
-        std::cout << "\033[1m     \\ ------------ /\033[0m\n\n";
-        std::cout << "    Enter your choice:\n            ";
-        if (!std::getline(std::cin, choice)) return 0;
-        if (choice != "1" && choice != "2" && choice != "0") choice = "-1";
+int Menu::examMenu(const char* part, const std::vector<std::string>& exams) const {
+    std::string choice;
+    int picked = -1;
+    _screen.invalidate();
+    while (picked < 0) {
+        _screen.begin();
+        _screen.line("\033[1m         42EXAM ");
+        _screen.line("\033[31m   BACK\033[0m\033[1m to menu with \033[31m0\033[0m");
+        _screen.line("\033[32m            \033[0m");
+        _screen.line("");
+        _screen.line(std::string("\033[1m    |  ") + part + " PART  |\033[0m");
+        _screen.line("");
+        for (std::size_t i = 0; i < exams.size(); ++i) {
+            _screen.line("\033[32m            " + std::to_string(i + 1) + "\033[0m\033[1m");
+            _screen.line("       " + exams[i] + "\033[0m");
+            if (i + 1 < exams.size()) _screen.line("");
+        }
+        _screen.line("\033[1m     \\ ------------ /\033[0m");
+        _screen.line("");
+        _screen.line("    Enter your choice:");
+        _screen.present();
+        if (!readLine("            ", choice)) return 0;
+        choice = trim(choice);
+        if (!choice.empty() && choice.size() < 4 && choice.find_first_not_of("0123456789") == std::string::npos &&
+            static_cast<std::size_t>(std::atoi(choice.c_str())) <= exams.size()) {
+            picked = std::atoi(choice.c_str());
+        }
     }
-    return std::atoi(choice.c_str());
+    return picked;
 }
 
-int Menu::studentMenu() const {
-    std::string choice = "-2";
-    while (choice == "-1" || choice == "-2") {
-        clear_screen();
-        std::cout << "\033[1m         42EXAM \n\033[31m   BACK\033[0m\033[1m to menu with \033[31m0\033[0m\n";
-        std::cout << "\033[32m            \033[0m\n\n\033[1m    |  Student PART  |\033[0m\n\n";
-        std::cout << "\033[32m            2\033[0m\033[1m\n       EXAM RANK 02\033[0m\n\n";
-        std::cout << "\033[32m            3\033[0m\033[1m\n       EXAM RANK 03\033[0m\n\n";
-        std::cout << "\033[32m            4\033[0m\033[1m\n       EXAM RANK 04\033[0m\n\n";
-        std::cout << "\033[32m            5\033[0m\033[1m\n       EXAM RANK 05\033[0m\n\n";
-        std::cout << "\033[32m            6\033[0m\033[1m\n       EXAM RANK 06\033[0m\n";
-        std::cout << "\033[1m     \\ ------------ /\033[0m\n\n";
-        std::cout << "    Enter your choice:\n            ";
-        if (!std::getline(std::cin, choice)) return 0;
-        if (choice != "2" && choice != "3" && choice != "4" && choice != "5" && choice != "6" && choice != "0")
-            choice = "-1";
-    }
-    return std::atoi(choice.c_str());
+int Menu::piscineMenu(const std::vector<std::string>& exams) const {
+    return examMenu("Piscine", exams);
+}
+
+int Menu::studentMenu(const std::vector<std::string>& exams) const {
+    return examMenu("Student", exams);
 }
 
 void Menu::settingsMenu() const {
     clear_screen();
     std::cout << "\033[1m     === SETTINGS MENU ===\033[0m\n\033[31m          BACK\033[0m with \033[31m0\033[0m\n\n";
     std::cout << "This is a placeholder. Plug your settings here.\n";
-    std::cout << "Press Enter to go back...";
     std::string tmp;
-    std::getline(std::cin, tmp);
+    readLine("Press Enter to go back...", tmp);
 }
 
 } // namespace ui
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 #include <chrono>
+#include <vector>
+#include <functional>
+#include "screen.hpp"
 
 namespace ui {
 
@@ -11,16 +14,47 @@ enum class ModeChoice {
     Sandbox = 3
 };
 
+struct DashboardInfo {
+    std::string modeName;
+    long sessionSeconds = 0;
+    long remainingSeconds = -1;   // exam countdown, -1 when there is no time limit
+    std::string jobs;             // running background jobs, e.g. "[1:45%]"
+    std::string lastGrade;        // empty until grademe ran
+};
+
+// 125 -> "2:05", 3725 -> "1:02:05"
+std::string format_duration(long seconds);
+
 class Menu {
 public:
+    // Reads one answer after printing prompt; false on EOF or cancel
+    using LineReader = std::function<bool(const std::string& prompt, std::string& out)>;
+    // Without one, answers are read with a blocking readline()
+    void setLineReader(LineReader reader) { _reader = std::move(reader); }
+
     void startupAnimation() const;
-    void showDashboard(const std::string& modeName, long sessionSeconds) const;
-    ModeChoice pickMode() const;
+    void showDashboard(const DashboardInfo& info) const;
+    // Redraw in place: only rows that changed since the last frame are sent
+    void refreshDashboard(const DashboardInfo& info) const;
+    // Drawn under the dashboard for info, in the same frame
+    ModeChoice pickMode(const DashboardInfo& info) const;
 
-    // Optional: higher-level sections similar to legacy menus
-    int piscineMenu() const; // returns 0 to go back, 1..2 choices
-    int studentMenu() const; // returns 0 to go back, 2..6 choices
+    // Exam pickers over the registry's groups of that kind (titles, in
+    // order); return 0 to go back, else the 1-based entry
+    int piscineMenu(const std::vector<std::string>& exams) const;
+    int studentMenu(const std::vector<std::string>& exams) const;
     void settingsMenu() const; // placeholder to plug real settings
+
+private:
+    int examMenu(const char* part, const std::vector<std::string>& exams) const;
+    void composeDashboard(const DashboardInfo& info) const;
+    void drawDashboard() const;
+    bool readLine(const std::string& prompt, std::string& out) const;
+
+    // Frames are diffed against the previous one; menus redraw in place
+    mutable Screen _screen;
+    mutable std::vector<std::string> _dashboard;
+    LineReader _reader;
 };
 
 } // namespace ui
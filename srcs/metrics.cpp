@@ -0,0 +1,296 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+namespace metrics {
+
+namespace {
+
+std::atomic<bool> g_publish{false};
+
+// Owns this process's segment. The mapping is never unmapped: handles cached
+// in statics may still be written to while the process exits.
+struct Registry {
+    std::mutex mx;
+    Segment* seg = nullptr;
+    std::string shmName;
+    Shard scratch[kShards];
+    std::uint64_t scratchBounds[kBuckets] = {};
+
+    Registry() {
+        if (g_publish.load()) seg = createShared();
+        if (!seg) {   // still record, just privately
+            void* p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            seg = p == MAP_FAILED ? nullptr : static_cast<Segment*>(p);
+        }
+        if (!seg) return;
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        seg->version = kVersion;
+        seg->maxMetrics = kMaxMetrics;
+        seg->shards = kShards;
+        seg->pid = static_cast<std::int32_t>(getpid());
+        seg->startNs = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+        std::atomic_thread_fence(std::memory_order_release);
+        seg->magic = kMagic;   // last: readers reject the segment until it is set
+    }
+
+    ~Registry() { unlink(); }
+
+    Segment* createShared() {
+        std::string name = "/" + std::string(kShmPrefix) + std::to_string(getpid());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {   // left behind by a dead shell with our pid
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (fd < 0) return nullptr;
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, sizeof(Segment)) == 0) {
+            p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        shmName = name;
+        return static_cast<Segment*>(p);
+    }
+
+    void unlink() {
+        std::lock_guard<std::mutex> lock(mx);
+        // A forked child shares the mapping but does not own the name
+        if (!shmName.empty() && seg && seg->pid == static_cast<std::int32_t>(getpid())) {
+            shm_unlink(shmName.c_str());
+        }
+        shmName.clear();
+    }
+
+    Shard* lookup(const char* name, const char* help, Type type, std::initializer_list<std::uint64_t> bounds) {
+        std::lock_guard<std::mutex> lock(mx);
+        if (!seg) return scratch;
+        const std::uint32_t n = seg->count.load(std::memory_order_relaxed);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            if (std::strncmp(seg->desc[i].name, name, sizeof(seg->desc[i].name)) == 0) {
+                return seg->desc[i].type == type ? seg->data[i] : scratch;
+            }
+        }
+        if (n == kMaxMetrics) return scratch;
+        Descriptor& d = seg->desc[n];
+        std::strncpy(d.name, name, sizeof(d.name) - 1);
+        std::strncpy(d.help, help, sizeof(d.help) - 1);
+        d.type = type;
+        std::size_t k = 0;
+        for (std::uint64_t b : bounds) {
+            if (k == kBuckets) break;
+            d.bounds[k++] = b;
+        }
+        seg->count.store(n + 1, std::memory_order_release);
+        return seg->data[n];
+    }
+
+    const std::uint64_t* boundsOf(const Shard* shards) {
+        if (!seg || shards == scratch) return scratchBounds;
+        return seg->desc[static_cast<std::size_t>((shards - &seg->data[0][0]) / kShards)].bounds;
+    }
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+std::atomic<std::size_t> g_nextShard{0};
+
+// Threads take shards round-robin in the order they first record something
+inline Shard& my_shard(Shard* shards) noexcept {
+    thread_local const std::size_t index = g_nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shards[index];
+}
+
+} // namespace
+
+void Counter::inc(std::uint64_t n) noexcept {
+    if (_shards) my_shard(_shards).v[0].fetch_add(n, std::memory_order_relaxed);
+}
+
+std::uint64_t Counter::value() const noexcept {
+    std::uint64_t sum = 0;
+    if (_shards) {
+        for (std::size_t i = 0; i < kShards; ++i) sum += _shards[i].v[0].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Gauge::set(std::int64_t v) noexcept {
+    if (_shards) _shards[0].v[0].store(static_cast<std::uint64_t>(v), std::memory_order_relaxed);
+}
+
+void Gauge::add(std::int64_t delta) noexcept {
+    if (_shards) _shards[0].v[0].fetch_add(static_cast<std::uint64_t>(delta), std::memory_order_relaxed);
+}
+
+std::int64_t Gauge::value() const noexcept {
+    return _shards ? static_cast<std::int64_t>(_shards[0].v[0].load(std::memory_order_relaxed)) : 0;
+}
+
+void Histogram::observe(std::uint64_t v) noexcept {
+    if (!_shards) return;
+    std::size_t i = 0;   // the bucket after the last bound is +Inf
+    while (i < kBuckets && _bounds[i] != 0 && v > _bounds[i]) ++i;
+    Shard& s = my_shard(_shards);
+    s.v[i].fetch_add(1, std::memory_order_relaxed);
+    s.v[Shard::kCount].fetch_add(1, std::memory_order_relaxed);
+    s.v[Shard::kSum].fetch_add(v, std::memory_order_relaxed);
+}
+
+Counter counter(const char* name, const char* help) {
+    return Counter(registry().lookup(name, help, Type::Counter, {}));
+}
+
+Gauge gauge(const char* name, const char* help) {
+    return Gauge(registry().lookup(name, help, Type::Gauge, {}));
+}
+
+Histogram histogram(const char* name, const char* help, std::initializer_list<std::uint64_t> bounds) {
+    Registry& r = registry();
+    Shard* shards = r.lookup(name, help, Type::Histogram, bounds);
+    return Histogram(shards, r.boundsOf(shards));
+}
+
+void setLabel(const std::string& label) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mx);
+    if (!r.seg) return;
+    std::size_t n = std::min(label.size(), sizeof(r.seg->label) - 1);
+    std::memcpy(r.seg->label, label.data(), n);
+    std::memset(r.seg->label + n, 0, sizeof(r.seg->label) - n);
+}
+
+// Segments whose shell is gone: killed, or crashed before its destructors ran
+static void remove_stale() {
+    const std::size_t prefixLen = std::strlen(kShmPrefix);
+    for (const std::string& name : SegmentView::list()) {
+        char* end = nullptr;
+        long pid = std::strtol(name.c_str() + prefixLen, &end, 10);
+        if (pid <= 0 || *end != '\0' || pid == static_cast<long>(getpid())) continue;
+        if (kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH) shm_unlink(("/" + name).c_str());
+    }
+}
+
+bool publish() {
+    const char* env = std::getenv("ESH_METRICS");
+    if (env && std::strcmp(env, "0") == 0) return false;
+    remove_stale();
+    g_publish.store(true);
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mx);
+    return !r.shmName.empty();
+}
+
+void unpublish() {
+    registry().unlink();
+}
+
+const Segment* self() noexcept {
+    return registry().seg;
+}
+
+void snapshot(const Segment& seg, std::vector<Sample>& out) {
+    const std::uint32_t n = std::min<std::uint32_t>(seg.count.load(std::memory_order_acquire), kMaxMetrics);
+    out.resize(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        const Descriptor& d = seg.desc[i];
+        const Shard* shards = seg.data[i];
+        Sample& s = out[i];
+        s.name.assign(d.name, strnlen(d.name, sizeof(d.name)));
+        s.help.assign(d.help, strnlen(d.help, sizeof(d.help)));
+        s.type = d.type;
+        s.sum = 0;
+        if (d.type == Type::Gauge) {
+            s.value = static_cast<double>(static_cast<std::int64_t>(shards[0].v[0].load(std::memory_order_relaxed)));
+            continue;
+        }
+        if (d.type == Type::Counter) {
+            std::uint64_t sum = 0;
+            for (std::size_t k = 0; k < kShards; ++k) sum += shards[k].v[0].load(std::memory_order_relaxed);
+            s.value = static_cast<double>(sum);
+            continue;
+        }
+        std::size_t nb = 0;
+        while (nb < kBuckets && d.bounds[nb] != 0) ++nb;
+        s.bounds.assign(d.bounds, d.bounds + nb);
+        s.buckets.assign(nb + 1, 0);
+        std::uint64_t count = 0;
+        for (std::size_t k = 0; k < kShards; ++k) {
+            for (std::size_t b = 0; b <= nb; ++b) s.buckets[b] += shards[k].v[b].load(std::memory_order_relaxed);
+            count += shards[k].v[Shard::kCount].load(std::memory_order_relaxed);
+            s.sum += shards[k].v[Shard::kSum].load(std::memory_order_relaxed);
+        }
+        s.value = static_cast<double>(count);
+    }
+}
+
+SegmentView::~SegmentView() {
+    if (_seg) munmap(const_cast<Segment*>(_seg), sizeof(Segment));
+}
+
+SegmentView::SegmentView(SegmentView&& other) noexcept : _seg(other._seg) {
+    other._seg = nullptr;
+}
+
+SegmentView& SegmentView::operator=(SegmentView&& other) noexcept {
+    if (this != &other) {
+        if (_seg) munmap(const_cast<Segment*>(_seg), sizeof(Segment));
+        _seg = other._seg;
+        other._seg = nullptr;
+    }
+    return *this;
+}
+
+bool SegmentView::open(const std::string& name) {
+    *this = SegmentView();
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(Segment)) {
+        p = mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    _seg = static_cast<const Segment*>(p);
+    if (_seg->magic != kMagic || _seg->version != kVersion || _seg->maxMetrics != kMaxMetrics ||
+        _seg->shards != kShards) {
+        *this = SegmentView();
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> SegmentView::list() {
+    std::vector<std::string> out;
+    DIR* dir = opendir("/dev/shm");
+    if (!dir) return out;
+    const std::size_t prefixLen = std::strlen(kShmPrefix);
+    while (dirent* e = readdir(dir)) {
+        if (std::strncmp(e->d_name, kShmPrefix, prefixLen) == 0) out.emplace_back(e->d_name);
+    }
+    closedir(dir);
+    return out;
+}
+
+} // namespace metrics
+} // namespace esh
@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace esh {
+namespace metrics {
+
+// --- Shared-memory layout ------------------------------------------------------
+// Every shell owns one segment, /dev/shm/esh-metrics.<pid>, and updates it in
+// place; readers (tools/esh-top) map it read-only and never talk to the shell.
+// A metric's descriptor is written before Segment::count is bumped (release),
+// so readers only look at [0, count).
+
+const std::uint32_t kMagic = 0x4D485345;   // "ESHM"
+const std::uint32_t kVersion = 1;
+const std::size_t kMaxMetrics = 64;
+const std::size_t kShards = 8;             // per-thread slots of a metric
+const std::size_t kBuckets = 12;           // histogram bounds; one more bucket for +Inf
+const char* const kShmPrefix = "esh-metrics.";
+
+enum class Type : std::uint32_t { Counter, Gauge, Histogram };
+
+// One cache line pair per shard so threads never share a line. Counters use
+// v[0]; gauges use v[0] of shard 0 (as int64); histograms use v[0..kBuckets]
+// for bucket counts, v[kCount] for the count and v[kSum] for the sum.
+struct alignas(64) Shard {
+    static const std::size_t kCount = kBuckets + 1;
+    static const std::size_t kSum = kBuckets + 2;
+    std::atomic<std::uint64_t> v[16];
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared counters must be lock-free");
+static_assert(kBuckets + 3 <= 16, "histogram does not fit a shard");
+
+struct Descriptor {
+    char name[56];
+    Type type;
+    std::uint32_t reserved;
+    char help[96];
+    std::uint64_t bounds[kBuckets];   // histogram upper bounds, ascending; unused ones are 0
+};
+
+struct Segment {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t maxMetrics;
+    std::uint32_t shards;
+    std::atomic<std::uint32_t> count;
+    std::int32_t pid;
+    std::uint64_t startNs;   // CLOCK_REALTIME at creation
+    char label[64];          // free text, e.g. "student PROJECT rank02"
+    Descriptor desc[kMaxMetrics];
+    Shard data[kMaxMetrics][kShards];
+};
+
+// --- Recording ---------------------------------------------------------------
+// Handles are small values pointing into the segment: look one up once (e.g.
+// into a function-local static) and update it from any thread without locks.
+
+class Counter {
+public:
+    Counter() = default;
+    explicit Counter(Shard* shards) : _shards(shards) {}
+    void inc(std::uint64_t n = 1) noexcept;
+    std::uint64_t value() const noexcept;
+private:
+    Shard* _shards = nullptr;
+};
+
+class Gauge {
+public:
+    Gauge() = default;
+    explicit Gauge(Shard* shards) : _shards(shards) {}
+    void set(std::int64_t v) noexcept;
+    void add(std::int64_t delta) noexcept;
+    std::int64_t value() const noexcept;
+private:
+    Shard* _shards = nullptr;
+};
+
+class Histogram {
+public:
+    Histogram() = default;
+    Histogram(Shard* shards, const std::uint64_t* bounds) : _shards(shards), _bounds(bounds) {}
+    void observe(std::uint64_t v) noexcept;
+private:
+    Shard* _shards = nullptr;
+    const std::uint64_t* _bounds = nullptr;
+};
+
+// Metrics go to a shared segment only in a process that called publish()
+// before registering anything (the interactive shell); elsewhere (esh-audit,
+// esh-bench, --replay) they are recorded in private memory that no reader
+// sees. publish() also removes the segments of shells that died without
+// cleaning up. False when the segment could not be created, metrics were
+// already registered, or ESH_METRICS=0.
+bool publish();
+
+// Registration is idempotent by name. Past kMaxMetrics, handles point at a
+// scratch slot that nobody reads.
+Counter counter(const char* name, const char* help);
+Gauge gauge(const char* name, const char* help);
+Histogram histogram(const char* name, const char* help, std::initializer_list<std::uint64_t> bounds);
+
+void setLabel(const std::string& label);
+
+// Removes this process's segment (also done at exit)
+void unpublish();
+
+// The segment of this process, or nullptr before the first registration
+const Segment* self() noexcept;
+
+// --- Reading -----------------------------------------------------------------
+
+struct Sample {
+    std::string name;
+    std::string help;
+    Type type;
+    double value;                        // counter/gauge value, histogram count
+    std::uint64_t sum = 0;               // histograms
+    std::vector<std::uint64_t> bounds;   // histograms
+    std::vector<std::uint64_t> buckets;  // histograms, per bucket (not cumulative), +Inf last
+};
+
+// Sums the shards of every published metric; out is resized, and its
+// strings and vectors reused, so polling does not allocate in steady state
+void snapshot(const Segment& seg, std::vector<Sample>& out);
+
+// A segment mapped read-only, e.g. another shell's
+class SegmentView {
+public:
+    SegmentView() = default;
+    ~SegmentView();
+    SegmentView(SegmentView&& other) noexcept;
+    SegmentView& operator=(SegmentView&& other) noexcept;
+    SegmentView(const SegmentView&) = delete;
+    SegmentView& operator=(const SegmentView&) = delete;
+
+    // name as in /dev/shm, e.g. "esh-metrics.1234"; false if it is not a valid segment
+    bool open(const std::string& name);
+    const Segment* get() const noexcept { return _seg; }
+
+    // Names of all segments in /dev/shm
+    static std::vector<std::string> list();
+
+private:
+    const Segment* _seg = nullptr;
+};
+
+} // namespace metrics
+} // namespace esh
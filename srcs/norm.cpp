@@ -1,7 +1,14 @@
 #include "norm.hpp"
+#include "norm_report.hpp"
 #include "utils.hpp"
 #include "log.hpp"
+#include "mapped_file.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
 namespace norm {
@@ -14,84 +21,392 @@ static bool has_ext(const std::string& path, const std::vector<std::string>& ext
     return false;
 }
 
-std::vector<Issue> Checker::checkFile(const std::string& path, const Config& cfg) const {
-    std::vector<Issue> issues;
+static const RuleInfo kRules[] = {
+    {"header-missing", Severity::Warning, "File header does not start with required prefix"},
+    {"final-newline",  Severity::Warning, "File does not end with a newline"},
+    {"crlf",           Severity::Warning, "Windows CRLF line ending detected"},
+    {"tabs",           Severity::Error,   "Tab character is not allowed"},
+    {"trailing-space", Severity::Warning, "Trailing whitespace"},
+    {"line-length",    Severity::Warning, "Line exceeds max length of {}"},
+    {"function-length",   Severity::Error,   "Function body is {} lines long"},
+    {"function-count",    Severity::Error,   "File defines {} functions"},
+    {"forbidden-keyword", Severity::Error,   "Forbidden keyword at column {}"},
+    {"indentation",       Severity::Warning, "Indentation is not a multiple of {}"},
+    {"header-format",     Severity::Error,   "Line does not match the 42 header layout"},
+    {"forbidden-function", Severity::Error,  "Calls {s}, which is not an allowed function"},
+    {"static-binary",      Severity::Error,  "Statically linked, the functions it calls cannot be checked"},
+};
+static_assert(sizeof(kRules) / sizeof(kRules[0]) == static_cast<std::size_t>(Rule::Count),
+              "kRules must list every Rule");
 
-    // Read both content and lines
-    std::string all = read_text_file(path);
-    auto lines = read_file_lines(path);
+const RuleInfo& ruleInfo(Rule rule) noexcept {
+    return kRules[static_cast<std::size_t>(rule)];
+}
 
-    // Header check
-    if (!cfg.headerPrefix.empty()) {
-        if (lines.empty() || lines[0].find(cfg.headerPrefix) != 0) {
-            issues.push_back({path, 1, "header-missing", "File header does not start with required prefix", Severity::Warning});
-        }
+Rule ruleByName(std::string_view name) noexcept {
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Rule::Count); ++i) {
+        if (name == kRules[i].name) return static_cast<Rule>(i);
     }
+    return Rule::Count;
+}
 
-    // Final newline check
-    if (cfg.requireFinalNewline) {
-        if (all.empty() || all.back() != '\n') {
-            issues.push_back({path, 0, "final-newline", "File does not end with a newline", Severity::Warning});
-        }
+// Defined in norm_rules.cpp
+void registerBuiltinRules(std::vector<RuleRegistration>& out);
+
+static std::vector<RuleRegistration>& registry() {
+    static std::vector<RuleRegistration> rules = [] {
+        std::vector<RuleRegistration> v;
+        registerBuiltinRules(v);
+        return v;
+    }();
+    return rules;
+}
+
+void registerRule(const RuleRegistration& reg) {
+    registry().push_back(reg);
+}
+
+const std::vector<RuleRegistration>& registeredRules() {
+    return registry();
+}
+
+Config::Config() {
+    ruleState.fill(-1);
+}
+
+bool Config::enabled(Rule rule) const noexcept {
+    std::int8_t st = ruleState[static_cast<std::size_t>(rule)];
+    if (st >= 0) return st != 0;
+    for (const auto& reg : registeredRules()) {
+        if (reg.rule == rule) return reg.enabledByDefault;
     }
+    return false;
+}
 
-    // Per-line checks
-    for (std::size_t i = 0; i < lines.size(); ++i) {
-        const std::string& ln = lines[i];
+bool Config::setEnabled(std::string_view name, bool on) {
+    Rule rule = ruleByName(name);
+    if (rule == Rule::Count) return false;
+    ruleState[static_cast<std::size_t>(rule)] = on ? 1 : 0;
+    return true;
+}
+
+static std::vector<std::string> split_list(const std::string& value) {
+    std::vector<std::string> out;
+    std::size_t pos = 0;
+    while (pos <= value.size()) {
+        std::size_t comma = value.find(',', pos);
+        if (comma == std::string::npos) comma = value.size();
+        std::string item = trim(value.substr(pos, comma - pos));
+        if (!item.empty()) out.push_back(item);
+        pos = comma + 1;
+    }
+    return out;
+}
 
-        // CRLF detection
-        if (!ln.empty() && ln.back() == '\r') {
-            issues.push_back({path, i + 1, "crlf", "Windows CRLF line ending detected", Severity::Warning});
+static bool parse_size(const std::string& value, std::size_t& out) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) return false;
+    out = static_cast<std::size_t>(std::strtoul(value.c_str(), nullptr, 10));
+    return true;
+}
+
+static bool parse_bool(const std::string& value, bool& out) {
+    if (value == "true" || value == "yes" || value == "1" || value == "on") { out = true; return true; }
+    if (value == "false" || value == "no" || value == "0" || value == "off") { out = false; return true; }
+    return false;
+}
+
+bool Config::set(const std::string& key, const std::string& value, std::string* error) {
+    bool ok = true;
+    if (key == "enable" || key == "disable") {
+        for (const auto& name : split_list(value)) {
+            if (!setEnabled(name, key == "enable")) {
+                if (error) *error = "unknown rule '" + name + "'";
+                return false;
+            }
         }
+    } else if (key == "max-line-length") {
+        ok = parse_size(value, maxLineLength);
+    } else if (key == "allow-tabs") {
+        ok = parse_bool(value, allowTabs);
+    } else if (key == "final-newline") {
+        ok = parse_bool(value, requireFinalNewline);
+    } else if (key == "header-prefix") {
+        headerPrefix = value;
+    } else if (key == "extensions") {
+        fileExtensions = split_list(value);
+    } else if (key == "max-function-lines") {
+        ok = parse_size(value, maxFunctionLines);
+    } else if (key == "max-functions") {
+        ok = parse_size(value, maxFunctions);
+    } else if (key == "indent-width") {
+        ok = parse_size(value, indentWidth) && indentWidth > 0;
+    } else if (key == "forbidden-keywords") {
+        forbiddenKeywords = split_list(value);
+    } else {
+        if (error) *error = "unknown key '" + key + "'";
+        return false;
+    }
+    if (!ok && error) *error = "bad value for '" + key + "'";
+    return ok;
+}
+
+bool Config::load(const std::string& path, std::string* error) {
+    std::ifstream in(path.c_str());
+    if (!in.is_open()) return true;
+    std::string raw;
+    std::string why;
+    std::size_t lineNo = 0;
+    auto fail = [&](const std::string& reason) {
+        if (error) *error = path + ":" + std::to_string(lineNo) + ": " + reason;
+        return false;
+    };
+    while (std::getline(in, raw)) {
+        ++lineNo;
+        std::string line = trim(raw.substr(0, raw.find('#')));
+        if (line.empty()) continue;
+        std::size_t eq = line.find('=');
+        if (eq == std::string::npos) return fail("expected key = value");
+        if (!set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why)) return fail(why);
+    }
+    return true;
+}
+
+std::uint32_t Report::internFile(std::string_view path) {
+    auto it = _fileIds.find(path);
+    if (it != _fileIds.end()) return it->second;
+    std::uint32_t id = static_cast<std::uint32_t>(_files.size());
+    _files.emplace_back(path);
+    _fileIds.emplace(_files.back(), id);
+    return id;
+}
+
+void Report::add(std::uint32_t file, std::uint32_t line, Rule rule, std::uint32_t arg) {
+    _issues.push_back(Issue{file, line, arg, rule, ruleInfo(rule).severity});
+}
+
+std::uint32_t Report::internName(std::string_view name) {
+    auto it = _nameIds.find(name);
+    if (it != _nameIds.end()) return it->second;
+    std::uint32_t id = static_cast<std::uint32_t>(_names.size());
+    _names.emplace_back(name);
+    _nameIds.emplace(_names.back(), id);
+    return id;
+}
+
+static bool takes_name(Rule rule) noexcept {
+    return std::strstr(ruleInfo(rule).format, "{s}") != nullptr;
+}
+
+void Report::merge(Report&& other) {
+    if (_issues.empty() && _files.empty() && _names.empty()) {
+        *this = std::move(other);
+        return;
+    }
+    std::vector<std::uint32_t> remap;
+    remap.reserve(other._files.size());
+    for (const auto& f : other._files) remap.push_back(internFile(f));
+    std::vector<std::uint32_t> names;
+    names.reserve(other._names.size());
+    for (const auto& n : other._names) names.push_back(internName(n));
+    _issues.reserve(_issues.size() + other._issues.size());
+    for (Issue is : other._issues) {
+        is.file = remap[is.file];
+        if (takes_name(is.rule)) is.arg = names[is.arg];
+        _issues.push_back(is);
+    }
+    other._issues.clear();
+}
 
-        // Tabs
-        if (!cfg.allowTabs && ln.find('\t') != std::string::npos) {
-            issues.push_back({path, i + 1, "tabs", "Tab character is not allowed", Severity::Error});
+std::size_t Report::count(Severity severity) const noexcept {
+    std::size_t n = 0;
+    for (const auto& is : _issues) n += is.severity == severity;
+    return n;
+}
+
+void Report::appendMessage(std::string& out, const Issue& issue) const {
+    const char* fmt = ruleInfo(issue.rule).format;
+    if (const char* text = std::strstr(fmt, "{s}")) {
+        out.append(fmt, text);
+        out += _names[issue.arg];
+        out += text + 3;
+        return;
+    }
+    const char* hole = std::strstr(fmt, "{}");
+    if (!hole) {
+        out += fmt;
+        return;
+    }
+    out.append(fmt, hole);
+    char num[16];
+    int n = std::snprintf(num, sizeof(num), "%u", issue.arg);
+    out.append(num, static_cast<std::size_t>(n));
+    out += hole + 2;
+}
+
+std::string Report::message(const Issue& issue) const {
+    std::string out;
+    appendMessage(out, issue);
+    return out;
+}
+
+Checker::Checker(const Config& cfg)
+: _cfg(cfg) {
+    for (const auto& reg : registeredRules()) {
+        if (!_cfg.enabled(reg.rule)) continue;
+        _rules.push_back(Active{reg.make(_cfg), reg.events, _timings.size()});
+        _events |= reg.events;
+        _timings.push_back(Timing{reg.rule, 0, 0});
+    }
+}
+
+template <typename Fn>
+void Checker::dispatch(unsigned event, Fn&& fn) {
+    for (auto& r : _rules) {
+        if (!(r.events & event)) continue;
+        if (!_timing) {
+            fn(*r.check);
+            continue;
         }
+        auto t0 = std::chrono::steady_clock::now();
+        fn(*r.check);
+        Timing& t = _timings[r.timing];
+        t.ns += static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+        ++t.calls;
+    }
+}
+
+// Lexical state carried from one line to the next
+struct ScanState {
+    bool inComment = false;
+};
 
-        // Trailing whitespace
-        if (!ln.empty()) {
-            std::size_t j = ln.size();
-            while (j > 0 && (ln[j - 1] == ' ' || ln[j - 1] == '\t' || ln[j - 1] == '\r')) --j;
-            if (j < ln.size()) {
-                issues.push_back({path, i + 1, "trailing-space", "Trailing whitespace", Severity::Warning});
+// Fill lv from one line: byte facts and the blanked code copy
+static void scan_line(std::string_view text, ScanState& st, std::string& code, LineView& lv) {
+    lv.text = text;
+    lv.crlf = !text.empty() && text.back() == '\r';
+    lv.length = text.size() - (lv.crlf ? 1 : 0);
+    lv.hasTab = false;
+    // A CRLF line has always been reported for trailing whitespace as well
+    lv.trailingBlank = lv.crlf || (lv.length > 0 && (text[lv.length - 1] == ' ' || text[lv.length - 1] == '\t'));
+    lv.indent = 0;
+    while (lv.indent < lv.length && (text[lv.indent] == ' ' || text[lv.indent] == '\t')) ++lv.indent;
+
+    code.assign(text.data(), lv.length);
+    char quote = 0;
+    for (std::size_t i = 0; i < lv.length; ++i) {
+        char c = text[i];
+        if (c == '\t') lv.hasTab = true;
+        if (st.inComment) {
+            if (c == '*' && i + 1 < lv.length && text[i + 1] == '/') {
+                st.inComment = false;
+                code[i + 1] = ' ';
+                ++i;
+            }
+            code[i] = ' ';
+            continue;
+        }
+        if (quote) {
+            if (c == '\\' && i + 1 < lv.length) {
+                code[i] = code[i + 1] = ' ';
+                ++i;
+                continue;
+            }
+            if (c == quote) quote = 0;
+            code[i] = ' ';
+            continue;
+        }
+        if (c == '/' && i + 1 < lv.length && text[i + 1] == '/') {
+            for (std::size_t k = i; k < lv.length; ++k) {
+                if (text[k] == '\t') lv.hasTab = true;
+                code[k] = ' ';
             }
+            break;
+        }
+        if (c == '/' && i + 1 < lv.length && text[i + 1] == '*') {
+            st.inComment = true;
+            code[i] = code[i + 1] = ' ';
+            ++i;
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            quote = c;
+            code[i] = ' ';
+            continue;
+        }
+    }
+    lv.code = code;
+}
+
+void Checker::checkFile(const std::string& path, Report& out) {
+    esh::MappedFile file(path);
+    if (!file.ok()) {
+        ESH_LOG_WARN() << "norm: cannot read " << path;
+        return;
+    }
+    const std::string_view data = file.view();
+    const FileContext ctx(path, out.internFile(path), data, _cfg, out);
+
+    dispatch(OnFile, [&](RuleCheck& r) { r.beginFile(ctx); });
+
+    if (_events & OnLine) {
+        ScanState st;
+        LineView lv{};
+        std::uint32_t lineNo = 0;
+        for (std::size_t pos = 0; pos < data.size();) {
+            std::size_t nl = data.find('\n', pos);
+            if (nl == std::string_view::npos) nl = data.size();
+            lv.number = ++lineNo;
+            scan_line(data.substr(pos, nl - pos), st, _code, lv);
+            pos = nl + 1;
+            dispatch(OnLine, [&](RuleCheck& r) { r.onLine(ctx, lv); });
         }
+    }
 
-        // Line length
-        std::size_t visualLen = ln.size();
-        if (visualLen > cfg.maxLineLength) {
-            issues.push_back({path, i + 1, "line-length", "Line exceeds max length of " + std::to_string(cfg.maxLineLength), Severity::Warning});
+    if (_events & OnToken) {
+        _lexer.reset(data);
+        esh::Token tok;
+        while (_lexer.next(tok)) {
+            dispatch(OnToken, [&](RuleCheck& r) { r.onToken(ctx, tok); });
         }
     }
 
-    return issues;
+    dispatch(OnFile, [&](RuleCheck& r) { r.endFile(ctx); });
 }
 
-std::vector<Issue> Checker::run(const std::string& rootPath, const Config& cfg) const {
-    std::vector<Issue> allIssues;
-    auto files = list_files_recursive(rootPath, cfg.fileExtensions);
+Report Checker::run(const std::string& rootPath) {
+    Report report;
+    auto files = list_files_recursive(rootPath, _cfg.fileExtensions);
     for (const auto& f : files) {
-        if (!has_ext(f, cfg.fileExtensions)) continue;
-        auto issues = checkFile(f, cfg);
-        allIssues.insert(allIssues.end(), issues.begin(), issues.end());
+        if (!has_ext(f, _cfg.fileExtensions)) continue;
+        checkFile(f, report);
     }
     esh::Logger::instance().log(esh::Logger::Level::Info, "Norm check completed on " + std::to_string(files.size()) + " files", __FILE__, __LINE__, __func__);
-    return allIssues;
+    return report;
+}
+
+void Checker::reportTimings(const std::vector<Timing>& timings, std::ostream& out) {
+    std::vector<Timing> sorted(timings);
+    std::sort(sorted.begin(), sorted.end(), [](const Timing& a, const Timing& b) { return a.ns > b.ns; });
+    out << "Rule timings:\n";
+    for (const auto& t : sorted) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "  %-18s %10.3f ms %12llu calls\n", ruleInfo(t.rule).name,
+                      static_cast<double>(t.ns) / 1e6, static_cast<unsigned long long>(t.calls));
+        out << line;
+    }
 }
 
-void Checker::reportConsole(const std::vector<Issue>& issues) {
-    std::size_t nInfo = 0, nWarn = 0, nErr = 0;
-    for (const auto& is : issues) {
-        const char* sev = is.severity == Severity::Error ? "ERROR" : (is.severity == Severity::Warning ? "WARN " : "INFO ");
-        std::cout << sev << " " << is.file;
-        if (is.line) std::cout << ":" << is.line;
-        std::cout << " [" << is.rule << "] " << is.message << "\n";
-        if (is.severity == Severity::Error) ++nErr;
-        else if (is.severity == Severity::Warning) ++nWarn;
-        else ++nInfo;
+void Checker::reportConsole(const Report& report, std::ostream& out) {
+    auto writer = ReportWriter::create(ReportFormat::Console, out);
+    writer->begin();
+    // One fileDone per run of issues from the same file
+    const auto& issues = report.issues();
+    for (std::size_t i = 0, j = 0; i < issues.size(); i = j) {
+        for (j = i + 1; j < issues.size() && issues[j].file == issues[i].file; ++j) {}
+        writer->fileDone(report, issues[i].file, i, j);
     }
-    std::cout << "Summary: " << nErr << " error(s), " << nWarn << " warning(s), " << nInfo << " info.\n";
+    writer->end(report);
 }
 
 } // namespace norm
@@ -1,18 +1,98 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <iostream>
+#include <cstdint>
+#include "lexer.hpp"
 
 namespace norm {
 
-enum class Severity { Info, Warning, Error };
+enum class Severity : std::uint8_t { Info, Warning, Error };
 
+// Rule ids index kRules (norm.cpp); names and message formats live there
+// rather than in every issue.
+enum class Rule : std::uint8_t {
+    HeaderMissing,
+    FinalNewline,
+    Crlf,
+    Tabs,
+    TrailingSpace,
+    LineLength,
+    FunctionLength,
+    FunctionCount,
+    ForbiddenKeyword,
+    Indentation,
+    HeaderFormat,
+    ForbiddenFunction,   // from the compiled program (esh::checkAllowedFunctions), not a source rule
+    StaticBinary,        // same source: libc linked in, so its calls cannot be checked
+    Count
+};
+
+struct RuleInfo {
+    const char* name;      // e.g., "line-length", "trailing-space"
+    Severity severity;
+    const char* format;    // message; "{}" is replaced by Issue::arg, "{s}" by Report::name(arg)
+};
+
+const RuleInfo& ruleInfo(Rule rule) noexcept;
+// Rule::Count when the name is unknown
+Rule ruleByName(std::string_view name) noexcept;
+
+// 16 bytes, no owned memory: the file is an id into the Report's path table
+// and the message is only formatted when it is printed.
 struct Issue {
-    std::string file;
-    std::size_t line;     // 1-based, 0 if not applicable
-    std::string rule;     // e.g., "line-length", "trailing-space"
-    std::string message;
+    std::uint32_t file;
+    std::uint32_t line;   // 1-based, 0 if not applicable
+    std::uint32_t arg;    // rule parameter for the message, e.g. the length limit
+    Rule rule;
     Severity severity;
 };
+static_assert(sizeof(Issue) == 16, "Issue is meant to stay a small POD");
+
+// Issues for a whole run plus the interned file paths they point into
+class Report {
+public:
+    Report() = default;
+    // A copy would duplicate the deques but keep map keys viewing the
+    // original's strings. Moving a deque hands over its blocks, so the
+    // strings, and the views, stay where they are.
+    Report(const Report&) = delete;
+    Report& operator=(const Report&) = delete;
+    Report(Report&&) = default;
+    Report& operator=(Report&&) = default;
+
+    std::uint32_t internFile(std::string_view path);
+    const std::string& file(std::uint32_t id) const { return _files[id]; }
+    std::size_t fileCount() const noexcept { return _files.size(); }
+    // Text arguments of "{s}" messages (e.g. symbol names), interned the same way
+    std::uint32_t internName(std::string_view name);
+    const std::string& name(std::uint32_t id) const { return _names[id]; }
+
+    void add(std::uint32_t file, std::uint32_t line, Rule rule, std::uint32_t arg = 0);
+    // Move other's issues in, remapping its file and name ids
+    void merge(Report&& other);
+
+    const std::vector<Issue>& issues() const noexcept { return _issues; }
+    std::size_t size() const noexcept { return _issues.size(); }
+    bool empty() const noexcept { return _issues.empty(); }
+    std::size_t count(Severity severity) const noexcept;
+
+    // Lazy message formatting; the append form reuses the caller's buffer
+    void appendMessage(std::string& out, const Issue& issue) const;
+    std::string message(const Issue& issue) const;
+
+private:
+    std::deque<std::string> _files;   // deque: the views in _fileIds stay valid
+    std::unordered_map<std::string_view, std::uint32_t> _fileIds;
+    std::deque<std::string> _names;
+    std::unordered_map<std::string_view, std::uint32_t> _nameIds;
+    std::vector<Issue> _issues;
+};
 
 struct Config {
     std::size_t maxLineLength = 80;
@@ -20,16 +100,140 @@ struct Config {
     bool requireFinalNewline = true;
     std::string headerPrefix; // e.g., "// 42 " or "/* ************************************************************************** */"
     std::vector<std::string> fileExtensions{".c", ".h", ".cpp", ".hpp", ".cc", ".hh"};
+
+    // Rules that are off unless enabled (see Config::load)
+    std::size_t maxFunctionLines = 25;
+    std::size_t maxFunctions = 5;
+    std::size_t indentWidth = 4;
+    std::vector<std::string> forbiddenKeywords{"for", "do", "switch", "case", "goto"};
+
+    // Per rule: -1 = rule default, 0 = off, 1 = on
+    std::array<std::int8_t, static_cast<std::size_t>(Rule::Count)> ruleState{};
+
+    Config();
+    bool enabled(Rule rule) const noexcept;
+    // false when the name is not a rule
+    bool setEnabled(std::string_view name, bool on);
+
+    // One setting by its .normrc key; false with a reason in error when the
+    // key or value is bad
+    bool set(const std::string& key, const std::string& value, std::string* error = nullptr);
+
+    // "key = value" lines, '#' comments. Keys: enable, disable (comma
+    // separated rule names), max-line-length, allow-tabs, final-newline,
+    // header-prefix, extensions, max-function-lines, max-functions,
+    // indent-width, forbidden-keywords. Returns false and sets error on the
+    // first bad line; a missing file is not an error.
+    bool load(const std::string& path, std::string* error = nullptr);
+};
+
+// --- Rule engine -------------------------------------------------------------
+// Every file is mapped and scanned once for lines. The scan precomputes
+// per-line facts (length, indentation, tabs, trailing blanks, CR, a copy of
+// the line with comments and string literals blanked out) and hands them to
+// each enabled rule that subscribed to that event. Rules that need syntax
+// subscribe to tokens; the file is then also run through esh::Lexer, once,
+// for all of them.
+
+enum Event : unsigned {
+    OnFile  = 1u << 0,   // beginFile/endFile with the whole buffer
+    OnLine  = 1u << 1,   // onLine with the precomputed LineView
+    OnToken = 1u << 2    // onToken for every token except comments
+};
+
+struct LineView {
+    std::uint32_t number;      // 1-based
+    std::string_view text;     // without '\n', with a trailing '\r' if any
+    std::string_view code;     // text with comments/literals replaced by spaces
+    std::size_t length;        // text length without the '\r'
+    std::size_t indent;        // leading blanks, tabs counted as one
+    bool hasTab;
+    bool trailingBlank;        // space, tab or the '\r' of a CRLF before the end of line
+    bool crlf;
 };
 
+class FileContext {
+public:
+    FileContext(const std::string& path, std::uint32_t file, std::string_view data,
+                const Config& cfg, Report& report)
+    : path(path), file(file), data(data), cfg(cfg), _report(report) {}
+
+    void emit(std::uint32_t line, Rule rule, std::uint32_t arg = 0) const {
+        _report.add(file, line, rule, arg);
+    }
+    std::string_view text(const esh::Token& tok) const noexcept { return tok.text(data); }
+
+    const std::string& path;
+    const std::uint32_t file;
+    const std::string_view data;
+    const Config& cfg;
+
+private:
+    Report& _report;
+};
+
+class RuleCheck {
+public:
+    virtual ~RuleCheck() = default;
+    virtual void beginFile(const FileContext&) {}
+    virtual void onLine(const FileContext&, const LineView&) {}
+    virtual void onToken(const FileContext&, const esh::Token&) {}
+    virtual void endFile(const FileContext&) {}
+};
+
+struct RuleRegistration {
+    Rule rule;
+    unsigned events;         // Event bits
+    bool enabledByDefault;
+    std::unique_ptr<RuleCheck> (*make)(const Config& cfg);
+};
+
+// Built-in rules register themselves on first use (norm_rules.cpp); more can
+// be added before a Checker is created.
+void registerRule(const RuleRegistration& reg);
+const std::vector<RuleRegistration>& registeredRules();
+
 class Checker {
 public:
-    Checker() = default;
+    struct Timing {
+        Rule rule;
+        std::uint64_t calls = 0;
+        std::uint64_t ns = 0;
+    };
+
+    explicit Checker(const Config& cfg = Config());
+
+    // Appends the issues of one file to out. Not thread-safe: rules keep
+    // per-file state, use one Checker per thread.
+    void checkFile(const std::string& path, Report& out);
+    Report run(const std::string& rootPath);
+
+    const Config& config() const noexcept { return _cfg; }
+
+    // Per-rule time accounting (adds a clock read around every rule call)
+    void setTiming(bool on) noexcept { _timing = on; }
+    const std::vector<Timing>& timings() const noexcept { return _timings; }
+    static void reportTimings(const std::vector<Timing>& timings, std::ostream& out = std::cout);
+
+    static void reportConsole(const Report& report, std::ostream& out = std::cout);
+
+private:
+    struct Active {
+        std::unique_ptr<RuleCheck> check;
+        unsigned events;
+        std::size_t timing;   // index into _timings
+    };
 
-    std::vector<Issue> checkFile(const std::string& path, const Config& cfg) const;
-    std::vector<Issue> run(const std::string& rootPath, const Config& cfg) const;
+    template <typename Fn>
+    void dispatch(unsigned event, Fn&& fn);
 
-    static void reportConsole(const std::vector<Issue>& issues);
+    Config _cfg;
+    std::vector<Active> _rules;
+    std::vector<Timing> _timings;
+    unsigned _events = 0;   // union of the active rules' events
+    bool _timing = false;
+    std::string _code;      // reused per-line buffer for LineView::code
+    esh::Lexer _lexer;
 };
 
 } // namespace norm
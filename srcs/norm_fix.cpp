@@ -0,0 +1,247 @@
+#include "norm_fix.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace norm {
+
+Fixer::Fixer(const Config& cfg)
+: _trailing(cfg.enabled(Rule::TrailingSpace)),
+  _crlf(cfg.enabled(Rule::Crlf)),
+  _tabs(cfg.enabled(Rule::Tabs) && !cfg.allowTabs),
+  _finalNewline(cfg.enabled(Rule::FinalNewline) && cfg.requireFinalNewline),
+  _tabWidth(cfg.indentWidth ? cfg.indentWidth : 4) {}
+
+static inline bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+void Fixer::expandTabs(std::string_view text, std::string* out) {
+    const std::size_t base = out ? out->size() : 0;
+    const std::size_t n = text.size();
+    char quote = 0;   // literals do not continue on the next line
+    for (std::size_t i = 0; i < n; ++i) {
+        const char c = text[i];
+        const char next = i + 1 < n ? text[i + 1] : '\0';
+        if (_inComment) {
+            if (c == '*' && next == '/') {
+                _inComment = false;
+                if (out) out->append("*/");
+                ++i;
+                continue;
+            }
+        } else if (quote) {
+            if (c == '\\' && i + 1 < n) {
+                if (out) out->append(text.data() + i, 2);
+                ++i;
+                continue;
+            }
+            if (c == quote) {
+                quote = 0;
+            } else if (c == '\t') {
+                // Same value, and no longer a tab in the source
+                if (out) out->append("\\t");
+                continue;
+            }
+        } else if (c == '/' && next == '/') {
+            for (; i < n; ++i) {
+                if (text[i] != '\t') {
+                    if (out) out->push_back(text[i]);
+                } else if (out) {
+                    out->append(_tabWidth - (out->size() - base) % _tabWidth, ' ');
+                }
+            }
+            return;
+        } else if (c == '/' && next == '*') {
+            _inComment = true;
+            if (out) out->append("/*");
+            ++i;
+            continue;
+        } else if (c == '"') {
+            quote = c;
+        } else if (c == '\'' && !(i > 0 && is_digit(text[i - 1]) && !(i > 1 && text[i - 2] == 'u' && text[i - 1] == '8'))) {
+            // A quote right after a digit is a C++14 digit separator, u8'x' aside
+            quote = c;
+        }
+        if (!out) continue;
+        if (c == '\t') out->append(_tabWidth - (out->size() - base) % _tabWidth, ' ');
+        else out->push_back(c);
+    }
+}
+
+bool Fixer::fixLine(std::string_view line, bool tabs, FixResult& result) {
+    std::size_t end = line.size();
+    const bool cr = end > 0 && line[end - 1] == '\r';
+    if (cr) --end;
+    std::size_t keep = end;
+    if (_trailing) {
+        while (keep > 0 && (line[keep - 1] == ' ' || line[keep - 1] == '\t')) --keep;
+    }
+    const bool hasTab = tabs && keep > 0 && std::memchr(line.data(), '\t', keep) != nullptr;
+    const bool fixCr = cr && _crlf;
+
+    if (!hasTab && !fixCr && keep == end) {
+        if (tabs) expandTabs(line.substr(0, end), nullptr);
+        return false;
+    }
+
+    _line.clear();
+    if (hasTab) {
+        expandTabs(line.substr(0, keep), &_line);
+        ++result.tabs;
+    } else {
+        if (tabs) expandTabs(line.substr(0, keep), nullptr);
+        _line.append(line.data(), keep);
+    }
+    if (keep != end) ++result.trailingSpace;
+    if (fixCr) ++result.crlf;
+    else if (cr) _line.push_back('\r');
+    return true;
+}
+
+bool Fixer::fixFile(const std::string& path, FixResult& result) {
+    result = FixResult();
+    esh::MappedFile file(path);
+    if (!file.ok()) {
+        result.error = "cannot read " + path;
+        return false;
+    }
+    const std::string_view data = file.view();
+    result.bytesIn = data.size();
+    // Literal and comment tracking is only needed when there is a tab to expand
+    const bool tabs = _tabs && !data.empty() && std::memchr(data.data(), '\t', data.size()) != nullptr;
+
+    _inComment = false;
+    _out.clear();
+    bool changed = false;
+    std::size_t copied = 0;   // data[0, copied) is already in _out
+    for (std::size_t pos = 0; pos < data.size();) {
+        std::size_t nl = data.find('\n', pos);
+        if (nl == std::string_view::npos) nl = data.size();
+        if (fixLine(data.substr(pos, nl - pos), tabs, result)) {
+            if (!changed) _out.reserve(data.size() + data.size() / 8 + 1);
+            changed = true;
+            _out.append(data.data() + copied, pos - copied);
+            _out += _line;
+            copied = nl;   // the '\n' goes out with the next unchanged chunk
+        }
+        pos = nl + 1;
+    }
+    if (_finalNewline && (data.empty() || data.back() != '\n')) {
+        result.finalNewline = true;
+        changed = true;
+    }
+    if (!changed) return false;
+
+    if (copied < data.size()) _out.append(data.data() + copied, data.size() - copied);
+    if (result.finalNewline) _out.push_back('\n');
+    file.close();
+    if (!replace(path, _out, result.error)) return false;
+    result.rewritten = true;
+    result.bytesOut = _out.size();
+    return true;
+}
+
+// Write next to the original and rename over it: readers see the old or the
+// new file, never a partial one
+bool Fixer::replace(const std::string& path, const std::string& content, std::string& error) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        error = path + " is not a regular file, left as is";
+        return false;
+    }
+    const std::size_t slash = path.rfind('/');
+    const std::size_t nameAt = slash == std::string::npos ? 0 : slash + 1;
+    std::string tmp = path.substr(0, nameAt) + "." + path.substr(nameAt) + ".fix.XXXXXX";
+    int fd = ::mkstemp(&tmp[0]);
+    if (fd < 0) {
+        error = "cannot create a temp file for " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    bool ok = true;
+    const char* p = content.data();
+    std::size_t left = content.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    ok = ok && ::fchmod(fd, st.st_mode & 07777) == 0 && ::fsync(fd) == 0;
+    int saved = errno;
+    if (::close(fd) != 0 && ok) {
+        ok = false;
+        saved = errno;
+    }
+    if (ok && ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ok = false;
+        saved = errno;
+    }
+    if (!ok) {
+        ::unlink(tmp.c_str());
+        error = "cannot rewrite " + path + ": " + std::strerror(saved);
+    }
+    return ok;
+}
+
+FixSummary Fixer::run(const std::vector<std::string>& files, unsigned threads,
+                      const std::function<bool()>& stop,
+                      const std::function<void(std::size_t)>& progress,
+                      std::vector<FixResult>* results) {
+    const auto start = std::chrono::steady_clock::now();
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threads, files.size())));
+
+    std::vector<FixResult> local;
+    std::vector<FixResult>& res = results ? *results : local;
+    res.assign(files.size(), FixResult());
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> done{0};
+    std::atomic<bool> stopped{false};
+    auto worker = [&](Fixer& fixer, bool caller) {
+        for (;;) {
+            if (caller && stop && stop()) stopped.store(true);
+            if (stopped.load()) return;
+            std::size_t i = next.fetch_add(1);
+            if (i >= files.size()) return;
+            fixer.fixFile(files[i], res[i]);
+            std::size_t d = done.fetch_add(1) + 1;
+            if (caller && progress) progress(d);
+        }
+    };
+
+    // Each helper gets its own Fixer: the line buffers and comment state are per file
+    std::vector<Fixer> helpers(threads - 1, *this);
+    std::vector<std::thread> pool;
+    pool.reserve(helpers.size());
+    for (auto& h : helpers) pool.emplace_back(worker, std::ref(h), false);
+    worker(*this, true);
+    for (auto& t : pool) t.join();
+
+    FixSummary sum;
+    sum.files = done.load();
+    for (const auto& r : res) {
+        if (!r.error.empty()) ++sum.failed;
+        if (!r.rewritten) continue;
+        ++sum.rewritten;
+        sum.fixes += r.trailingSpace + r.crlf + r.tabs + (r.finalNewline ? 1 : 0);
+        sum.bytesIn += r.bytesIn;
+        sum.bytesOut += r.bytesOut;
+    }
+    sum.ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return sum;
+}
+
+} // namespace norm
@@ -0,0 +1,76 @@
+#pragma once
+#include "norm.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace norm {
+
+// What happened to one file in a --fix run
+struct FixResult {
+    bool rewritten = false;
+    std::uint32_t trailingSpace = 0;   // lines stripped
+    std::uint32_t crlf = 0;            // lines converted to LF
+    std::uint32_t tabs = 0;            // lines with tabs expanded
+    bool finalNewline = false;         // '\n' appended
+    std::uint64_t bytesIn = 0;
+    std::uint64_t bytesOut = 0;        // 0 unless rewritten
+    std::string error;                 // set when the file could not be read or replaced
+};
+
+struct FixSummary {
+    std::size_t files = 0;
+    std::size_t rewritten = 0;
+    std::size_t failed = 0;
+    std::uint64_t fixes = 0;           // fixed lines plus appended newlines
+    std::uint64_t bytesIn = 0;         // of the rewritten files
+    std::uint64_t bytesOut = 0;
+    std::uint64_t ns = 0;
+};
+
+// Applies the mechanical fixes for the trailing-space, crlf, final-newline
+// and tabs rules, each only when the Config enables that rule. A file is
+// mapped and scanned once; nothing is allocated or written until the first
+// line that needs a change, so clean files are never touched. A changed file
+// is written to a temp file next to it and renamed over the original.
+//
+// Tabs are expanded to the next multiple of Config::indentWidth, except
+// inside string and character literals where they become "\t".
+class Fixer {
+public:
+    explicit Fixer(const Config& cfg = Config());
+
+    // Returns true when the file was rewritten
+    bool fixFile(const std::string& path, FixResult& result);
+
+    // Fixes files on `threads` threads (0: one per CPU), the calling thread
+    // included. stop is polled between files; progress(done) is called from
+    // the calling thread only. results[i] belongs to files[i].
+    FixSummary run(const std::vector<std::string>& files, unsigned threads = 0,
+                   const std::function<bool()>& stop = nullptr,
+                   const std::function<void(std::size_t)>& progress = nullptr,
+                   std::vector<FixResult>* results = nullptr);
+
+private:
+    // Puts the fixed form of one line (without its '\n') in _line; false when
+    // the line is already clean
+    bool fixLine(std::string_view line, bool tabs, FixResult& result);
+    // Tab expansion of one line's text, tracking comments and literals
+    // across lines; with out == nullptr only the tracking is done
+    void expandTabs(std::string_view text, std::string* out);
+    bool replace(const std::string& path, const std::string& content, std::string& error);
+
+    bool _trailing;
+    bool _crlf;
+    bool _tabs;
+    bool _finalNewline;
+    std::size_t _tabWidth;
+    bool _inComment = false;   // inside a block comment at the start of the next line
+    std::string _out;          // reused per file, only filled once a line changes
+    std::string _line;         // reused per changed line
+};
+
+} // namespace norm
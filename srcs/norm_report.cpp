@@ -0,0 +1,392 @@
+#include "norm_report.hpp"
+#include "log.hpp"
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+namespace norm {
+
+static const std::size_t kRuleCount = static_cast<std::size_t>(Rule::Count);
+
+const char* severityName(Severity s) noexcept {
+    switch (s) {
+        case Severity::Error:   return "error";
+        case Severity::Warning: return "warning";
+        case Severity::Info:    return "info";
+    }
+    return "info";
+}
+
+bool parseReportFormat(const std::string& name, ReportFormat& out) {
+    if (name == "console") out = ReportFormat::Console;
+    else if (name == "grouped") out = ReportFormat::Grouped;
+    else if (name == "json") out = ReportFormat::Json;
+    else if (name == "sarif") out = ReportFormat::Sarif;
+    else if (name == "junit") out = ReportFormat::JUnit;
+    else return false;
+    return true;
+}
+
+ReportWriter::ReportWriter(std::ostream& out)
+: _out(&out), _color(&out == &std::cout && isatty(STDOUT_FILENO)) {}
+
+ReportWriter::ReportWriter(int fd)
+: _fd(fd), _color(isatty(fd)) {}
+
+ReportWriter::~ReportWriter() {}
+
+void ReportWriter::begin() {
+    writeBegin();
+    if (_buf.size() >= kFlushBytes) flush();
+}
+
+void ReportWriter::fileDone(const Report& report, std::uint32_t file, std::size_t first, std::size_t last) {
+    const Issue* issues = report.issues().data();
+    for (std::size_t i = first; i < last; ++i) ++_counts[static_cast<std::size_t>(issues[i].severity)];
+    writeFile(report, file, issues + first, issues + last);
+    if (_buf.size() >= kFlushBytes) flush();
+}
+
+void ReportWriter::end(const Report& report) {
+    writeEnd(report);
+    flush();
+}
+
+void ReportWriter::flush() {
+    if (_buf.empty()) return;
+    if (_out) {
+        _out->write(_buf.data(), static_cast<std::streamsize>(_buf.size()));
+        _out->flush();
+    } else {
+        const char* p = _buf.data();
+        std::size_t left = _buf.size();
+        while (left > 0) {
+            ssize_t n = ::write(_fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ESH_LOG_ERROR() << "Report write failed: " << std::strerror(errno);
+                break;
+            }
+            p += n;
+            left -= static_cast<std::size_t>(n);
+        }
+    }
+    _written += _buf.size();
+    _buf.clear();   // keeps the capacity for the next chunk
+}
+
+void ReportWriter::putNumber(std::uint64_t v) {
+    char tmp[24];
+    auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    _buf.append(tmp, static_cast<std::size_t>(res.ptr - tmp));
+}
+
+void ReportWriter::putJsonString(const std::string& s) {
+    _buf += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"':  _buf += "\\\""; break;
+            case '\\': _buf += "\\\\"; break;
+            case '\n': _buf += "\\n"; break;
+            case '\r': _buf += "\\r"; break;
+            case '\t': _buf += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    static const char hex[] = "0123456789abcdef";
+                    _buf += "\\u00";
+                    _buf += hex[(c >> 4) & 0xF];
+                    _buf += hex[c & 0xF];
+                } else {
+                    _buf += c;
+                }
+        }
+    }
+    _buf += '"';
+}
+
+void ReportWriter::putXml(const std::string& s) {
+    for (char c : s) {
+        switch (c) {
+            case '<':  _buf += "&lt;"; break;
+            case '>':  _buf += "&gt;"; break;
+            case '&':  _buf += "&amp;"; break;
+            case '"':  _buf += "&quot;"; break;
+            case '\'': _buf += "&apos;"; break;
+            default:   _buf += c;
+        }
+    }
+}
+
+void ReportWriter::putMessage(const Report& report, const Issue& issue) {
+    _msg.clear();
+    report.appendMessage(_msg, issue);
+}
+
+namespace {
+
+// The historical one-line-per-issue text
+class ConsoleWriter : public ReportWriter {
+public:
+    using ReportWriter::ReportWriter;
+
+protected:
+    void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) override {
+        for (const Issue* is = first; is != last; ++is) {
+            put(is->severity == Severity::Error ? "ERROR " : (is->severity == Severity::Warning ? "WARN  " : "INFO  "));
+            put(report.file(file));
+            if (is->line) {
+                put(':');
+                putNumber(is->line);
+            }
+            put(" [");
+            put(ruleInfo(is->rule).name);
+            put("] ");
+            putMessage(report, *is);
+            put(_msg);
+            put('\n');
+        }
+    }
+
+    void writeEnd(const Report&) override {
+        put("Summary: ");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Error)]);
+        put(" error(s), ");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Warning)]);
+        put(" warning(s), ");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Info)]);
+        put(" info.\n");
+    }
+};
+
+// One block per file, one row per rule with its count and first lines
+class GroupedWriter : public ConsoleWriter {
+public:
+    using ConsoleWriter::ConsoleWriter;
+
+protected:
+    static const std::size_t kMaxLines = 8;
+
+    void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) override {
+        if (first == last) return;
+        std::size_t perRule[kRuleCount] = {};
+        for (const Issue* is = first; is != last; ++is) ++perRule[static_cast<std::size_t>(is->rule)];
+
+        putStyle("\033[1m");
+        put(report.file(file));
+        putStyle("\033[0m");
+        put("  ");
+        putNumber(static_cast<std::uint64_t>(last - first));
+        put(" issue(s)\n");
+        for (std::size_t r = 0; r < kRuleCount; ++r) {
+            if (!perRule[r]) continue;
+            _totals[r] += perRule[r];
+            const RuleInfo& info = ruleInfo(static_cast<Rule>(r));
+            put("  ");
+            putStyle(info.severity == Severity::Error ? "\033[1;31m" : "\033[1;33m");
+            padded(info.name, 18);
+            putStyle("\033[0m");
+            put(" x");
+            putNumber(perRule[r]);
+            std::size_t shown = 0;
+            for (const Issue* is = first; is != last && shown <= kMaxLines; ++is) {
+                if (static_cast<std::size_t>(is->rule) != r || !is->line) continue;
+                put(shown == 0 ? "  line " : ", ");
+                if (shown++ == kMaxLines) {
+                    put("...");
+                    break;
+                }
+                putNumber(is->line);
+            }
+            put('\n');
+        }
+    }
+
+    void writeEnd(const Report& report) override {
+        bool any = false;
+        for (std::size_t r = 0; r < kRuleCount; ++r) {
+            if (!_totals[r]) continue;
+            put(any ? ", " : "By rule: ");
+            any = true;
+            put(ruleInfo(static_cast<Rule>(r)).name);
+            put(' ');
+            putNumber(_totals[r]);
+        }
+        if (any) put('\n');
+        ConsoleWriter::writeEnd(report);
+    }
+
+private:
+    void padded(const char* s, std::size_t width) {
+        std::size_t n = std::strlen(s);
+        _buf.append(s, n);
+        if (n < width) _buf.append(width - n, ' ');
+    }
+
+    std::size_t _totals[kRuleCount] = {};
+};
+
+class JsonWriter : public ReportWriter {
+public:
+    using ReportWriter::ReportWriter;
+
+protected:
+    void writeBegin() override { put("{\"issues\":["); }
+
+    void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) override {
+        for (const Issue* is = first; is != last; ++is) {
+            put(_first ? "\n" : ",\n");
+            _first = false;
+            put("{\"file\":");
+            putJsonString(report.file(file));
+            put(",\"line\":");
+            putNumber(is->line);
+            put(",\"rule\":\"");
+            put(ruleInfo(is->rule).name);
+            put("\",\"severity\":\"");
+            put(severityName(is->severity));
+            put("\",\"message\":");
+            putMessage(report, *is);
+            putJsonString(_msg);
+            put('}');
+        }
+    }
+
+    void writeEnd(const Report&) override {
+        put("\n],\"summary\":{\"errors\":");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Error)]);
+        put(",\"warnings\":");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Warning)]);
+        put(",\"info\":");
+        putNumber(_counts[static_cast<std::size_t>(Severity::Info)]);
+        put("}}\n");
+    }
+
+private:
+    bool _first = true;
+};
+
+// SARIF 2.1.0: the rule table goes in the driver, results stream after it
+class SarifWriter : public ReportWriter {
+public:
+    using ReportWriter::ReportWriter;
+
+protected:
+    void writeBegin() override {
+        put("{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\",\"runs\":[{"
+            "\"tool\":{\"driver\":{\"name\":\"exam-shell-norm\",\"rules\":[");
+        for (std::size_t r = 0; r < kRuleCount; ++r) {
+            const RuleInfo& info = ruleInfo(static_cast<Rule>(r));
+            if (r) put(',');
+            put("{\"id\":\"");
+            put(info.name);
+            put("\",\"defaultConfiguration\":{\"level\":\"");
+            put(level(info.severity));
+            put("\"}}");
+        }
+        put("]}},\"results\":[");
+    }
+
+    void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) override {
+        for (const Issue* is = first; is != last; ++is) {
+            put(_first ? "\n" : ",\n");
+            _first = false;
+            put("{\"ruleId\":\"");
+            put(ruleInfo(is->rule).name);
+            put("\",\"ruleIndex\":");
+            putNumber(static_cast<std::uint64_t>(is->rule));
+            put(",\"level\":\"");
+            put(level(is->severity));
+            put("\",\"message\":{\"text\":");
+            putMessage(report, *is);
+            putJsonString(_msg);
+            put("},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":");
+            putJsonString(uri(report.file(file)));
+            put('}');
+            if (is->line) {
+                put(",\"region\":{\"startLine\":");
+                putNumber(is->line);
+                put('}');
+            }
+            put("}}]}");
+        }
+    }
+
+    void writeEnd(const Report&) override { put("\n]}]}\n"); }
+
+private:
+    static const char* level(Severity s) noexcept {
+        return s == Severity::Error ? "error" : (s == Severity::Warning ? "warning" : "note");
+    }
+    // Relative URIs without the "./" that list_files_recursive leaves in
+    static std::string uri(const std::string& path) {
+        return path.compare(0, 2, "./") == 0 ? path.substr(2) : path;
+    }
+
+    bool _first = true;
+};
+
+// One testcase per file; a file with issues fails with all of them in the body
+class JUnitWriter : public ReportWriter {
+public:
+    using ReportWriter::ReportWriter;
+
+protected:
+    void writeBegin() override {
+        put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n<testsuite name=\"norm\">\n");
+    }
+
+    void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) override {
+        const std::string& path = report.file(file);
+        put("  <testcase classname=\"norm\" name=\"");
+        putXml(path);
+        if (first == last) {
+            put("\"/>\n");
+            return;
+        }
+        put("\">\n    <failure message=\"");
+        putNumber(static_cast<std::uint64_t>(last - first));
+        put(" norm issue(s)\" type=\"norm\">");
+        for (const Issue* is = first; is != last; ++is) {
+            putXml(path);
+            if (is->line) {
+                put(':');
+                putNumber(is->line);
+            }
+            put(" [");
+            put(ruleInfo(is->rule).name);
+            put("] ");
+            putMessage(report, *is);
+            putXml(_msg);
+            put('\n');
+        }
+        put("</failure>\n  </testcase>\n");
+    }
+
+    void writeEnd(const Report&) override { put("</testsuite>\n</testsuites>\n"); }
+};
+
+template <typename Sink>
+std::unique_ptr<ReportWriter> make_writer(ReportFormat format, Sink&& sink) {
+    switch (format) {
+        case ReportFormat::Grouped: return std::unique_ptr<ReportWriter>(new GroupedWriter(sink));
+        case ReportFormat::Json:    return std::unique_ptr<ReportWriter>(new JsonWriter(sink));
+        case ReportFormat::Sarif:   return std::unique_ptr<ReportWriter>(new SarifWriter(sink));
+        case ReportFormat::JUnit:   return std::unique_ptr<ReportWriter>(new JUnitWriter(sink));
+        case ReportFormat::Console: break;
+    }
+    return std::unique_ptr<ReportWriter>(new ConsoleWriter(sink));
+}
+
+} // namespace
+
+std::unique_ptr<ReportWriter> ReportWriter::create(ReportFormat format, std::ostream& out) {
+    return make_writer(format, out);
+}
+
+std::unique_ptr<ReportWriter> ReportWriter::create(ReportFormat format, int fd) {
+    return make_writer(format, fd);
+}
+
+} // namespace norm
@@ -0,0 +1,72 @@
+#pragma once
+#include "norm.hpp"
+#include <string>
+#include <memory>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+namespace norm {
+
+enum class ReportFormat { Console, Grouped, Json, Sarif, JUnit };
+
+// false for unknown names; names: console, grouped, json, sarif, junit
+bool parseReportFormat(const std::string& name, ReportFormat& out);
+
+// Streams a report while it is being produced: begin(), then fileDone() once
+// per checked file with that file's issues, then end(). Output is built in
+// one reused buffer that is written out when it passes kFlushBytes and at
+// end(), so a whole report usually leaves in a single write.
+class ReportWriter {
+public:
+    static const std::size_t kFlushBytes = 64 * 1024;
+
+    explicit ReportWriter(std::ostream& out);
+    explicit ReportWriter(int fd);
+    virtual ~ReportWriter();
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    void begin();
+    // Issues [first, last) of report all belong to file (may be empty)
+    void fileDone(const Report& report, std::uint32_t file, std::size_t first, std::size_t last);
+    void end(const Report& report);
+
+    // Total bytes handed to the sink so far
+    std::uint64_t bytesWritten() const noexcept { return _written; }
+
+    static std::unique_ptr<ReportWriter> create(ReportFormat format, std::ostream& out);
+    static std::unique_ptr<ReportWriter> create(ReportFormat format, int fd);
+
+protected:
+    virtual void writeBegin() {}
+    virtual void writeFile(const Report& report, std::uint32_t file, const Issue* first, const Issue* last) = 0;
+    virtual void writeEnd(const Report& report) = 0;
+
+    // Helpers for the formats, all appending to _buf
+    void put(const char* s) { _buf += s; }
+    void put(const std::string& s) { _buf += s; }
+    void put(char c) { _buf += c; }
+    void putNumber(std::uint64_t v);
+    void putJsonString(const std::string& s);
+    void putXml(const std::string& s);
+    void putMessage(const Report& report, const Issue& issue);
+    // ANSI escape, only when the sink is a terminal
+    void putStyle(const char* escape) { if (_color) _buf += escape; }
+
+    std::string _buf;
+    std::string _msg;   // scratch for lazily formatted messages
+    std::size_t _counts[3] = {0, 0, 0};   // by Severity, over everything written
+
+private:
+    void flush();
+
+    std::ostream* _out = nullptr;
+    int _fd = -1;
+    std::uint64_t _written = 0;
+    bool _color = false;   // std::cout or an fd on a tty
+};
+
+const char* severityName(Severity s) noexcept;
+
+} // namespace norm
@@ -0,0 +1,244 @@
+#include "norm.hpp"
+
+// Built-in norm rules. Each one subscribes to the scan events it needs and
+// only reads the facts the engine already computed for the line or token.
+
+namespace norm {
+
+namespace {
+
+class HeaderPrefixRule : public RuleCheck {
+public:
+    void beginFile(const FileContext& f) override {
+        const std::string& prefix = f.cfg.headerPrefix;
+        if (prefix.empty()) return;
+        if (f.data.compare(0, prefix.size(), prefix) != 0) f.emit(1, Rule::HeaderMissing);
+    }
+};
+
+class FinalNewlineRule : public RuleCheck {
+public:
+    void endFile(const FileContext& f) override {
+        if (!f.cfg.requireFinalNewline) return;
+        if (f.data.empty() || f.data.back() != '\n') f.emit(0, Rule::FinalNewline);
+    }
+};
+
+class CrlfRule : public RuleCheck {
+public:
+    void onLine(const FileContext& f, const LineView& l) override {
+        if (l.crlf) f.emit(l.number, Rule::Crlf);
+    }
+};
+
+class TabsRule : public RuleCheck {
+public:
+    void onLine(const FileContext& f, const LineView& l) override {
+        if (l.hasTab && !f.cfg.allowTabs) f.emit(l.number, Rule::Tabs);
+    }
+};
+
+class TrailingSpaceRule : public RuleCheck {
+public:
+    void onLine(const FileContext& f, const LineView& l) override {
+        if (l.trailingBlank) f.emit(l.number, Rule::TrailingSpace);
+    }
+};
+
+class LineLengthRule : public RuleCheck {
+public:
+    void onLine(const FileContext& f, const LineView& l) override {
+        // The '\r' of a CRLF line counts, as it always did
+        if (l.text.size() > f.cfg.maxLineLength) {
+            f.emit(l.number, Rule::LineLength, static_cast<std::uint32_t>(f.cfg.maxLineLength));
+        }
+    }
+};
+
+// Finds function bodies in the token stream: a '{' at file scope right after
+// a parameter list ("name(...) {", trailing const/noexcept/override allowed),
+// outside type definitions and initializers. Namespace and extern "C" blocks
+// are transparent so the functions inside them are still at file scope.
+class FunctionTracker {
+public:
+    // Returns true when t closes a function body; start()/lines() describe it
+    bool feed(const FileContext& f, const esh::Token& t) {
+        using Kind = esh::Token::Kind;
+        if (t.kind == Kind::Preprocessor) return false;
+        if (t.kind == Kind::Punct && t.length == 1) {
+            const char c = f.data[t.offset];
+            if (c == '{') {
+                Block b = Block::Other;
+                if (_depth == 0) {
+                    if (_transparentHead) b = Block::Transparent;
+                    else if (_paren && _afterClose && !_typeHead && !_assign) b = Block::Function;
+                    if (b == Block::Function) _start = t.line;
+                }
+                _open.push_back(b);
+                if (b != Block::Transparent) ++_depth;
+                resetHead();
+                return false;
+            }
+            if (c == '}') {
+                if (_open.empty()) return false;
+                Block b = _open.back();
+                _open.pop_back();
+                if (b != Block::Transparent) --_depth;
+                resetHead();
+                if (b != Block::Function) return false;
+                _lines = t.line > _start + 1 ? t.line - _start - 1 : 0;
+                return true;
+            }
+            if (_depth == 0) {
+                if (c == ';') resetHead();
+                else if (c == '(') _paren = true;
+                else if (c == '=') _assign = true;
+                _afterClose = c == ')';
+            }
+            return false;
+        }
+        if (_depth == 0) {
+            std::string_view w = f.text(t);
+            if (t.kind == Kind::Keyword && (w == "struct" || w == "enum" || w == "union" || w == "class")) {
+                _typeHead = true;
+            } else if (t.kind == Kind::Keyword && (w == "namespace" || w == "extern")) {
+                _transparentHead = true;
+            }
+            // Qualifiers between ')' and '{' keep the head a function head
+            if (!(w == "const" || w == "noexcept" || w == "override" || w == "final" || w == "volatile")) {
+                _afterClose = false;
+            }
+        }
+        return false;
+    }
+
+    void reset() {
+        _open.clear();
+        _depth = 0;
+        resetHead();
+    }
+
+    std::uint32_t start() const noexcept { return _start; }
+    std::uint32_t lines() const noexcept { return _lines; }
+
+private:
+    enum class Block : std::uint8_t { Other, Function, Transparent };
+
+    void resetHead() {
+        _paren = _afterClose = _typeHead = _assign = _transparentHead = false;
+    }
+
+    std::vector<Block> _open;   // capacity is reused across files
+    int _depth = 0;             // non-transparent blocks open
+    bool _paren = false;
+    bool _afterClose = false;
+    bool _typeHead = false;
+    bool _assign = false;
+    bool _transparentHead = false;
+    std::uint32_t _start = 0;
+    std::uint32_t _lines = 0;
+};
+
+class FunctionLengthRule : public RuleCheck {
+public:
+    void beginFile(const FileContext&) override { _tracker.reset(); }
+    void onToken(const FileContext& f, const esh::Token& t) override {
+        if (_tracker.feed(f, t) && _tracker.lines() > f.cfg.maxFunctionLines) {
+            f.emit(_tracker.start(), Rule::FunctionLength, _tracker.lines());
+        }
+    }
+
+private:
+    FunctionTracker _tracker;
+};
+
+class FunctionCountRule : public RuleCheck {
+public:
+    void beginFile(const FileContext&) override {
+        _tracker.reset();
+        _count = 0;
+    }
+    void onToken(const FileContext& f, const esh::Token& t) override {
+        if (_tracker.feed(f, t)) ++_count;
+    }
+    void endFile(const FileContext& f) override {
+        if (_count > f.cfg.maxFunctions) f.emit(0, Rule::FunctionCount, _count);
+    }
+
+private:
+    FunctionTracker _tracker;
+    std::uint32_t _count = 0;
+};
+
+class ForbiddenKeywordRule : public RuleCheck {
+public:
+    void onToken(const FileContext& f, const esh::Token& t) override {
+        if (t.kind != esh::Token::Kind::Keyword && t.kind != esh::Token::Kind::Identifier) return;
+        std::string_view word = f.text(t);
+        for (const auto& kw : f.cfg.forbiddenKeywords) {
+            if (word == kw) {
+                f.emit(t.line, Rule::ForbiddenKeyword, t.column);
+                return;
+            }
+        }
+    }
+};
+
+class IndentationRule : public RuleCheck {
+public:
+    void onLine(const FileContext& f, const LineView& l) override {
+        // Blank lines, comment-only lines and tab indentation (the tabs rule) are skipped
+        if (l.indent == 0 || l.code.find_first_not_of(" \t") == std::string_view::npos) return;
+        if (l.text.substr(0, l.indent).find('\t') != std::string_view::npos) return;
+        if (l.indent % f.cfg.indentWidth != 0) {
+            f.emit(l.number, Rule::Indentation, static_cast<std::uint32_t>(f.cfg.indentWidth));
+        }
+    }
+};
+
+// The 42 header: 11 lines of exactly 80 columns, each a /* ... */ comment
+class HeaderFormatRule : public RuleCheck {
+public:
+    void beginFile(const FileContext&) override { _seen = 0; _reported = false; }
+    void onLine(const FileContext& f, const LineView& l) override {
+        if (l.number > kLines || _reported) return;
+        ++_seen;
+        std::string_view t = l.text.substr(0, l.length);
+        bool ok = t.size() == 80 && t.compare(0, 2, "/*") == 0 && t.compare(78, 2, "*/") == 0;
+        if (!ok) {
+            f.emit(l.number, Rule::HeaderFormat);
+            _reported = true;
+        }
+    }
+    void endFile(const FileContext& f) override {
+        if (!_reported && _seen < kLines) f.emit(_seen + 1, Rule::HeaderFormat);
+    }
+
+private:
+    static const std::uint32_t kLines = 11;
+    std::uint32_t _seen = 0;
+    bool _reported = false;
+};
+
+template <typename T>
+std::unique_ptr<RuleCheck> make_rule(const Config&) {
+    return std::unique_ptr<RuleCheck>(new T());
+}
+
+} // namespace
+
+void registerBuiltinRules(std::vector<RuleRegistration>& out) {
+    out.push_back({Rule::HeaderMissing,    OnFile,           true,  &make_rule<HeaderPrefixRule>});
+    out.push_back({Rule::FinalNewline,     OnFile,           true,  &make_rule<FinalNewlineRule>});
+    out.push_back({Rule::Crlf,             OnLine,           true,  &make_rule<CrlfRule>});
+    out.push_back({Rule::Tabs,             OnLine,           true,  &make_rule<TabsRule>});
+    out.push_back({Rule::TrailingSpace,    OnLine,           true,  &make_rule<TrailingSpaceRule>});
+    out.push_back({Rule::LineLength,       OnLine,           true,  &make_rule<LineLengthRule>});
+    out.push_back({Rule::FunctionLength,   OnFile | OnToken, false, &make_rule<FunctionLengthRule>});
+    out.push_back({Rule::FunctionCount,    OnFile | OnToken, false, &make_rule<FunctionCountRule>});
+    out.push_back({Rule::ForbiddenKeyword, OnToken,          false, &make_rule<ForbiddenKeywordRule>});
+    out.push_back({Rule::Indentation,      OnLine,           false, &make_rule<IndentationRule>});
+    out.push_back({Rule::HeaderFormat,     OnFile | OnLine,  false, &make_rule<HeaderFormatRule>});
+}
+
+} // namespace norm
@@ -0,0 +1,288 @@
+#include "projects.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <climits>
+#include <unistd.h>
+
+namespace esh {
+
+static std::string_view trim_view(std::string_view s) {
+    std::size_t i = 0, j = s.size();
+    while (i < j && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r')) ++i;
+    while (j > i && (s[j - 1] == ' ' || s[j - 1] == '\t' || s[j - 1] == '\r')) --j;
+    return s.substr(i, j - i);
+}
+
+static std::vector<std::string> split_list(std::string_view value) {
+    std::vector<std::string> out;
+    std::size_t pos = 0;
+    while (pos <= value.size()) {
+        std::size_t comma = value.find(',', pos);
+        if (comma == std::string_view::npos) comma = value.size();
+        std::string_view item = trim_view(value.substr(pos, comma - pos));
+        if (!item.empty()) out.emplace_back(item);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+static bool parse_number(std::string_view value, unsigned long& out) {
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string_view::npos) return false;
+    out = std::strtoul(std::string(value).c_str(), nullptr, 10);
+    return true;
+}
+
+// \n, \t, \\ and \" in the expected output
+static std::string unescape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\' || i + 1 == s.size()) {
+            out += s[i];
+            continue;
+        }
+        char c = s[++i];
+        out += c == 'n' ? '\n' : (c == 't' ? '\t' : c);
+    }
+    return out;
+}
+
+// "a "b c" => out" -> args {a, b c}, expected "out"
+static bool parse_test(std::string_view value, TestCase& test, std::string& why) {
+    std::size_t arrow = value.find("=>");
+    if (arrow == std::string_view::npos) {
+        why = "expected 'test = args => output'";
+        return false;
+    }
+    std::string_view args = value.substr(0, arrow);
+    for (std::size_t i = 0; i < args.size();) {
+        if (args[i] == ' ' || args[i] == '\t') {
+            ++i;
+            continue;
+        }
+        std::string arg;
+        if (args[i] == '"') {
+            std::size_t close = args.find('"', i + 1);
+            if (close == std::string_view::npos) {
+                why = "unterminated quote in test arguments";
+                return false;
+            }
+            arg = unescape(args.substr(i + 1, close - i - 1));
+            i = close + 1;
+        } else {
+            std::size_t end = args.find_first_of(" \t", i);
+            if (end == std::string_view::npos) end = args.size();
+            arg = unescape(args.substr(i, end - i));
+            i = end;
+        }
+        test.args.push_back(std::move(arg));
+    }
+    std::string_view expected = trim_view(value.substr(arrow + 2));
+    if (expected.size() >= 2 && expected.front() == '"' && expected.back() == '"') {
+        expected = expected.substr(1, expected.size() - 2);
+    }
+    test.expected = unescape(expected);
+    return true;
+}
+
+// Calls fn(key, value, why) for every "key = value" line of a section body;
+// stops with error set at the first line that is not a setting or that fn
+// rejects
+template <typename Fn>
+static bool parse_settings(const std::string& path, std::string_view body, std::uint32_t line, Fn&& fn,
+                           std::string* error) {
+    std::string why;
+    for (std::size_t pos = 0; pos < body.size();) {
+        ++line;
+        std::size_t nl = body.find('\n', pos);
+        if (nl == std::string_view::npos) nl = body.size();
+        std::string_view raw = trim_view(body.substr(pos, nl - pos));
+        pos = nl + 1;
+        if (raw.empty() || raw[0] == '#') continue;
+        std::size_t eq = raw.find('=');
+        if (eq == std::string_view::npos) why = "expected key = value";
+        else if (fn(trim_view(raw.substr(0, eq)), trim_view(raw.substr(eq + 1)), why)) continue;
+        if (error) *error = path + ":" + std::to_string(line) + ": " + why;
+        return false;
+    }
+    return true;
+}
+
+bool Exercise::normConfig(norm::Config& cfg, std::string* error) const {
+    for (const auto& kv : norm) {
+        if (!cfg.set(kv.first, kv.second, error)) return false;
+    }
+    return true;
+}
+
+std::string ProjectRegistry::defaultPath() {
+    if (const char* env = std::getenv("ESH_PROJECTS")) return env;
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return "data/projects.esh";
+    std::string dir(exe, static_cast<std::size_t>(n));
+    dir.erase(dir.rfind('/') + 1);
+    return dir + "data/projects.esh";
+}
+
+bool ProjectRegistry::open(const std::string& path, std::string* error) {
+    std::lock_guard<std::mutex> lock(_mx);
+    _entries.clear();
+    _groups.clear();
+    _path = path;
+    if (!_file.open(path)) {
+        if (error) *error = "cannot read " + path;
+        return false;
+    }
+
+    // One pass over the buffer for the headers; bodies stay unparsed views
+    const std::string_view data = _file.view();
+    std::string_view name;
+    std::size_t bodyStart = 0;
+    std::uint32_t header = 0;
+    std::uint32_t lineNo = 0;
+    auto closeSection = [&](std::size_t end) {
+        std::string_view body = data.substr(bodyStart, end - bodyStart);
+        if (name.find('/') == std::string_view::npos) return parseGroup(name, body, header, error);
+        _entries.push_back(Entry{name, body, header, nullptr, false});
+        return true;
+    };
+    auto fail = [&](const char* why) {
+        if (why && error) *error = path + ":" + std::to_string(lineNo) + ": " + why;
+        _entries.clear();
+        _groups.clear();
+        return false;
+    };
+    for (std::size_t pos = 0; pos < data.size();) {
+        ++lineNo;
+        std::size_t nl = data.find('\n', pos);
+        if (nl == std::string_view::npos) nl = data.size();
+        if (data[pos] == '[') {
+            if (!name.empty() && !closeSection(pos)) return fail(nullptr);   // error set by the parser
+            std::size_t rb = data.find(']', pos);
+            if (rb == std::string_view::npos || rb > nl) return fail("unterminated section header");
+            name = trim_view(data.substr(pos + 1, rb - pos - 1));
+            if (name.empty()) return fail("empty section name");
+            bodyStart = std::min(nl + 1, data.size());
+            header = lineNo;
+        } else if (name.empty()) {
+            std::string_view raw = trim_view(data.substr(pos, nl - pos));
+            if (!raw.empty() && raw[0] != '#') return fail("setting outside of a section");
+        }
+        pos = nl + 1;
+    }
+    if (!name.empty() && !closeSection(data.size())) return fail(nullptr);
+
+    std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) { return a.id < b.id; });
+    for (std::size_t i = 0; i < _entries.size(); ++i) {
+        lineNo = _entries[i].line;
+        if (i > 0 && _entries[i].id == _entries[i - 1].id) return fail("duplicate exercise");
+        if (!group(_entries[i].id.substr(0, _entries[i].id.find('/')))) return fail("exercise in an undefined group");
+    }
+    ESH_LOG_INFO() << "Project registry " << path << ": " << _groups.size() << " group(s), "
+                   << _entries.size() << " exercise(s)";
+    return true;
+}
+
+bool ProjectRegistry::parseGroup(std::string_view name, std::string_view body, std::uint32_t line,
+                                 std::string* error) {
+    ExerciseGroup g;
+    g.name = std::string(name);
+    g.title = g.name;
+    g.kind = "student";
+    bool ok = parse_settings(_path, body, line, [&g](std::string_view key, std::string_view value, std::string& why) {
+        unsigned long n = 0;
+        if (key == "title") g.title = std::string(value);
+        else if (key == "kind") g.kind = std::string(value);
+        else if (key == "time" && parse_number(value, n)) g.timeLimit = std::chrono::minutes(n);
+        else {
+            why = key == "time" ? "bad value for 'time'" : "unknown group key '" + std::string(key) + "'";
+            return false;
+        }
+        return true;
+    }, error);
+    if (!ok) return false;
+    _groups.push_back(std::move(g));
+    return true;
+}
+
+std::unique_ptr<Exercise> ProjectRegistry::parseExercise(const Entry& entry, std::string* error) const {
+    std::unique_ptr<Exercise> ex(new Exercise());
+    ex->id = std::string(entry.id);
+    ex->name = ex->id.substr(ex->id.rfind('/') + 1);
+    norm::Config probe;   // norm keys are checked here rather than at grading time
+    bool ok = parse_settings(_path, entry.body, entry.line,
+                             [&ex, &probe](std::string_view key, std::string_view value, std::string& why) {
+        unsigned long n = 0;
+        if (key == "level") {
+            if (!parse_number(value, n)) why = "bad value for 'level'";
+            ex->level = static_cast<unsigned>(n);
+        } else if (key == "sources") {
+            ex->sources = split_list(value);
+        } else if (key == "allowed") {
+            ex->allowed = split_list(value);
+        } else if (key == "build") {
+            ex->build = std::string(value);
+        } else if (key == "program") {
+            ex->program = std::string(value);
+        } else if (key == "timeout") {
+            if (!parse_number(value, n)) why = "bad value for 'timeout'";
+            ex->timeout = std::chrono::seconds(n);
+        } else if (key == "test") {
+            ex->tests.emplace_back();
+            parse_test(value, ex->tests.back(), why);
+        } else if (key.compare(0, 5, "norm.") == 0) {
+            std::string normKey(key.substr(5));
+            if (probe.set(normKey, std::string(value), &why)) ex->norm.emplace_back(normKey, std::string(value));
+        } else {
+            why = "unknown exercise key '" + std::string(key) + "'";
+        }
+        return why.empty();
+    }, error);
+    if (!ok) return nullptr;
+    if (ex->program.empty()) ex->program = "./" + ex->name;
+    return ex;
+}
+
+std::vector<const ExerciseGroup*> ProjectRegistry::groups(std::string_view kind) const {
+    std::vector<const ExerciseGroup*> out;
+    for (const auto& g : _groups) {
+        if (g.kind == kind) out.push_back(&g);
+    }
+    return out;
+}
+
+const ExerciseGroup* ProjectRegistry::group(std::string_view name) const {
+    for (const auto& g : _groups) {
+        if (g.name == name) return &g;
+    }
+    return nullptr;
+}
+
+std::vector<std::string_view> ProjectRegistry::exercises(std::string_view group) const {
+    std::string prefix = std::string(group) + "/";
+    std::vector<std::string_view> out;
+    auto it = std::lower_bound(_entries.begin(), _entries.end(), prefix,
+                               [](const Entry& e, const std::string& p) { return e.id < p; });
+    for (; it != _entries.end() && it->id.compare(0, prefix.size(), prefix) == 0; ++it) out.push_back(it->id);
+    return out;
+}
+
+const Exercise* ProjectRegistry::find(std::string_view id) const {
+    std::lock_guard<std::mutex> lock(_mx);
+    auto it = std::lower_bound(_entries.begin(), _entries.end(), id,
+                               [](const Entry& e, std::string_view key) { return e.id < key; });
+    if (it == _entries.end() || it->id != id) return nullptr;
+    if (!it->parsed && !it->failed) {
+        std::string error;
+        it->parsed = parseExercise(*it, &error);
+        if (!it->parsed) {
+            it->failed = true;
+            ESH_LOG_WARN() << "Project registry: " << error;
+        }
+    }
+    return it->parsed.get();
+}
+
+} // namespace esh
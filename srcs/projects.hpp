@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include "mapped_file.hpp"
+#include "norm.hpp"
+
+namespace esh {
+
+struct TestCase {
+    std::vector<std::string> args;
+    std::string expected;   // stdout and stderr of the run, escapes decoded
+};
+
+struct Exercise {
+    std::string id;                      // "<group>/<name>"
+    std::string name;
+    unsigned level = 0;
+    std::vector<std::string> sources;    // files the student hands in
+    std::vector<std::string> allowed;    // functions the program may call
+    std::string build;                   // shell command; empty: make, or cc on the .c sources
+    std::string program;                 // binary the tests run, "./<name>" by default
+    std::vector<TestCase> tests;
+    std::chrono::seconds timeout{0};     // per test run, 0 for none
+    std::vector<std::pair<std::string, std::string>> norm;   // norm::Config keys
+
+    // Applies the exercise's norm keys over cfg
+    bool normConfig(norm::Config& cfg, std::string* error = nullptr) const;
+};
+
+struct ExerciseGroup {
+    std::string name;                    // "rank02"
+    std::string title;                   // "EXAM RANK 02"
+    std::string kind;                    // menu it is listed in: "student", "piscine"
+    std::chrono::minutes timeLimit{0};   // exam length, 0 when untimed
+};
+
+// Exercise definitions from one text file of sections:
+//
+//   [rank02]                  a group: title, kind, time (minutes)
+//   title = EXAM RANK 02
+//   kind = student
+//   time = 180
+//
+//   [rank02/ft_strlen]        an exercise: level, sources, allowed, build,
+//   level = 1                 program, timeout (seconds), norm.<normrc key>,
+//   sources = ft_strlen.c     and any number of "test = args => output"
+//   test = hello => 5\n
+//
+// Lists are comma separated; test arguments split on blanks, with double
+// quotes grouping; the expected output takes \n, \t, \\ and \" escapes.
+// '#' starts a comment only at the beginning of a line.
+//
+// open() maps the file and indexes the section headers in one pass; groups
+// are parsed right away, exercises only when first looked up, then cached.
+class ProjectRegistry {
+public:
+    ProjectRegistry() = default;
+    ProjectRegistry(const ProjectRegistry&) = delete;
+    ProjectRegistry& operator=(const ProjectRegistry&) = delete;
+
+    bool open(const std::string& path, std::string* error = nullptr);
+    bool isOpen() const noexcept { return _file.ok(); }
+    const std::string& path() const noexcept { return _path; }
+
+    // $ESH_PROJECTS, else data/projects.esh next to the executable
+    static std::string defaultPath();
+
+    const std::vector<ExerciseGroup>& groups() const noexcept { return _groups; }
+    std::vector<const ExerciseGroup*> groups(std::string_view kind) const;
+    const ExerciseGroup* group(std::string_view name) const;
+
+    std::size_t exerciseCount() const noexcept { return _entries.size(); }
+    // Exercise ids of a group, sorted
+    std::vector<std::string_view> exercises(std::string_view group) const;
+    // nullptr when the id is unknown or its section is invalid (logged once).
+    // Thread-safe; the pointer stays valid until the next open().
+    const Exercise* find(std::string_view id) const;
+
+private:
+    struct Entry {
+        std::string_view id;
+        std::string_view body;
+        std::uint32_t line;   // of the header, for messages
+        mutable std::unique_ptr<Exercise> parsed;
+        mutable bool failed = false;
+    };
+
+    bool parseGroup(std::string_view name, std::string_view body, std::uint32_t line, std::string* error);
+    std::unique_ptr<Exercise> parseExercise(const Entry& entry, std::string* error) const;
+
+    MappedFile _file;
+    std::string _path;
+    std::vector<Entry> _entries;   // sorted by id
+    std::vector<ExerciseGroup> _groups;
+    mutable std::mutex _mx;        // guards the lazy parse
+};
+
+} // namespace esh
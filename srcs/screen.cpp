@@ -0,0 +1,87 @@
+#include "screen.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <sys/ioctl.h>
+
+namespace ui {
+
+static void move_to(std::string& out, std::size_t row) {
+    out += "\033[";
+    out += std::to_string(row + 1);
+    out += ";1H";
+}
+
+// Terminal rows the frame takes, long rows wrapping at cols
+static std::size_t rows_on(const std::vector<std::string>& frame, std::size_t cols) {
+    std::size_t rows = 0;
+    for (const auto& l : frame) rows += std::max<std::size_t>(1, (Screen::width(l) + cols - 1) / cols);
+    return rows;
+}
+
+std::size_t Screen::present() {
+    _out.clear();
+    struct winsize ws;
+    const bool tty = ioctl(_fd, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0;
+    // One row is left for the cursor parked below the frame
+    if (!tty || rows_on(_next, ws.ws_col) >= ws.ws_row) {
+        if (_lined && _next == _prev) return 0;
+        for (const auto& l : _next) {
+            _out += l;
+            _out += '\n';
+        }
+        _valid = false;
+        _lined = true;
+    } else if (!_valid) {
+        _lined = false;
+        _out += "\033[H\033[2J";
+        for (const auto& l : _next) {
+            _out += l;
+            _out += '\n';
+        }
+    } else {
+        for (std::size_t i = 0; i < _next.size(); ++i) {
+            if (i < _prev.size() && _prev[i] == _next[i]) continue;
+            move_to(_out, i);
+            _out += _next[i];
+            _out += "\033[K";
+        }
+        // Park below the frame and wipe whatever was printed under it
+        move_to(_out, _next.size());
+        _out += "\033[J";
+    }
+    if (!_lined) _valid = true;
+
+    // Anything still sitting in std::cout belongs before the frame
+    std::cout.flush();
+    const char* p = _out.data();
+    std::size_t left = _out.size();
+    while (left > 0) {
+        ssize_t n = ::write(_fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    _prev.swap(_next);
+    return _out.size() - left;
+}
+
+std::size_t Screen::width(const std::string& text) {
+    std::size_t w = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == 0x1B) {
+            // CSI: ESC [ params final-byte
+            if (i + 1 < text.size() && text[i + 1] == '[') {
+                i += 2;
+                while (i < text.size() && !(text[i] >= 0x40 && text[i] <= 0x7E)) ++i;
+            }
+            continue;
+        }
+        if ((c & 0xC0) != 0x80) ++w;   // count UTF-8 lead bytes only
+    }
+    return w;
+}
+
+} // namespace ui
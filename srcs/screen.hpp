@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <unistd.h>
+
+namespace ui {
+
+// Line-based frame renderer anchored at the top of the terminal.
+// Keeps the previously presented frame and only rewrites the lines that
+// changed (cursor move + text + erase-to-eol), batched into one write().
+// Cursor addressing needs the whole frame on screen: when fd is not a
+// terminal, or the frame is taller than it (wrapped rows included), the
+// frame is printed as plain lines instead, and only when it changed.
+class Screen {
+public:
+    explicit Screen(int fd = STDOUT_FILENO) : _fd(fd) {}
+
+    // Start composing a new frame
+    void begin() { _next.clear(); }
+    // Append one row; may contain SGR color sequences but no newline
+    void line(const std::string& text) { _next.push_back(text); }
+    std::size_t rows() const noexcept { return _next.size(); }
+
+    // Draw the frame, leaving the cursor on the row below it with the rest of
+    // the screen cleared. Returns the number of bytes written.
+    std::size_t present();
+
+    // Something else wrote to the terminal: the next present() redraws fully
+    void invalidate() {
+        _valid = false;
+        _lined = false;
+    }
+
+    // Visible width of a row (escape sequences skipped, UTF-8 aware)
+    static std::size_t width(const std::string& text);
+
+private:
+    int _fd;
+    bool _valid = false;   // _prev is on screen, addressable from the top
+    bool _lined = false;   // _prev was printed in line mode
+    std::vector<std::string> _prev;
+    std::vector<std::string> _next;
+    std::string _out;   // reused output buffer
+};
+
+} // namespace ui
@@ -0,0 +1,259 @@
+#include "session.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+
+namespace {
+
+std::vector<std::string> fields(const std::string& payload, std::size_t count) {
+    std::vector<std::string> out;
+    std::size_t pos = 0;
+    // The last field takes the rest: command lines may contain tabs
+    while (out.size() + 1 < count) {
+        std::size_t tab = payload.find('\t', pos);
+        if (tab == std::string::npos) break;
+        out.push_back(payload.substr(pos, tab - pos));
+        pos = tab + 1;
+    }
+    out.push_back(payload.substr(pos));
+    out.resize(count);
+    return out;
+}
+
+std::string join(const std::vector<std::string>& argv) {
+    std::string out;
+    for (const auto& a : argv) {
+        if (!out.empty()) out += ' ';
+        out += a;
+    }
+    return out;
+}
+
+std::string command_of(const std::string& line) {
+    std::size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos) return std::string();
+    std::size_t end = line.find_first_of(" \t", start);
+    return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+} // namespace
+
+// Recording
+
+bool SessionRecorder::open(const std::string& path) {
+    // Only when no other shell records into it: a rename under its open fd
+    // would send the rest of its session to <path>.1
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        struct stat st;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0 &&
+            static_cast<std::uint64_t>(st.st_size) > kRotateBytes) {
+            std::rename(path.c_str(), (path + ".1").c_str());
+        }
+        ::close(fd);
+    }
+    return _journal.open(path);
+}
+
+void SessionRecorder::close() {
+    _journal.close();
+}
+
+void SessionRecorder::start(const std::string& cwd, const std::string& user) {
+    if (active()) _journal.append(static_cast<std::uint8_t>(SessionEvent::Start), cwd + "\t" + user);
+}
+
+void SessionRecorder::mode(int mode, const std::string& group) {
+    if (active()) _journal.append(static_cast<std::uint8_t>(SessionEvent::Mode), std::to_string(mode) + "\t" + group);
+}
+
+void SessionRecorder::input(const std::string& line) {
+    if (active()) _journal.append(static_cast<std::uint8_t>(SessionEvent::Input), line);
+}
+
+void SessionRecorder::dispatch(const std::string& line, std::chrono::nanoseconds latency, std::uint64_t bytes,
+                               std::uint32_t crc) {
+    if (!active()) return;
+    _journal.append(static_cast<std::uint8_t>(SessionEvent::Dispatch),
+                    std::to_string(latency.count()) + "\t" + std::to_string(bytes) + "\t" + std::to_string(crc) +
+                        "\t" + line);
+}
+
+void SessionRecorder::child(const std::vector<std::string>& argv, int result, std::chrono::nanoseconds took) {
+    if (!active()) return;
+    _journal.append(static_cast<std::uint8_t>(SessionEvent::Child),
+                    std::to_string(result) + "\t" + std::to_string(took.count()) + "\t" + join(argv));
+}
+
+void SessionRecorder::jobDone(int id) {
+    if (active()) _journal.append(static_cast<std::uint8_t>(SessionEvent::JobDone), std::to_string(id));
+}
+
+void SessionRecorder::end() {
+    if (!active()) return;
+    _journal.append(static_cast<std::uint8_t>(SessionEvent::End), std::string());
+    _journal.sync();
+}
+
+// Output probe
+
+OutputProbe::OutputProbe(std::ostream& stream, bool forward)
+: _stream(stream), _original(stream.rdbuf()), _forward(forward) {
+    _stream.flush();
+    _stream.rdbuf(this);
+}
+
+OutputProbe::~OutputProbe() {
+    _stream.rdbuf(_original);
+}
+
+int OutputProbe::overflow(int c) {
+    if (c == traits_type::eof()) return traits_type::not_eof(c);
+    char ch = static_cast<char>(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize OutputProbe::xsputn(const char* s, std::streamsize n) {
+    std::lock_guard<std::mutex> lock(_mx);
+    _crc = Journal::crc32(s, static_cast<std::size_t>(n), _crc);
+    _bytes += static_cast<std::uint64_t>(n);
+    return _forward ? _original->sputn(s, n) : n;
+}
+
+std::uint64_t OutputProbe::bytes() const {
+    std::lock_guard<std::mutex> lock(_mx);
+    return _bytes;
+}
+
+std::uint32_t OutputProbe::crc() const {
+    std::lock_guard<std::mutex> lock(_mx);
+    return _crc;
+}
+
+int OutputProbe::sync() {
+    std::lock_guard<std::mutex> lock(_mx);
+    return _forward ? _original->pubsync() : 0;
+}
+
+// Reading a recording back
+
+bool load_sessions(const std::string& path, std::vector<RecordedSession>& out, std::string* error) {
+    out.clear();
+    bool ok = Journal::replay(path, [&out](const Journal::Record& rec) {
+        const SessionEvent type = static_cast<SessionEvent>(rec.type);
+        if (type == SessionEvent::Start) {
+            auto f = fields(rec.payload, 2);
+            out.emplace_back();
+            out.back().cwd = f[0];
+            out.back().user = f[1];
+            out.back().startNs = rec.timeNs;
+            return;
+        }
+        if (out.empty()) return;
+        RecordedSession& s = out.back();
+        if (type == SessionEvent::Mode) {
+            auto f = fields(rec.payload, 2);
+            RecordedSession::Step step{RecordedSession::Step::Kind::Mode, f[1]};
+            step.mode = std::atoi(f[0].c_str());
+            s.steps.push_back(std::move(step));
+        } else if (type == SessionEvent::Input) {
+            s.steps.push_back(RecordedSession::Step{RecordedSession::Step::Kind::Line, rec.payload});
+        } else if (type == SessionEvent::Dispatch) {
+            auto f = fields(rec.payload, 4);
+            // Matches the latest input of the same line still waiting for its result
+            for (auto it = s.steps.rbegin(); it != s.steps.rend(); ++it) {
+                if (it->kind != RecordedSession::Step::Kind::Line || it->dispatched || it->line != f[3]) continue;
+                it->dispatched = true;
+                it->latencyNs = std::strtoull(f[0].c_str(), nullptr, 10);
+                it->bytes = std::strtoull(f[1].c_str(), nullptr, 10);
+                it->crc = static_cast<std::uint32_t>(std::strtoul(f[2].c_str(), nullptr, 10));
+                break;
+            }
+        } else if (type == SessionEvent::JobDone) {
+            RecordedSession::Step step{RecordedSession::Step::Kind::JobDone, std::string()};
+            step.job = std::atoi(rec.payload.c_str());
+            s.steps.push_back(std::move(step));
+        } else if (type == SessionEvent::Child) {
+            auto f = fields(rec.payload, 3);
+            s.children[f[2]].push_back(std::atoi(f[0].c_str()));
+        }
+    });
+    if (!ok && error) *error = "cannot read session recording " + path;
+    return ok;
+}
+
+// Replay report
+
+void ReplayReport::line(const RecordedSession::Step& recorded, std::chrono::nanoseconds latency, std::uint64_t bytes,
+                        std::uint32_t crc) {
+    ++_lines;
+    if (!recorded.dispatched) return;   // the recording ended inside this command
+    Latency& l = _latency[command_of(recorded.line)];
+    ++l.count;
+    l.recordedNs += static_cast<double>(recorded.latencyNs);
+    l.replayedNs += static_cast<double>(latency.count());
+    if (bytes != recorded.bytes || crc != recorded.crc) {
+        _divergent.push_back("output of '" + recorded.line + "': " + std::to_string(recorded.bytes) + " -> " +
+                             std::to_string(bytes) + " bytes" + (bytes == recorded.bytes ? ", different text" : ""));
+    }
+}
+
+void ReplayReport::skipped(const std::string& line) {
+    ++_lines;
+    _skipped.push_back(line);
+}
+
+void ReplayReport::child(const std::vector<std::string>& argv, int result) {
+    std::lock_guard<std::mutex> lock(_childMx);
+    _children[join(argv)].push_back(result);
+}
+
+// The nth run of a command line is compared with its nth recorded run, so
+// background jobs finishing in another order do not count
+void ReplayReport::finish(const RecordedSession& recorded) {
+    std::lock_guard<std::mutex> lock(_childMx);
+    for (const auto& kv : recorded.children) {
+        const std::vector<int>& now = _children[kv.first];
+        for (std::size_t i = 0; i < std::max(kv.second.size(), now.size()); ++i) {
+            std::string was = i < kv.second.size() ? std::to_string(kv.second[i]) : "not run";
+            std::string is = i < now.size() ? std::to_string(now[i]) : "not run";
+            if (was != is) _divergent.push_back("child '" + kv.first + "': exit " + was + " -> " + is);
+        }
+    }
+    for (const auto& kv : _children) {
+        if (recorded.children.count(kv.first)) continue;
+        _divergent.push_back("child '" + kv.first + "': not recorded, ran " + std::to_string(kv.second.size()) +
+                             " time(s)");
+    }
+}
+
+void ReplayReport::print(std::ostream& out) const {
+    out << _lines << " input line(s) replayed, " << _skipped.size() << " skipped\n\n";
+    out << std::left << std::setw(16) << "command" << std::right << std::setw(7) << "runs" << std::setw(14)
+        << "recorded ms" << std::setw(14) << "replayed ms" << std::setw(10) << "change" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (const auto& kv : _latency) {
+        const Latency& l = kv.second;
+        const double was = l.recordedNs / l.count / 1e6, is = l.replayedNs / l.count / 1e6;
+        out << std::left << std::setw(16) << kv.first << std::right << std::setw(7) << l.count << std::setw(14) << was
+            << std::setw(14) << is << std::setw(9) << std::setprecision(1)
+            << (was > 0 ? (is / was - 1) * 100 : 0.0) << "%" << std::setprecision(3) << "\n";
+    }
+    out << std::defaultfloat;
+    for (const auto& line : _skipped) out << "skipped (interactive): " << line << "\n";
+    if (_divergent.empty()) {
+        out << "\nno divergence\n";
+        return;
+    }
+    out << "\n" << _divergent.size() << " divergence(s):\n";
+    for (const auto& d : _divergent) out << "  " << d << "\n";
+}
+
+} // namespace esh
@@ -0,0 +1,130 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include "journal.hpp"
+
+namespace esh {
+
+// Event types of the session recording (.exam-shell.session), stored in the
+// Journal format. Fields inside a payload are separated by tabs.
+enum class SessionEvent : std::uint8_t {
+    Start    = 1,   // payload: cwd, user
+    Mode     = 2,   // payload: mode number, exam group
+    Input    = 3,   // payload: the line as typed
+    Dispatch = 4,   // payload: latency ns, output bytes, output crc32, line
+    Child    = 5,   // payload: result, duration ns, argv joined by spaces
+    End      = 6,
+    JobDone  = 7    // payload: job id; a background task returned
+};
+
+// Appends one session to the recording. Every call only copies into the
+// journal's buffer; the journal's flusher thread does the writes.
+class SessionRecorder {
+public:
+    // A recording past this size is moved to <path>.1 (replacing the one
+    // there) when the next shell opens it
+    static const std::uint64_t kRotateBytes = 8ull << 20;
+
+    bool open(const std::string& path);
+    void close();
+    bool active() const noexcept { return _journal.isOpen(); }
+
+    void start(const std::string& cwd, const std::string& user);
+    void mode(int mode, const std::string& group);
+    void input(const std::string& line);
+    void dispatch(const std::string& line, std::chrono::nanoseconds latency, std::uint64_t bytes, std::uint32_t crc);
+    // Thread-safe: called from the job threads
+    void child(const std::vector<std::string>& argv, int result, std::chrono::nanoseconds took);
+    void jobDone(int id);
+    void end();
+
+private:
+    Journal _journal;
+};
+
+// Counts and checksums what is printed to a stream while it lives, passing
+// it on to the original buffer or, with forward=false, dropping it. Task
+// threads print through it while the loop thread reads the totals.
+class OutputProbe : private std::streambuf {
+public:
+    OutputProbe(std::ostream& stream, bool forward);
+    ~OutputProbe() override;
+    OutputProbe(const OutputProbe&) = delete;
+    OutputProbe& operator=(const OutputProbe&) = delete;
+
+    std::uint64_t bytes() const;
+    std::uint32_t crc() const;
+
+private:
+    int overflow(int c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+    std::ostream& _stream;
+    std::streambuf* _original;
+    bool _forward;
+    mutable std::mutex _mx;   // _bytes, _crc
+    std::uint64_t _bytes = 0;
+    std::uint32_t _crc = 0;
+};
+
+// One recorded session, as read back for a replay
+struct RecordedSession {
+    struct Step {
+        enum class Kind { Mode, Line, JobDone };
+        Kind kind;
+        std::string line;          // the input line, or the exam group for Mode
+        int mode = 0;
+        int job = 0;               // JobDone: replay waits for it before going on
+        bool dispatched = false;   // a Dispatch record followed the input
+        std::uint64_t latencyNs = 0;
+        std::uint64_t bytes = 0;
+        std::uint32_t crc = 0;
+    };
+    std::string cwd;
+    std::string user;
+    std::uint64_t startNs = 0;
+    std::vector<Step> steps;
+    // Results of each child command line, in the order they finished
+    std::map<std::string, std::vector<int>> children;
+};
+
+// Sessions of a recording, oldest first
+bool load_sessions(const std::string& path, std::vector<RecordedSession>& out, std::string* error = nullptr);
+
+// Compares a replay with its recording: latency per command and the inputs
+// or child commands whose results differ
+class ReplayReport {
+public:
+    void line(const RecordedSession::Step& recorded, std::chrono::nanoseconds latency, std::uint64_t bytes,
+              std::uint32_t crc);
+    void skipped(const std::string& line);
+    // Thread-safe: called from the job threads
+    void child(const std::vector<std::string>& argv, int result);
+    // Children recorded but not run again count as divergences too
+    void finish(const RecordedSession& recorded);
+
+    std::size_t divergences() const noexcept { return _divergent.size(); }
+    void print(std::ostream& out) const;
+
+private:
+    struct Latency {
+        std::size_t count = 0;
+        double recordedNs = 0;
+        double replayedNs = 0;
+    };
+    std::map<std::string, Latency> _latency;   // by command name
+    std::vector<std::string> _divergent;
+    std::vector<std::string> _skipped;
+    std::map<std::string, std::vector<int>> _children;
+    std::mutex _childMx;
+    std::size_t _lines = 0;
+};
+
+} // namespace esh
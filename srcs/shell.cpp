@@ -2,59 +2,222 @@
 #include "utils.hpp"
 #include "log.hpp"
 #include "menu.hpp"
+#include "norm.hpp"
+#include "norm_report.hpp"
+#include "norm_fix.hpp"
+#include "allowed_functions.hpp"
+#include "metrics.hpp"
+#include "debug.hpp"
+#include "alloc.hpp"
+#include "mapped_file.hpp"
+#include "template.hpp"
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
-#include <fstream>
 #include <map>
 #include <vector>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <functional>
 #include <chrono>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <set>
+
+// Published in the shell's metrics segment (see metrics.hpp, tools/esh-top)
+struct ShellMetrics {
+    esh::metrics::Counter commands = esh::metrics::counter("esh_commands_total", "Commands dispatched");
+    esh::metrics::Counter unknown = esh::metrics::counter("esh_commands_unknown_total", "Unknown commands typed");
+    esh::metrics::Histogram grade = esh::metrics::histogram("esh_grade_duration_ms", "grademe wall time",
+        {50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000});
+    esh::metrics::Counter gradeFailed = esh::metrics::counter("esh_grades_failed_total", "grademe runs graded KO");
+    esh::metrics::Counter normFiles = esh::metrics::counter("esh_norm_files_total", "Files checked by the norm");
+    esh::metrics::Counter normIssues = esh::metrics::counter("esh_norm_issues_total", "Norm issues found");
+    esh::metrics::Counter normMicros = esh::metrics::counter("esh_norm_check_us_total",
+                                                             "Time spent checking files, microseconds");
+    esh::metrics::Gauge jobs = esh::metrics::gauge("esh_jobs_active", "Tasks queued or running");
+    esh::metrics::Gauge rss = esh::metrics::gauge("esh_rss_bytes", "Resident set size");
+    esh::metrics::Gauge mode = esh::metrics::gauge("esh_session_mode",
+                                                   "0 menu, 1 project, 2 evaluation, 3 sandbox");
+    esh::metrics::Gauge uptime = esh::metrics::gauge("esh_session_uptime_seconds", "Time since the session started");
+};
+
+static ShellMetrics& shell_metrics() {
+    static ShellMetrics m;
+    return m;
+}
+
+// Our own log, journal, recordings and snapshot store would otherwise report
+// themselves forever and be rolled back; rotated logs and the files esh-audit
+// leaves next to a journal too
+static const char* const kOwnFiles[] = {
+    ".git",
+    ".shell_audit",
+    ".shell_audit.*",
+    ".exam-shell.log",
+    ".exam-shell.log.*",
+    ".exam-shell.session",
+    ".exam-shell.session.*",
+    ".exam-shell.replay.log",
+    ".exam-shell.crash",
+    ".esh-snapshot",
+};
 
-// Forward declare template renderer from utils.cpp
-std::string render_template(const std::string& tpl, const std::map<std::string, std::string>& vars);
+static const char* mode_name(Shell::Mode m) {
+    switch (m) {
+        case Shell::Mode::Project: return "PROJECT";
+        case Shell::Mode::Evaluation: return "EVALUATION";
+        case Shell::Mode::Sandbox: return "SANDBOX";
+        default: return "MENU";
+    }
+}
 
-Shell::Shell() {
+Shell::Shell(bool headless) {
     backupEnvironment();
+    if (const char* minutes = std::getenv("ESH_EXAM_MINUTES")) {
+        examLimit = std::chrono::minutes(std::atol(minutes));
+    }
+    // Only the section headers are read here; exercises are parsed on use
+    std::string error;
+    if (!projects.open(esh::ProjectRegistry::defaultPath(), &error)) {
+        ESH_LOG_WARN() << "No project registry: " << error;
+    }
+    // Absolute path: the journal must not follow later chdir()s
+    if (!headless && audit.open(originalCwd + "/.shell_audit")) {
+        const char* user = std::getenv("USER");
+        audit.append(esh::AuditEvent::SessionStart, user ? user : "student");
+    }
+    for (const char* name : kOwnFiles) {
+        watcher.ignore(name);
+        workspace.ignore(name);
+    }
+    watcher.setSink([this](const std::string& path, const esh::FileWatcher::Stat& st) {
+        trackFileChange(path, st);
+    });
+    if (!headless) watcher.start(originalCwd, &loop);
+
+    // Children are reaped on the loop; finished jobs wake it to be announced
+    jobs.setLoop(&loop);
+    jobs.setOnFinished([this] {
+        loop.post([this] {
+            if (promptActive) onTick();
+        });
+    });
+    jobs.setOnSpawn([this](const std::vector<std::string>& argv, int result, std::chrono::nanoseconds took) {
+        if (replaying) replaying->child(argv, result);
+        else session.child(argv, result, took);
+    });
 }
 
 void Shell::backupEnvironment() {
     originalCwd = get_current_dir();
-    originalEnv = get_env_map();
+    originalEnv = esh::EnvSnapshot::capture();
 }
 
+// Only variables that differ from the snapshot are touched; ones added during
+// the session are removed
 void Shell::restoreEnvironment() {
     chdir(originalCwd.c_str());
-    for (const auto& kv : originalEnv) {
-        setenv(kv.first.c_str(), kv.second.c_str(), 1);
-    }
+    std::size_t touched = originalEnv.restore();
+    ESH_LOG_DEBUG() << "Environment restored, " << touched << " variable(s) changed";
 }
 
-void Shell::trackFileChange(const std::string& path) {
-    changedFiles.push_back(path);
+// Called with events already coalesced by the watcher; one journal record per path and flush
+void Shell::trackFileChange(const std::string& path, const esh::FileWatcher::Stat& stat) {
+    {
+        std::lock_guard<std::mutex> lock(changedMx);
+        esh::FileWatcher::Stat& total = changedFiles[path];
+        if (total.count == 0) total.first = stat.first;
+        total.count += stat.count;
+        total.mask |= stat.mask;
+        total.last = stat.last;
+    }
+    audit.append(esh::AuditEvent::FileChange,
+                 path + "\t" + esh::FileWatcher::describe(stat.mask) + " x" + std::to_string(stat.count));
 }
 
 void Shell::trackEnvChange(const std::string& key, const std::string& value) {
     changedEnv[key] = value;
+    audit.append(esh::AuditEvent::EnvChange, key + "=" + value);
 }
 
+// Changes are journaled as they happen; closing the session only has to
+// mark its end and wait for the last group commit.
 void Shell::persistChanges() {
-    std::ofstream audit(".shell_audit", std::ios::app);
-    audit << "Changed files:\n";
-    for (const auto& f : changedFiles) {
-        audit << f << "\n";
+    watcher.stop();  // delivers the last coalesced batch
+    std::lock_guard<std::mutex> lock(changedMx);
+    audit.append(esh::AuditEvent::SessionEnd,
+                 "files=" + std::to_string(changedFiles.size()) + " env=" + std::to_string(changedEnv.size()));
+    audit.sync();
+}
+
+// The directory snapshots cover: rendu/ under the launch directory when there
+// is one (the hand-in tree of an exam), else the launch directory when it is
+// named like an exercise. Never any other directory: a rollback deletes what
+// the snapshot does not know, and the shell may have been started from $HOME.
+std::string Shell::exerciseDir() const {
+    const std::string rendu = originalCwd + "/rendu";
+    struct stat st;
+    if (stat(rendu.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return rendu;
+    std::string group;
+    {
+        std::lock_guard<std::mutex> lock(gradeMx);
+        group = currentGroup;
     }
-    audit << "Changed env:\n";
-    for (const auto& kv : changedEnv) {
-        audit << kv.first << "=" << kv.second << "\n";
+    return findExercise(group, std::string()) ? originalCwd : std::string();
+}
+
+// Save the exercise directory so graders can reset it between test cases.
+// Taken once per exercise: entering a mode again keeps the snapshot as long
+// as the directory and the exam stay the same, unless force is set.
+bool Shell::snapshotWorkspace(bool force) {
+    const std::string dir = exerciseDir();
+    if (dir.empty()) {
+        ESH_LOG_DEBUG() << "No exercise directory to snapshot";
+        return false;
     }
-    audit.close();
+    std::string key;
+    {
+        std::lock_guard<std::mutex> lock(gradeMx);
+        key = currentGroup + "\t" + dir;
+    }
+    if (!force && workspace.active() && key == snapshotKey) return true;
+    // Without reflinks the first snapshot copies every file: keep the loop
+    // (and Ctrl+C) alive and show how far it got once it takes a while
+    bool ok = true;
+    bool cancelled = !runForeground("snapshot", [this, &dir, &ok](esh::JobContext& ctx) {
+        auto shown = std::chrono::steady_clock::now();
+        bool showing = false;
+        ok = workspace.take(dir, originalCwd + "/.esh-snapshot", nullptr,
+                            [&](const esh::WorkspaceSnapshot::Stats& s) {
+                                auto now = std::chrono::steady_clock::now();
+                                if (now - shown >= std::chrono::milliseconds(250)) {
+                                    shown = now;
+                                    showing = true;
+                                    ctx.progress(-1, std::to_string(s.files) + " file(s)");
+                                    std::cout << "\r\033[KSnapshot: " << s.files << " file(s), "
+                                              << s.bytes / (1024 * 1024) << " MiB copied" << std::flush;
+                                }
+                                return !ctx.cancelled();
+                            });
+        if (showing) std::cout << "\r\033[K" << std::flush;
+    });
+    if (cancelled || !workspace.active()) {
+        std::cout << "\033[1;33mWarning:\033[0m no workspace snapshot, use 'snapshot' to take it again\n";
+        snapshotKey.clear();
+        return false;
+    }
+    if (!ok) std::cout << "\033[1;33mWarning:\033[0m workspace snapshot is incomplete, see log\n";
+    snapshotKey = key;
+    return true;
 }
 
 static void print_welcome() {
@@ -72,32 +235,26 @@ static void print_welcome() {
     char ts[64];
     std::strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
 
-    std::map<std::string, std::string> ctx = {
-        {"user", user},
-        {"start_time", ts},
-        {"product", "Exam Shell"}
-    };
-
-    std::string tpl =
+    static const esh::Template tpl(
         "\033[1;36m========================================\033[0m\n"
         "\033[1;32m  Welcome {{user}} to the {{product}}!\033[0m\n"
         "\033[1;36m========================================\033[0m\n"
         "Session start: {{start_time}}\n"
-        "Use 'mode' to select evaluation mode, 'help' for commands.\n\n";
+        "Use 'mode' to select evaluation mode, 'help' for commands.\n\n");
 
-    std::cout << render_template(tpl, ctx);
+    auto vars = tpl.bind();
+    vars.set("user", user).set("start_time", ts).set("product", "Exam Shell");
+    tpl.render(vars, std::cout);
     ESH_LOG_INFO() << "Welcome banner displayed for user=" << user;
 }
 
-// Replace previous SIGINT handler with a safe one (no prompt print here)
-static volatile sig_atomic_t sigint_received = 0;
-static void handle_sigint(int) {
-    sigint_received = 1;
-    // async-signal-safe: just write a newline
-    write(STDOUT_FILENO, "\n", 1);
+// Readline needs non-printing sequences wrapped in \001..\002 to size the prompt
+static std::string rl_sgr(const char* code) {
+    return std::string("\001") + code + "\002";
 }
 
-// Build a nice prompt with mode and time
+// Build a nice prompt with mode and time, plus the live status: elapsed
+// session time, exam countdown, running jobs and the last grade
 std::string Shell::buildPrompt() const {
     auto now = std::chrono::system_clock::now();
     std::time_t t = std::chrono::system_clock::to_time_t(now);
@@ -110,58 +267,142 @@ std::string Shell::buildPrompt() const {
     std::ostringstream ts;
     ts << std::put_time(&tm, "%H:%M:%S");
 
-    const char* modeName = "MENU";
-    switch (currentMode) {
-        case Mode::Project: modeName = "PROJECT"; break;
-        case Mode::Evaluation: modeName = "EVALUATION"; break;
-        case Mode::Sandbox: modeName = "SANDBOX"; break;
-        default: modeName = "MENU"; break;
-    }
-
+    ui::DashboardInfo info = dashboardInfo();
     std::ostringstream prompt;
-    prompt << "\033[1;90m[" << ts.str() << "]\033[0m "
-           << "\033[1;94m" << modeName << "\033[0m"
-           << " \033[1;93mexamshell\033[0m$ ";
+    prompt << rl_sgr("\033[1;90m") << "[" << ts.str() << "]" << rl_sgr("\033[0m") << " "
+           << rl_sgr("\033[1;94m") << info.modeName << rl_sgr("\033[0m");
+    if (currentMode != Mode::Menu) {
+        prompt << " " << rl_sgr("\033[90m") << ui::format_duration(info.sessionSeconds) << rl_sgr("\033[0m");
+    }
+    if (info.remainingSeconds >= 0) {
+        prompt << " " << rl_sgr(info.remainingSeconds < 600 ? "\033[1;31m" : "\033[1;33m")
+               << "-" << ui::format_duration(info.remainingSeconds) << rl_sgr("\033[0m");
+    }
+    if (!info.jobs.empty()) prompt << " " << rl_sgr("\033[1;35m") << info.jobs << rl_sgr("\033[0m");
+    if (!info.lastGrade.empty()) {
+        prompt << " " << rl_sgr(info.lastGrade == "OK" ? "\033[1;32m" : "\033[1;31m") << info.lastGrade << rl_sgr("\033[0m");
+    }
+    prompt << " " << rl_sgr("\033[1;93m") << "examshell" << rl_sgr("\033[0m") << "$ ";
     return prompt.str();
 }
 
-// Replace old dashboard with delegation to Menu
-void Shell::showDashboard() const {
-    ui::Menu menu;
-    // Build current mode name and elapsed time
-    const char* modeName = "MENU";
-    switch (currentMode) {
-        case Mode::Project: modeName = "PROJECT"; break;
-        case Mode::Evaluation: modeName = "EVALUATION"; break;
-        case Mode::Sandbox: modeName = "SANDBOX"; break;
-        default: modeName = "MENU"; break;
-    }
+ui::DashboardInfo Shell::dashboardInfo() const {
+    ui::DashboardInfo info;
+    info.modeName = mode_name(currentMode);
     auto now = std::chrono::system_clock::now();
-    long secs = std::chrono::duration_cast<std::chrono::seconds>(now - sessionStart).count();
-    if (secs < 0) secs = 0;
-    menu.showDashboard(modeName, secs);
+    info.sessionSeconds = std::max<long>(0, std::chrono::duration_cast<std::chrono::seconds>(now - sessionStart).count());
+    if (examLimit.count() > 0 && currentMode != Mode::Menu) {
+        info.remainingSeconds = std::max<long>(0, examLimit.count() - info.sessionSeconds);
+    }
+    info.jobs = jobs.promptSummary();
+    std::lock_guard<std::mutex> lock(gradeMx);
+    if (!currentGroup.empty() && currentMode != Mode::Menu) info.modeName += " " + currentGroup;
+    info.lastGrade = lastGrade;
+    return info;
+}
+
+void Shell::showDashboard() const {
+    menu.showDashboard(dashboardInfo());
+}
+
+// Live dashboard: the loop's tick redraws the rows that changed each second
+void Shell::watchDashboard() {
+    std::cout << "\033[2m(live, press Enter to return)\033[0m" << std::flush;
+    // Through readline: std::cin would buffer the lines typed after Enter
+    std::string tmp;
+    liveDashboard = true;
+    readAnswer("", tmp);
+    liveDashboard = false;
+    ESH_LOG_DEBUG() << "Live dashboard closed";
 }
 
-// Replace old modeMenu with delegation to Menu
+// Delegates to Menu. The dashboard is drawn once per pick: with the menu below it, then with
+// the new mode once one was picked
 void Shell::modeMenu() {
-    ui::Menu menu;
     while (true) {
-        ui::ModeChoice c = menu.pickMode();
+        ui::ModeChoice c = menu.pickMode(dashboardInfo());
         if (c == ui::ModeChoice::Cancel) {
             ESH_LOG_INFO() << "Mode selection cancelled";
             currentMode = Mode::Menu;
             return;
         }
-        if (c == ui::ModeChoice::Project)    { currentMode = Mode::Project;    ESH_LOG_INFO() << "Mode set to PROJECT";    break; }
-        if (c == ui::ModeChoice::Evaluation) { currentMode = Mode::Evaluation; ESH_LOG_INFO() << "Mode set to EVALUATION"; break; }
-        if (c == ui::ModeChoice::Sandbox)    { currentMode = Mode::Sandbox;    ESH_LOG_INFO() << "Mode set to SANDBOX";    break; }
+        if (c == ui::ModeChoice::Project) {
+            if (!pickExam("student")) continue;
+            currentMode = Mode::Project;
+            ESH_LOG_INFO() << "Mode set to PROJECT";
+            break;
+        }
+        if (c == ui::ModeChoice::Evaluation) {
+            if (!pickExam("piscine")) continue;
+            currentMode = Mode::Evaluation;
+            ESH_LOG_INFO() << "Mode set to EVALUATION";
+            break;
+        }
+        if (c == ui::ModeChoice::Sandbox) {
+            pickExam("");
+            currentMode = Mode::Sandbox;
+            ESH_LOG_INFO() << "Mode set to SANDBOX";
+            break;
+        }
+    }
+    std::string group;
+    {
+        std::lock_guard<std::mutex> lock(gradeMx);
+        group = currentGroup;
     }
+    std::string label = group.empty() ? std::string(mode_name(currentMode))
+                                      : std::string(mode_name(currentMode)) + " " + group;
+    audit.append(esh::AuditEvent::Mode, label);
+    session.mode(static_cast<int>(currentMode.load()), group);
+    esh::metrics::setLabel(label);
+    snapshotWorkspace(false);
     sessionStart = std::chrono::system_clock::now();
     showDashboard();
 }
 
+// The exam sets the countdown unless ESH_EXAM_MINUTES overrides it. Kinds
+// without any exam in the registry (and the sandbox) leave no exam selected.
+bool Shell::pickExam(const char* kind) {
+    auto exams = projects.groups(kind);
+    const esh::ExerciseGroup* picked = nullptr;
+    if (!exams.empty()) {
+        std::vector<std::string> titles;
+        for (const auto* g : exams) titles.push_back(g->title);
+        int n = std::string(kind) == "piscine" ? menu.piscineMenu(titles) : menu.studentMenu(titles);
+        if (n == 0) return false;
+        picked = exams[n - 1];
+        ESH_LOG_INFO() << "Exam " << picked->name << " selected, " << projects.exercises(picked->name).size()
+                       << " exercise(s)";
+    }
+    {
+        std::lock_guard<std::mutex> lock(gradeMx);
+        currentGroup = picked ? picked->name : std::string();
+    }
+    if (!std::getenv("ESH_EXAM_MINUTES")) {
+        examLimit = picked ? std::chrono::duration_cast<std::chrono::seconds>(picked->timeLimit)
+                           : std::chrono::seconds(0);
+    }
+    return true;
+}
+
+const esh::Exercise* Shell::findExercise(const std::string& group, const std::string& name) const {
+    if (name.find('/') != std::string::npos) return projects.find(name);
+    std::string exercise = name;
+    if (exercise.empty()) {
+        exercise = get_current_dir();
+        exercise.erase(0, exercise.rfind('/') + 1);
+    }
+    if (!group.empty()) return projects.find(group + "/" + exercise);
+    // No exam picked: the first exam that has it
+    for (const auto& g : projects.groups()) {
+        if (const esh::Exercise* ex = projects.find(g.name + "/" + exercise)) return ex;
+    }
+    return nullptr;
+}
+
 // Tokenize input by spaces (simple)
 std::vector<std::string> Shell::split(const std::string& line) const {
+    ESH_ALLOC_SCOPE("split");
     std::vector<std::string> out;
     std::istringstream iss(line);
     std::string tok;
@@ -169,6 +410,167 @@ std::vector<std::string> Shell::split(const std::string& line) const {
     return out;
 }
 
+// Rules for a norm run on root: <root>/.normrc when present, else defaults
+static norm::Config load_norm_config(esh::JobContext& ctx, const std::string& root) {
+    norm::Config cfg;
+    std::string error;
+    if (!cfg.load(root + "/.normrc", &error)) {
+        ctx.out() << "\033[1;33mWarning:\033[0m " << error << ", using defaults\n";
+        cfg = norm::Config();
+    }
+    return cfg;
+}
+
+// Norm pass with per-file progress so long runs show up in the prompt.
+// With a writer, each file's issues are streamed out as soon as the file is
+// checked.
+static norm::Report norm_with_progress(esh::JobContext& ctx, const std::string& root, const norm::Config& cfg,
+                                       int pctFrom, int pctTo, bool timings = false,
+                                       norm::ReportWriter* writer = nullptr) {
+    norm::Checker checker(cfg);
+    checker.setTiming(timings);
+    norm::Report all;
+    auto files = list_files_recursive(root, cfg.fileExtensions);
+    if (writer) writer->begin();
+    std::size_t checked = 0;
+    std::chrono::steady_clock::duration spent{};
+    for (std::size_t i = 0; i < files.size() && !ctx.cancelled(); ++i, ++checked) {
+        ctx.progress(pctFrom + static_cast<int>((pctTo - pctFrom) * i / files.size()), "norm");
+        std::size_t first = all.size();
+        auto t0 = std::chrono::steady_clock::now();
+        checker.checkFile(files[i], all);
+        spent += std::chrono::steady_clock::now() - t0;
+        if (writer) writer->fileDone(all, all.internFile(files[i]), first, all.size());
+    }
+    if (writer) writer->end(all);
+    ShellMetrics& m = shell_metrics();
+    m.normFiles.inc(checked);
+    m.normIssues.inc(all.size());
+    m.normMicros.inc(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(spent).count()));
+    if (timings) norm::Checker::reportTimings(checker.timings(), ctx.out());
+    return all;
+}
+
+// norm --fix: rewrite the mechanically fixable issues on all CPUs
+static void norm_fix(esh::JobContext& ctx, const std::string& root, const norm::Config& cfg, int pctTo) {
+    auto files = list_files_recursive(root, cfg.fileExtensions);
+    norm::Fixer fixer(cfg);
+    std::vector<norm::FixResult> results;
+    auto sum = fixer.run(files, 0, [&ctx] { return ctx.cancelled(); },
+                         [&](std::size_t done) {
+                             ctx.progress(static_cast<int>(pctTo * done / files.size()), "fix");
+                         }, &results);
+    std::ostream& out = ctx.out();
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        if (!results[i].error.empty()) out << "\033[1;31mnorm --fix:\033[0m " << results[i].error << "\n";
+    }
+    out << "Fixed " << sum.fixes << " issue(s) in " << sum.rewritten << "/" << sum.files << " file(s): "
+        << sum.bytesIn << " -> " << sum.bytesOut << " bytes rewritten in " << std::fixed << std::setprecision(1)
+        << static_cast<double>(sum.ns) / 1e6 << " ms\n";
+    out.unsetf(std::ios::fixed);
+    ESH_LOG_INFO() << "norm --fix on " << root << ": " << sum.rewritten << " file(s) rewritten, "
+                   << sum.bytesOut << " bytes, " << sum.failed << " failed";
+}
+
+// build_exercise's result without a build command, a Makefile or C sources
+static const int kNothingToBuild = -2;
+
+// The exercise's build command, else make when there is a Makefile, else cc
+// on the exercise's .c sources. The exit status, or kNothingToBuild.
+static int build_exercise(esh::JobContext& ctx, const esh::Exercise* ex) {
+    std::vector<std::string> argv;
+    if (ex && !ex->build.empty()) {
+        argv = {"/bin/sh", "-c", ex->build};
+    } else if (access("Makefile", R_OK) == 0) {
+        argv = {"make"};
+    } else if (ex) {
+        argv = {"cc", "-Wall", "-Wextra", "-Werror"};
+        for (const auto& src : ex->sources) {
+            if (src.size() > 2 && src.compare(src.size() - 2, 2, ".c") == 0) argv.push_back(src);
+        }
+        if (argv.size() == 4) return kNothingToBuild;
+        argv.push_back("-o");
+        argv.push_back(ex->program);
+    } else {
+        return kNothingToBuild;
+    }
+    ctx.out() << "Building with " << (argv[0] == "/bin/sh" ? ex->build : argv[0]) << "...\n" << std::flush;
+    return ctx.spawn(argv);
+}
+
+// "a\tb\n" for a one-line test report
+static std::string show_output(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s.substr(0, 60)) {
+        if (c == '\n') out += "\\n";
+        else if (c == '\t') out += "\\t";
+        else out += c;
+    }
+    return out + (s.size() > 60 ? "...\"" : "\"");
+}
+
+// Symbols of the compiled program (or of the object files when there is no
+// program) against the exercise's allowed functions; returns the violations
+static std::size_t check_functions(esh::JobContext& ctx, const esh::Exercise& ex) {
+    std::ostream& out = ctx.out();
+    std::vector<std::string> files;
+    if (access(ex.program.c_str(), R_OK) == 0) files.push_back(ex.program);
+    else files = list_files_recursive(".", {".o"});
+    if (files.empty()) {
+        out << "Functions: nothing compiled to check\n";
+        return 0;
+    }
+    norm::Report report;
+    std::string error;
+    std::size_t forbidden = esh::checkAllowedFunctions(files, ex.allowed, report, &error);
+    if (!error.empty()) out << "\033[1;33mWarning:\033[0m " << error << "\n";
+    out << "Functions: " << (forbidden ? "\033[1;31mKO\033[0m" : "OK") << " (" << files.size() << " file(s) checked)\n";
+    std::string msg;
+    for (const auto& is : report.issues()) {
+        msg.clear();
+        report.appendMessage(msg, is);
+        out << "  " << report.file(is.file) << ": " << msg << "\n";
+    }
+    return forbidden;
+}
+
+// Output a test may print beyond the expected one before it is killed
+static const std::size_t kTestOutputSlack = 64 * 1024;
+
+// Runs the exercise's test cases against its program; returns how many passed
+static std::size_t run_tests(esh::JobContext& ctx, const esh::Exercise& ex, int pctFrom, int pctTo) {
+    std::ostream& out = ctx.out();
+    std::size_t passed = 0;
+    for (std::size_t i = 0; i < ex.tests.size() && !ctx.cancelled(); ++i) {
+        ctx.progress(pctFrom + static_cast<int>((pctTo - pctFrom) * i / ex.tests.size()), "tests");
+        const esh::TestCase& test = ex.tests[i];
+        std::vector<std::string> argv;
+        if (ex.timeout.count() > 0) argv = {"timeout", std::to_string(ex.timeout.count())};
+        argv.push_back(ex.program);
+        argv.insert(argv.end(), test.args.begin(), test.args.end());
+        // Anything far past the expected output is a KO already; a program
+        // printing in a loop must not fill the shell's memory first
+        const std::size_t maxOutput = test.expected.size() + kTestOutputSlack;
+        std::string output;
+        int status = ctx.spawn(argv, &output, maxOutput);
+        if (output.size() > maxOutput) {
+            out << "Test " << i + 1 << ": \033[1;31mKO\033[0m (output too large: more than " << maxOutput
+                << " bytes)\n";
+        } else if (status == 124 && ex.timeout.count() > 0) {
+            out << "Test " << i + 1 << ": \033[1;31mKO\033[0m (timed out after " << ex.timeout.count() << "s)\n";
+        } else if (status < 0 || status >= 128) {
+            out << "Test " << i + 1 << ": \033[1;31mKO\033[0m (status " << status << ")\n";
+        } else if (output != test.expected) {
+            out << "Test " << i + 1 << ": \033[1;31mKO\033[0m (expected " << show_output(test.expected)
+                << ", got " << show_output(output) << ")\n";
+        } else {
+            out << "Test " << i + 1 << ": \033[1;32mOK\033[0m\n";
+            ++passed;
+        }
+    }
+    return passed;
+}
+
 // Register built-in commands
 void Shell::setupBuiltins() {
     helpTexts.clear();
@@ -186,9 +588,9 @@ void Shell::setupBuiltins() {
     commands["finish"] = [this](const std::vector<std::string>&) {
         std::cout << "Are you sure you want to \033[1;31mexit\033[0m the exam?\n";
         std::cout << "All your progress will be \033[1;31mlost\033[0m.\n";
-        std::cout << "Type '\033[1;32myes\033[0m' to confirm: ";
+        std::cout << "Type '\033[1;32myes\033[0m' to confirm: " << std::flush;
         std::string confirm;
-        std::getline(std::cin, confirm);
+        readAnswer("", confirm);
         if (confirm == "yes") {
             ESH_LOG_INFO() << "User confirmed exit";
             running = false;
@@ -215,88 +617,689 @@ void Shell::setupBuiltins() {
     };
     helpTexts["clock"] = "Show current time";
 
-    commands["grademe"] = [this](const std::vector<std::string>&) {
-        std::cout << "\033[1;32mGrading in progress...\033[0m\n";
-        std::cout << "Mode: ";
-        switch (currentMode) {
-            case Mode::Project: std::cout << "PROJECT\n"; break;
-            case Mode::Evaluation: std::cout << "EVALUATION\n"; break;
-            case Mode::Sandbox: std::cout << "SANDBOX\n"; break;
-            default: std::cout << "MENU\n"; break;
-        }
-        std::cout << "This is a placeholder. Plug your grading logic here.\n";
-        ESH_LOG_INFO() << "Grademe invoked in mode=" << (currentMode == Mode::Project ? "PROJECT" :
-                                                       currentMode == Mode::Evaluation ? "EVALUATION" :
-                                                       currentMode == Mode::Sandbox ? "SANDBOX" : "MENU");
+    tasks["grademe"] = [this](esh::JobContext& ctx, const std::vector<std::string>& args) {
+        const auto started = std::chrono::steady_clock::now();
+        std::ostream& out = ctx.out();
+        const char* mode = mode_name(currentMode);
+        std::string group;
+        {
+            std::lock_guard<std::mutex> lock(gradeMx);
+            group = currentGroup;
+        }
+        const esh::Exercise* ex = findExercise(group, args.size() > 1 ? args[1] : std::string());
+        if (!ex && args.size() > 1) {
+            out << "grademe: unknown exercise '" << args[1] << "'\n";
+            return;
+        }
+        out << "\033[1;32mGrading in progress...\033[0m\n";
+        out << "Mode: " << mode << "\n";
+
+        bool ok = true;
+        norm::Config cfg = load_norm_config(ctx, ".");
+        if (ex) {
+            out << "Exercise: " << ex->id << " (level " << ex->level << ")\n";
+            for (const auto& src : ex->sources) {
+                if (access(src.c_str(), R_OK) != 0) {
+                    out << "Missing file: " << src << "\n";
+                    ok = false;
+                }
+            }
+            std::string error;
+            if (!ex->normConfig(cfg, &error)) out << "\033[1;33mWarning:\033[0m " << error << "\n";
+        }
+
+        auto issues = norm_with_progress(ctx, ".", cfg, 0, 40);
+        std::size_t errors = issues.count(norm::Severity::Error);
+        out << "Norm: " << issues.size() << " issue(s), " << errors << " error(s)\n";
+
+        int build = kNothingToBuild;
+        if (!ctx.cancelled()) {
+            ctx.progress(40, "build");
+            build = build_exercise(ctx, ex);
+            if (build == kNothingToBuild) out << "Build: skipped\n";
+            else out << "Build: " << (build == 0 ? "OK" : "KO (status " + std::to_string(build) + ")") << "\n";
+        }
+        if (ctx.cancelled()) return;
+        // Nothing built may still mean a program that is already there
+        const bool built = build == 0 || build == kNothingToBuild;
+        std::size_t forbidden = 0;
+        if (ex && built && !ex->allowed.empty() && !ctx.cancelled()) forbidden = check_functions(ctx, *ex);
+        std::size_t passed = 0;
+        if (ex && built && !ex->tests.empty()) {
+            passed = run_tests(ctx, *ex, 50, 100);
+            out << "Tests: " << passed << "/" << ex->tests.size() << " passed\n";
+        }
+        if (ctx.cancelled()) return;
+        ctx.progress(100, "done");
+        if (!ex && build == kNothingToBuild) {
+            // Only the norm ran: no grade to give or to remember
+            out << "Result: nothing to grade (no exercise here and nothing to build)\n";
+            ESH_LOG_INFO() << "Grademe found nothing to grade in mode=" << mode << " issues=" << issues.size();
+            return;
+        }
+        ok = ok && errors == 0 && built && forbidden == 0 && (!ex || passed == ex->tests.size());
+        out << "Result: " << (ok ? "\033[1;32mOK\033[0m" : "\033[1;31mKO\033[0m") << "\n";
+        {
+            std::lock_guard<std::mutex> lock(gradeMx);
+            lastGrade = ok ? "OK" : "KO";
+        }
+        shell_metrics().grade.observe(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count()));
+        if (!ok) shell_metrics().gradeFailed.inc();
+        ESH_LOG_INFO() << "Grademe finished in mode=" << mode << " exercise=" << (ex ? ex->id : "-")
+                       << " issues=" << issues.size() << " build=" << build;
+    };
+    helpTexts["grademe"] = "Grade the current directory (norm + build + allowed functions + the exercise's tests): grademe [exercise], "
+                           "append & to run in background";
+
+    tasks["norm"] = [](esh::JobContext& ctx, const std::vector<std::string>& args) {
+        std::string root = ".";
+        std::string output;
+        bool timings = false;
+        bool fix = false;
+        norm::ReportFormat format = norm::ReportFormat::Console;
+        for (std::size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--timings") {
+                timings = true;
+            } else if (args[i] == "--fix") {
+                fix = true;
+            } else if (args[i].compare(0, 9, "--format=") == 0) {
+                if (!norm::parseReportFormat(args[i].substr(9), format)) {
+                    ctx.out() << "norm: unknown format '" << args[i].substr(9)
+                              << "' (console, grouped, json, sarif, junit)\n";
+                    return;
+                }
+            } else if (args[i].compare(0, 9, "--output=") == 0) {
+                output = args[i].substr(9);
+            } else {
+                root = args[i];
+            }
+        }
+
+        const norm::Config cfg = load_norm_config(ctx, root);
+        if (fix) norm_fix(ctx, root, cfg, 50);
+        if (ctx.cancelled()) return;
+
+        int fd = -1;
+        if (!output.empty()) {
+            fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                ctx.out() << "norm: cannot open " << output << ": " << std::strerror(errno) << "\n";
+                return;
+            }
+        }
+        auto writer = fd >= 0 ? norm::ReportWriter::create(format, fd) : norm::ReportWriter::create(format, ctx.out());
+        auto issues = norm_with_progress(ctx, root, cfg, fix ? 50 : 0, 100, timings, writer.get());
+        if (fd >= 0) {
+            close(fd);
+            ctx.out() << "Norm report written to " << output << " (" << writer->bytesWritten() << " bytes, "
+                      << issues.size() << " issue(s))\n";
+        }
+        ESH_LOG_INFO() << "Norm check on " << root << " found " << issues.size() << " issue(s)";
     };
-    helpTexts["grademe"] = "Simulate grading (placeholder)";
+    helpTexts["norm"] = "Run the norm checker: norm [--fix] [--timings] [--format=console|grouped|json|sarif|junit] "
+                        "[--output=FILE] [path] (rules from .normrc), append & to run in background";
 
     commands["mode"] = [this](const std::vector<std::string>&) { modeMenu(); };
     helpTexts["mode"] = "Switch mode (Project/Evaluation/Sandbox)";
 
-    commands["status"] = [this](const std::vector<std::string>&) { showDashboard(); ESH_LOG_DEBUG() << "Status displayed"; };
-    helpTexts["status"] = "Show dashboard";
+    commands["status"] = [this](const std::vector<std::string>& args) {
+        showDashboard();
+        ESH_LOG_DEBUG() << "Status displayed";
+        if (args.size() > 1 && args[1] == "-w") watchDashboard();
+    };
+    helpTexts["status"] = "Show dashboard (status -w: keep it updating)";
+
+    // Stacks go to /tmp by default: the exam directory is watched and snapshotted
+    commands["profile"] = [](const std::vector<std::string>& args) {
+        using Profiler = esh::DebugTools::Profiler;
+        const std::string sub = args.size() > 1 ? args[1] : "status";
+        if (sub == "start") {
+            unsigned hz = args.size() > 2 ? static_cast<unsigned>(std::strtoul(args[2].c_str(), nullptr, 10)) : 99;
+            std::string error;
+            if (Profiler::start(hz, &error)) std::cout << "Profiling at " << hz << " Hz, 'profile stop' to dump.\n";
+            else std::cout << "profile: " << error << "\n";
+        } else if (sub == "stop") {
+            Profiler::stop();
+            std::string path = args.size() > 2 ? args[2] : "/tmp/exam-shell." + std::to_string(getpid()) + ".folded";
+            std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+            if (!out) {
+                std::cout << "profile: cannot write " << path << "\n";
+                return;
+            }
+            std::size_t n = Profiler::dump(out);
+            std::cout << n << " sample(s) written to " << path << " (flamegraph.pl " << path << " > profile.svg)\n";
+        } else if (sub == "status") {
+            std::cout << (Profiler::running() ? "Profiling, " : "Not profiling, ") << Profiler::samples()
+                      << " sample(s)\n";
+        } else {
+            std::cout << "usage: profile [start [hz] | stop [file] | status]\n";
+        }
+    };
+    helpTexts["profile"] = "Sample CPU stacks: profile start [hz], profile stop [file] (collapsed stacks), profile status";
+
+    commands["heap"] = [](const std::vector<std::string>& args) {
+        if (args.size() > 1 && args[1] == "reset") {
+            esh::alloc::reset();
+            std::cout << "Allocation counters reset.\n";
+            return;
+        }
+        std::size_t top = args.size() > 1 ? std::strtoul(args[1].c_str(), nullptr, 10) : 15;
+        esh::DebugTools::heapReport(std::cout, top ? top : 15);
+    };
+    helpTexts["heap"] = "Allocations per command/scope: heap [top], heap reset (build with ALLOC_TRACKING=1)";
+
+    commands["hexdump"] = [](const std::vector<std::string>& args) {
+        esh::HexdumpOptions opt;
+        unsigned long long skip = 0, length = ~0ull;
+        std::string path;
+        bool bad = false;
+        for (std::size_t i = 1; i < args.size() && !bad; ++i) {
+            const std::string& a = args[i];
+            char* end = nullptr;
+            if ((a == "-s" || a == "-n" || a == "-w") && i + 1 < args.size()) {
+                unsigned long long n = std::strtoull(args[++i].c_str(), &end, 0);   // 0x... accepted
+                bad = *end != '\0';
+                if (a == "-s") skip = n;
+                else if (a == "-n") length = n;
+                else opt.width = static_cast<std::size_t>(n);
+            } else if (a == "-v") {
+                opt.collapse = false;
+            } else if (path.empty() && a[0] != '-') {
+                path = a;
+            } else {
+                bad = true;
+            }
+        }
+        if (bad || path.empty() || opt.width == 0 || opt.width > 64) {
+            std::cout << "usage: hexdump [-s offset] [-n length] [-w width] [-v] file\n";
+            return;
+        }
+        esh::MappedFile file(path);
+        if (!file.ok()) {
+            std::cout << "hexdump: cannot read " << path << "\n";
+            return;
+        }
+        skip = std::min<unsigned long long>(skip, file.size());
+        length = std::min<unsigned long long>(length, file.size() - skip);
+        opt.baseOffset = skip;
+        std::cout << std::flush;
+        esh::DebugTools::hexdumpTo(STDOUT_FILENO, file.data() + skip, static_cast<std::size_t>(length), opt);
+    };
+    helpTexts["hexdump"] = "Dump a file like hexdump -C: hexdump [-s offset] [-n length] [-w width] [-v] file";
 
     commands["clear"] = [](const std::vector<std::string>&) { std::cout << "\033[2J\033[H"; };
     helpTexts["clear"] = "Clear the screen";
+
+    commands["snapshot"] = [this](const std::vector<std::string>&) {
+        if (exerciseDir().empty()) {
+            std::cout << "snapshot: no exercise directory here (rendu/, or a directory named like an exercise)\n";
+            return;
+        }
+        if (snapshotWorkspace(true)) std::cout << "Snapshot of " << workspace.root() << " taken.\n";
+    };
+    helpTexts["snapshot"] = "Snapshot the exercise directory again (taken once per exercise on mode entry)";
+
+    commands["rollback"] = [this](const std::vector<std::string>&) {
+        if (!workspace.active()) {
+            std::cout << "No workspace snapshot, use 'mode' or 'snapshot' in an exercise directory first.\n";
+            return;
+        }
+        esh::WorkspaceSnapshot::Stats st;
+        bool ok = workspace.rollback(&st);
+        std::cout << "Rollback: " << st.restored << " file(s) restored, " << st.removed
+                  << " removed in " << std::fixed << std::setprecision(2) << st.ms << " ms"
+                  << std::defaultfloat << (ok ? "" : " (with errors, see log)") << "\n";
+    };
+    helpTexts["rollback"] = "Reset the exercise directory to its snapshot";
+
+    setupJobBuiltins();
+}
+
+// Job control: jobs / fg / wait / cancel
+void Shell::setupJobBuiltins() {
+    // Default job id: the most recent one
+    auto pickJob = [this](const std::vector<std::string>& args) -> int {
+        if (args.size() > 1) return std::atoi(args[1].c_str());
+        auto all = jobs.list();
+        return all.empty() ? 0 : all.back()->id;
+    };
+    commands["jobs"] = [this](const std::vector<std::string>&) {
+        auto all = jobs.list();
+        if (all.empty()) {
+            std::cout << "No jobs.\n";
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& job : all) {
+            esh::Job::State st = job->state.load();
+            std::cout << "[" << job->id << "] " << std::left << std::setw(10) << esh::JobManager::stateName(st);
+            if (st == esh::Job::State::Running) {
+                int pct = job->progress.load();
+                std::string label;
+                {
+                    std::lock_guard<std::mutex> lock(job->labelMx);
+                    label = job->label;
+                }
+                long secs = std::chrono::duration_cast<std::chrono::seconds>(now - job->started).count();
+                std::cout << (pct >= 0 ? std::to_string(pct) + "% " : std::string()) << label << " " << secs << "s  ";
+            }
+            std::cout << job->command << "\n";
+        }
+    };
+    helpTexts["jobs"] = "List background jobs";
+
+    commands["fg"] = [this, pickJob](const std::vector<std::string>& args) {
+        int id = pickJob(args);
+        auto job = jobs.find(id);
+        if (!job) {
+            std::cout << "fg: no such job\n";
+            return;
+        }
+        waitUntil([&job] { return job->finishedState(); });
+        if (!job->finishedState()) {
+            std::cout << "[" << id << "] still running in background\n";
+            return;
+        }
+        job->reported = true;
+        std::cout << job->output.str();
+        std::cout << "[" << id << "] " << esh::JobManager::stateName(job->state.load()) << "  " << job->command << "\n";
+        jobs.reap(id);
+    };
+    helpTexts["fg"] = "Wait for a job and show its output: fg [id]";
+
+    commands["wait"] = [this](const std::vector<std::string>& args) {
+        std::vector<std::shared_ptr<esh::Job>> waitFor;
+        if (args.size() > 1) {
+            auto job = jobs.find(std::atoi(args[1].c_str()));
+            if (!job) {
+                std::cout << "wait: no such job " << args[1] << "\n";
+                return;
+            }
+            waitFor.push_back(job);
+        } else {
+            waitFor = jobs.list();
+        }
+        waitUntil([&waitFor] {
+            return std::all_of(waitFor.begin(), waitFor.end(),
+                               [](const std::shared_ptr<esh::Job>& j) { return j->finishedState(); });
+        });
+        if (interrupted) return;
+        std::cout << finishedJobNotices();
+    };
+    helpTexts["wait"] = "Wait for one job or all jobs: wait [id]";
+
+    commands["cancel"] = [this](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "usage: cancel <id> [-9]\n";
+            return;
+        }
+        int sig = (args.size() > 2 && args[2] == "-9") ? SIGKILL : SIGTERM;
+        if (!jobs.cancel(std::atoi(args[1].c_str()), sig)) {
+            std::cout << "cancel: no running job " << args[1] << "\n";
+        }
+    };
+    helpTexts["cancel"] = "Cancel a job and its child processes: cancel <id> [-9]";
+}
+
+// Announcements for background jobs that finished since the last prompt
+std::string Shell::finishedJobNotices() {
+    std::ostringstream out;
+    for (const auto& job : jobs.takeFinished()) {
+        out << "[" << job->id << "] " << esh::JobManager::stateName(job->state.load())
+            << "  " << job->command;
+        if (job->output.tellp() > 0) out << "   (fg " << job->id << " to see output)";
+        else jobs.reap(job->id);
+        out << "\n";
+    }
+    return out.str();
+}
+
+void Shell::waitUntil(const std::function<bool()>& done) {
+    interrupted = false;
+    loop.runUntil([&] { return interrupted || !running || done(); });
+}
+
+// Foreground tasks run on their own thread while the loop keeps serving
+// signals and timers; background ones go to the executor
+void Shell::runTask(const std::vector<std::string>& tokens, bool background) {
+    Task task = tasks[tokens[0]];
+    std::string command;
+    for (const auto& t : tokens) {
+        if (!command.empty()) command += ' ';
+        command += t;
+    }
+    auto bound = [this, task, tokens, background](esh::JobContext& ctx) {
+        ESH_ALLOC_SCOPE_DYNAMIC(tokens[0]);
+        task(ctx, tokens);
+        // A replay holds the next input back until the job got this far
+        if (background) session.jobDone(ctx.job().id);
+    };
+    if (!background) {
+        runForeground(command, bound);
+        return;
+    }
+    int id = jobs.submit(command, bound);
+    std::cout << "[" << id << "] " << command << "\n";
+}
+
+bool Shell::runForeground(const std::string& command, esh::JobManager::Task task) {
+    foreground = jobs.runForeground(command, std::move(task));
+    auto job = foreground;
+    loop.runUntil([&job] { return job->finishedState(); });
+    foreground.reset();
+    if (job->state.load() == esh::Job::State::Cancelled) {
+        std::cout << "\n ** Interrupted ** \n";
+        ESH_LOG_INFO() << "Foreground task interrupted: " << command;
+        return false;
+    }
+    return true;
 }
 
 // Dispatch tokens to a handler
 void Shell::handleTokens(const std::vector<std::string>& tokens) {
     if (tokens.empty()) return;
-    ESH_LOG_DEBUG() << "Dispatch command=" << tokens[0] << " argc=" << (tokens.size() - 1);
-    auto it = commands.find(tokens[0]);
+
+    // Trailing "&" (separate or glued to the last word) sends a task to the background
+    std::vector<std::string> args = tokens;
+    bool background = false;
+    if (args.back() == "&") {
+        background = true;
+        args.pop_back();
+    } else if (args.back().size() > 1 && args.back().back() == '&') {
+        background = true;
+        args.back().pop_back();
+    }
+    if (args.empty()) return;
+
+    ESH_LOG_DEBUG() << "Dispatch command=" << args[0] << " argc=" << (args.size() - 1) << (background ? " &" : "");
+    shell_metrics().commands.inc();
+    if (tasks.count(args[0])) {
+        runTask(args, background);
+        return;
+    }
+    auto it = commands.find(args[0]);
     if (it != commands.end()) {
-        it->second(tokens);
+        if (background) {
+            std::cout << "'" << args[0] << "' cannot run in the background\n";
+            return;
+        }
+        ESH_ALLOC_SCOPE_DYNAMIC(args[0]);
+        it->second(args);
     } else {
         std::cout << "           **Unknown command**     type \033[1;33mhelp\033[0m for more help\n";
-        ESH_LOG_WARN() << "Unknown command: " << tokens[0];
+        shell_metrics().unknown.inc();
+        ESH_LOG_WARN() << "Unknown command: " << args[0];
     }
 }
 
+Shell::Dispatched Shell::measuredDispatch(const std::string& line, bool forward) {
+    auto tokens = split(line);
+    esh::OutputProbe probe(std::cout, forward);
+    auto start = std::chrono::steady_clock::now();
+    handleTokens(tokens);
+    std::cout.flush();
+    return Dispatched{std::chrono::steady_clock::now() - start, probe.bytes(), probe.crc()};
+}
+
+// Commands that read their own answers from the terminal; those answers are
+// not in the recording, the Mode records that follow stand in for "mode"
+static const std::set<std::string> kInteractiveCommands = {"mode", "finish"};
+
+int Shell::replay(const esh::RecordedSession& recorded, std::ostream& report) {
+    ESH_LOG_INFO() << "Replaying " << recorded.steps.size() << " step(s) in " << originalCwd;
+
+    setupBuiltins();
+    sessionStart = std::chrono::system_clock::now();
+    esh::ReplayReport result;
+    replaying = &result;
+    for (const auto& step : recorded.steps) {
+        if (step.kind == esh::RecordedSession::Step::Kind::JobDone) {
+            auto job = jobs.find(step.job);
+            if (job) loop.runUntil([&job] { return job->finishedState(); });
+            continue;
+        }
+        if (step.kind == esh::RecordedSession::Step::Kind::Mode) {
+            currentMode = static_cast<Mode>(step.mode);
+            std::lock_guard<std::mutex> lock(gradeMx);
+            currentGroup = step.line;
+            continue;
+        }
+        auto tokens = split(step.line);
+        if (!tokens.empty() && kInteractiveCommands.count(tokens[0])) {
+            result.skipped(step.line);
+            continue;
+        }
+        Dispatched d = measuredDispatch(step.line, false);
+        result.line(step, d.latency, d.bytes, d.crc);
+        if (!running) break;
+    }
+    // Background jobs of the session finish before their results are compared
+    loop.runUntil([this] { return jobs.activeCount() == 0; });
+    shutdownJobs();
+    replaying = nullptr;
+    result.finish(recorded);
+
+    result.print(report);
+    restoreEnvironment();
+    esh::metrics::unpublish();
+    ESH_LOG_INFO() << "Replay finished, " << result.divergences() << " divergence(s)";
+    return result.divergences() ? 1 : 0;
+}
+
+// Readline callbacks carry no user pointer
+static Shell* s_active = nullptr;
+void Shell::onLine(char* input) {
+    if (s_active) s_active->acceptLine(input);
+}
+
+void Shell::installPrompt() {
+    currentPrompt = buildPrompt();
+    rl_callback_handler_install(currentPrompt.c_str(), &Shell::onLine);
+    loop.watchFd(STDIN_FILENO, [this] {
+        if (running) rl_callback_read_char();
+    });
+    promptActive = true;
+}
+
+// Swap the prompt under the user's cursor (readline keeps the typed text);
+// returns false when nothing changed so the caller can skip the redraw
+bool Shell::updatePrompt() {
+    std::string prompt = buildPrompt();
+    if (prompt == currentPrompt) return false;
+    currentPrompt.swap(prompt);
+    rl_set_prompt(currentPrompt.c_str());
+    return true;
+}
+
+// Print on the prompt line, then redraw the prompt and pending input below it
+void Shell::printAbovePrompt(const std::string& text) {
+    std::cout << "\r\033[K" << text << std::flush;
+    rl_on_new_line();
+    rl_forced_update_display();
+}
+
+void Shell::onTick() {
+    ShellMetrics& m = shell_metrics();
+    m.jobs.set(static_cast<std::int64_t>(jobs.activeCount()));
+    m.rss.set(static_cast<std::int64_t>(resident_bytes()));
+    m.mode.set(static_cast<std::int64_t>(currentMode.load()));
+    m.uptime.set(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - sessionStart).count());
+    if (liveDashboard) {
+        menu.refreshDashboard(dashboardInfo());
+        std::cout << "\033[2m(live, press Enter to return)\033[0m" << std::flush;
+        return;
+    }
+    if (!promptActive) return;
+    std::string notices = finishedJobNotices();
+    bool changed = updatePrompt();
+    if (!notices.empty()) printAbovePrompt(notices);
+    else if (changed) rl_forced_update_display();
+}
+
+// Ctrl+C: cancel the foreground task (SIGKILL on the second press), end a
+// wait, or drop the line being typed
+void Shell::onInterrupt() {
+    interrupted = true;
+    if (foreground) {
+        jobs.cancel(foreground, foreground->cancelRequested.load() ? SIGKILL : SIGINT);
+        std::cout << "\n" << std::flush;
+        return;
+    }
+    if (!promptActive) {
+        std::cout << "\n" << std::flush;
+        return;
+    }
+    ESH_LOG_DEBUG() << "Input interrupted by SIGINT";
+    std::cout << "\n" << std::flush;
+    rl_replace_line("", 0);
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+// Same callback interface as the prompt, with its own line handler
+struct PendingAnswer {
+    std::string text;
+    bool done = false;
+    bool eof = false;
+};
+static PendingAnswer* s_answer = nullptr;
+static void on_answer(char* input) {
+    // Removed here, or readline would print the prompt again for the next line
+    rl_callback_handler_remove();
+    if (!s_answer) return;
+    s_answer->done = true;
+    if (!input) {
+        s_answer->eof = true;
+        return;
+    }
+    s_answer->text = input;
+    free(input);
+}
+
+bool Shell::readAnswer(const std::string& prompt, std::string& out) {
+    PendingAnswer answer;
+    s_answer = &answer;
+    rl_callback_handler_install(prompt.c_str(), &on_answer);
+    loop.watchFd(STDIN_FILENO, [&answer] {
+        if (!answer.done) rl_callback_read_char();
+    });
+    waitUntil([&answer] { return answer.done; });
+    loop.unwatchFd(STDIN_FILENO);
+    s_answer = nullptr;
+    if (!answer.done) {
+        // Ctrl+C or shutdown: drop what was typed
+        rl_replace_line("", 0);
+        rl_callback_handler_remove();
+        return false;
+    }
+    if (answer.eof) return false;
+    out = answer.text;
+    return true;
+}
+
+void Shell::acceptLine(char* input) {
+    // Commands may read input themselves (mode menu, finish): leave callback
+    // mode and stop feeding stdin to readline until the next prompt
+    promptActive = false;
+    loop.unwatchFd(STDIN_FILENO);
+    rl_callback_handler_remove();
+    if (!input) {
+        ESH_LOG_INFO() << "EOF received, exiting loop";
+        running = false;
+        return;
+    }
+    std::string line = trim(input);
+    free(input);
+
+    if (!line.empty()) {
+        add_history(line.c_str());
+        audit.append(esh::AuditEvent::Command, line);
+        if (session.active()) {
+            session.input(line);
+            Dispatched d = measuredDispatch(line, true);
+            session.dispatch(line, d.latency, d.bytes, d.crc);
+        } else {
+            handleTokens(split(line));
+        }
+    }
+    if (!running) return;
+    std::cout << finishedJobNotices();
+    installPrompt();
+}
+
+// Cancel what is still running and keep reaping until it is gone; children
+// that ignore SIGTERM get SIGKILL after two seconds
+void Shell::shutdownJobs() {
+    jobs.cancelAll();
+    int escalate = loop.addTimer(std::chrono::seconds(2), std::chrono::milliseconds(0), [this] {
+        ESH_LOG_WARN() << "Jobs still running at exit, sending SIGKILL";
+        jobs.cancelAll(SIGKILL);
+    });
+    loop.runUntil([this] { return jobs.activeCount() == 0; });
+    loop.removeTimer(escalate);
+    jobs.setLoop(nullptr);
+}
+
 void Shell::run() {
     ESH_LOG_INFO() << "Shell run() entered";
     print_welcome();
 
-    // SIGINT handler (Ctrl+C -> newline + fresh prompt)
-    struct sigaction sa;
-    sa.sa_handler = handle_sigint;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0; // let readline return on SIGINT
-    sigaction(SIGINT, &sa, nullptr);
+    // SIGINT/SIGTERM/SIGHUP are blocked in main() and read here from a signalfd
+    loop.watchSignal(SIGINT, [this] { onInterrupt(); });
+    auto terminate = [this] {
+        ESH_LOG_INFO() << "Termination signal received, closing session";
+        running = false;
+        if (foreground) jobs.cancel(foreground, SIGTERM);
+    };
+    loop.watchSignal(SIGTERM, terminate);
+    loop.watchSignal(SIGHUP, terminate);
+    // Wall-clock aligned, so the prompt clock flips on the second
+    loop.addSecondTick([this] { onTick(); });
+    // The async logger leaves file writes buffered; bound how stale the file gets
+    loop.addTimer(std::chrono::seconds(1), std::chrono::seconds(1), [] { esh::Logger::instance().flush(); });
 
     setupBuiltins();
     sessionStart = std::chrono::system_clock::now();
+    const char* record = std::getenv("ESH_RECORD");
+    if (!(record && std::strcmp(record, "0") == 0)) {
+        // Absolute path, like the audit journal
+        if (session.open(originalCwd + "/.exam-shell.session")) {
+            const char* user = std::getenv("USER");
+            session.start(originalCwd, user ? user : "student");
+        } else {
+            ESH_LOG_WARN() << "Session recording disabled: cannot open .exam-shell.session";
+        }
+    }
+    if (const char* listen = std::getenv("ESH_METRICS_LISTEN")) {
+        std::string error;
+        if (!exporter.start(listen, &error)) ESH_LOG_WARN() << "Metrics exporter disabled: " << error;
+    }
 
     // Fancy startup
-    ui::Menu menu;
     menu.startupAnimation();
-    showDashboard();
+    // Everything from here on is dispatched by the loop: keys, ticks, signals,
+    // child exits, watcher batches and job completions, menus included
+    rl_catch_signals = 0;
+    menu.setLineReader([this](const std::string& prompt, std::string& out) { return readAnswer(prompt, out); });
     modeMenu();
 
-    while (running) {
-        sigint_received = 0;
-        std::string prompt = buildPrompt();
-        char* input = readline(prompt.c_str());
-        if (!input) {
-            if (sigint_received) {
-                ESH_LOG_DEBUG() << "Input interrupted by SIGINT";
-                continue;
-            }
-            ESH_LOG_INFO() << "EOF received, exiting loop";
-            break;
-        }
-        std::string line = input;
-        free(input);
-
-        line = trim(line);
-        if (line.empty()) continue;
-
-        add_history(line.c_str());
-        auto tokens = split(line);
-        handleTokens(tokens);
+    s_active = this;
+    installPrompt();
+    loop.runUntil([this] { return !running; });
+    if (promptActive) {
+        loop.unwatchFd(STDIN_FILENO);
+        rl_callback_handler_remove();
+        promptActive = false;
     }
+    s_active = nullptr;
+    shutdownJobs();
+    session.end();
+    session.close();
+    exporter.stop();
     persistChanges();
+    workspace.discard();
     restoreEnvironment();
+    esh::metrics::unpublish();
     ESH_LOG_INFO() << "Shell run() exited";
-}
\ No newline at end of file
+}
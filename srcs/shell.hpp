@@ -2,13 +2,32 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 #include <functional>
 #include <chrono>
+#include <atomic>
+#include "loop.hpp"
+#include "jobs.hpp"
+#include "journal.hpp"
+#include "watch.hpp"
+#include "env.hpp"
+#include "snapshot.hpp"
+#include "menu.hpp"
+#include "projects.hpp"
+#include "exporter.hpp"
+#include "session.hpp"
+
+namespace esh { struct BenchAccess; }
 
 class Shell {
 public:
-    Shell();
+    // headless: no audit journal and no file watcher, for replay()
+    explicit Shell(bool headless = false);
     void run();
+    // Runs the inputs of a recorded session in the current directory and
+    // writes how it compares to report. Returns 0 when nothing diverged.
+    int replay(const esh::RecordedSession& recorded, std::ostream& report);
 
     enum class Mode {
         Menu,
@@ -18,33 +37,103 @@ public:
     };
 
 private:
+    // bench/bench.cpp times split() and dispatch directly
+    friend struct esh::BenchAccess;
+
     void backupEnvironment();
     void restoreEnvironment();
-    void trackFileChange(const std::string& path);
+    void trackFileChange(const std::string& path, const esh::FileWatcher::Stat& stat);
     void trackEnvChange(const std::string& key, const std::string& value);
     void persistChanges();
+    std::string exerciseDir() const;
+    bool snapshotWorkspace(bool force);
 
     // Built-in framework
     using Handler = std::function<void(const std::vector<std::string>&)>;
+    // Tasks can also run in the background ("cmd &") on the job executor
+    using Task = std::function<void(esh::JobContext&, const std::vector<std::string>&)>;
     void setupBuiltins();
+    void setupJobBuiltins();
+    void runTask(const std::vector<std::string>& tokens, bool background);
+    // Run a job on its own thread while the loop serves Ctrl+C; false if cancelled
+    bool runForeground(const std::string& command, esh::JobManager::Task task);
+    // Run the event loop until done(), Ctrl+C or shutdown
+    void waitUntil(const std::function<bool()>& done);
+    std::string finishedJobNotices();
     void handleTokens(const std::vector<std::string>& tokens);
     std::vector<std::string> split(const std::string& line) const;
+    // handleTokens() on one input line, timed, with a checksum of what it
+    // printed (passed on to the terminal when forward is set)
+    struct Dispatched {
+        std::chrono::nanoseconds latency;
+        std::uint64_t bytes;
+        std::uint32_t crc;
+    };
+    Dispatched measuredDispatch(const std::string& line, bool forward);
 
     // UI
     std::string buildPrompt() const;
+    ui::DashboardInfo dashboardInfo() const;
     void showDashboard() const;
+    void watchDashboard();
     void modeMenu();
+    // Exam of that kind from the registry; false when the user backed out
+    bool pickExam(const char* kind);
+    // name: "<group>/<exercise>", an exercise of the current exam, or empty
+    // for the one named like the working directory
+    const esh::Exercise* findExercise(const std::string& group, const std::string& name) const;
+
+    // Input loop: readline callback interface driven by the event loop, with
+    // a 1 Hz tick for the live status and signals read from a signalfd
+    static void onLine(char* input);   // readline line handler, forwards to acceptLine
+    void acceptLine(char* input);
+    // One answer for a menu or a confirmation, read while the loop keeps
+    // reaping children and serving signals; false on EOF, Ctrl+C or shutdown
+    bool readAnswer(const std::string& prompt, std::string& out);
+    void installPrompt();
+    bool updatePrompt();
+    void printAbovePrompt(const std::string& text);
+    void onTick();
+    void onInterrupt();
+    void shutdownJobs();
+
+    // Everything below is driven from this loop; constructed first, destroyed last
+    esh::EventLoop loop;
+    // Keeps the last drawn frame so redraws only send what changed
+    ui::Menu menu;
+    bool promptActive = false;    // readline owns the terminal
+    bool liveDashboard = false;   // status -w is running
+    bool interrupted = false;     // Ctrl+C since the last waitUntil()
+    std::shared_ptr<esh::Job> foreground;
 
     // State
-    std::map<std::string, std::string> originalEnv;
-    std::vector<std::string> changedFiles;
+    esh::EnvSnapshot originalEnv;
+    std::unordered_map<std::string, esh::FileWatcher::Stat> changedFiles;
+    std::mutex changedMx;  // changedFiles is fed by the watcher sink
     std::map<std::string, std::string> changedEnv;
     std::string originalCwd;
+    esh::Journal audit;  // append-only .shell_audit, written as events happen
+    esh::FileWatcher watcher;
+    esh::WorkspaceSnapshot workspace;  // of exerciseDir(), taken once per exercise, see rollback
+    std::string snapshotKey;           // exam and directory of that snapshot
+    esh::MetricsExporter exporter;     // serves ESH_METRICS_LISTEN when set
+    esh::SessionRecorder session;      // .exam-shell.session unless ESH_RECORD=0
+    esh::ReplayReport* replaying = nullptr;   // set during replay(), gets the child results
 
     // New state
-    Mode currentMode = Mode::Menu;
+    std::atomic<Mode> currentMode{Mode::Menu};
     std::chrono::system_clock::time_point sessionStart;
+    std::chrono::seconds examLimit{0};   // countdown length, 0 when untimed
+    esh::ProjectRegistry projects;       // exams and exercises, see ProjectRegistry::defaultPath
+    std::string currentGroup;            // exam picked in modeMenu, guarded by gradeMx
+    std::string currentPrompt;
+    std::string lastGrade;               // set by grademe, possibly from a job thread
+    mutable std::mutex gradeMx;          // lastGrade, currentGroup
     std::map<std::string, Handler> commands;
+    std::map<std::string, Task> tasks;
     std::map<std::string, std::string> helpTexts;
     bool running = true;
+
+    // Declared last: its destructor joins workers that may still use the state above
+    esh::JobManager jobs;
 };
@@ -0,0 +1,324 @@
+#include "snapshot.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+
+namespace fs = std::filesystem;
+
+static std::int64_t mtime_ns(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+}
+
+// Copy src over dst keeping mode and mtime, so an unchanged restore is
+// indistinguishable from the snapshot on the next rollback.
+// Returns 0 on failure, 1 when reflinked, 2 when data was copied.
+static int clone_file(const std::string& src, const std::string& dst, const struct stat& st, std::uint64_t& bytes) {
+    int in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return 0;
+    int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0 && errno == EACCES) {
+        // Made read-only since the snapshot
+        unlink(dst.c_str());
+        out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    }
+    if (out < 0) {
+        close(in);
+        return 0;
+    }
+
+    int how = 0;
+    if (ioctl(out, FICLONE, in) == 0) {
+        how = 1;
+    } else {
+        off_t left = st.st_size;
+        while (left > 0) {
+            ssize_t n = copy_file_range(in, nullptr, out, nullptr, static_cast<std::size_t>(left), 0);
+            if (n <= 0) break;
+            left -= n;
+        }
+        // Old kernels / odd filesystems: plain read/write for whatever is left
+        char buf[64 * 1024];
+        while (left > 0) {
+            ssize_t n = read(in, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || write(out, buf, static_cast<std::size_t>(n)) != n) break;
+            left -= n;
+        }
+        if (left == 0) {
+            how = 2;
+            bytes += static_cast<std::uint64_t>(st.st_size);
+        }
+    }
+    if (how) {
+        fchmod(out, st.st_mode & 07777);
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        futimens(out, times);
+    }
+    close(in);
+    close(out);
+    return how;
+}
+
+void WorkspaceSnapshot::ignore(const std::string& pattern) {
+    if (std::find(_ignore.begin(), _ignore.end(), pattern) == _ignore.end()) _ignore.push_back(pattern);
+}
+
+bool WorkspaceSnapshot::ignored(const std::string& name) const {
+    for (const auto& p : _ignore) {
+        if (fnmatch(p.c_str(), name.c_str(), FNM_PERIOD) == 0) return true;
+    }
+    return false;
+}
+
+// Calls fn(relPath, lstat) for every regular file, symlink and directory
+// under root, skipping ignored names; symlinks are not followed
+template <typename Fn>
+void WorkspaceSnapshot::walk(const std::string& root, Fn fn) const {
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+         it != end; it.increment(ec)) {
+        if (ec) break;
+        if (ignored(it->path().filename().string())) {
+            if (it->is_directory(ec)) it.disable_recursion_pending();
+            continue;
+        }
+        struct stat st;
+        if (lstat(it->path().c_str(), &st) != 0) continue;
+        if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode)) continue;
+        fn(it->path().lexically_relative(root).string(), st);
+    }
+}
+
+static std::string link_target(const std::string& path) {
+    std::error_code ec;
+    return fs::read_symlink(path, ec).string();
+}
+
+// The store's copy keeps the source's size, mtime and mode (see clone_file)
+// until the source changes
+static bool same_copy(const struct stat& saved, const struct stat& st) {
+    return S_ISREG(saved.st_mode) && saved.st_size == st.st_size && mtime_ns(saved) == mtime_ns(st) &&
+           saved.st_mode == st.st_mode;
+}
+
+bool WorkspaceSnapshot::take(const std::string& root, const std::string& store, Stats* stats,
+                             const Progress& progress) {
+    auto t0 = std::chrono::steady_clock::now();
+    // The same store is kept for its unchanged copies, another one is dropped
+    if (store == _store) {
+        _files.clear();
+        _dirs.clear();
+        _root.clear();
+    } else {
+        discard();
+    }
+
+    std::error_code ec;
+    fs::create_directories(store, ec);
+    if (ec) {
+        ESH_LOG_ERROR() << "Cannot create snapshot store " << store << ": " << ec.message();
+        return false;
+    }
+    _store = store;
+    // The store may live inside the workspace; never snapshot it
+    ignore(fs::path(store).filename().string());
+
+    Stats s;
+    bool ok = true;
+    bool cancelled = false;
+    walk(root, [&](const std::string& rel, const struct stat& st) {
+        if (cancelled) return;
+        const std::string dst = store + "/" + rel;
+        struct stat saved;
+        const bool stored = lstat(dst.c_str(), &saved) == 0;
+        if (S_ISDIR(st.st_mode)) {
+            // A file that became a directory since the last snapshot
+            if (stored && !S_ISDIR(saved.st_mode)) unlink(dst.c_str());
+            _dirs[rel] = st.st_mode & 07777;
+            return;
+        }
+        FileState state{static_cast<std::uint64_t>(st.st_size), mtime_ns(st), st.st_mode, std::string()};
+        if (S_ISLNK(st.st_mode)) {
+            state.target = link_target(root + "/" + rel);
+            _files[rel] = std::move(state);
+            return;
+        }
+        if (stored && same_copy(saved, st)) {
+            ++s.reused;
+        } else {
+            std::error_code dirEc;
+            if (stored && S_ISDIR(saved.st_mode)) fs::remove_all(dst, dirEc);
+            fs::create_directories(fs::path(dst).parent_path(), dirEc);
+            int how = clone_file(root + "/" + rel, dst, st, s.bytes);
+            if (!how) {
+                ESH_LOG_WARN() << "Snapshot skipped " << rel << ": " << std::strerror(errno);
+                ok = false;
+                return;
+            }
+            how == 1 ? ++s.reflinked : ++s.copied;
+        }
+        _files[rel] = std::move(state);
+        s.files = _files.size();
+        if (progress && !progress(s)) cancelled = true;
+    });
+    s.files = _files.size();
+    s.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (stats) *stats = s;
+    if (cancelled) {
+        ESH_LOG_INFO() << "Workspace snapshot of " << root << " cancelled after " << s.files << " file(s)";
+        _files.clear();
+        _dirs.clear();
+        return false;
+    }
+    // Copies of files deleted since the last snapshot
+    prune(store);
+    _root = root;
+
+    ESH_LOG_INFO() << "Workspace snapshot of " << root << ": " << s.files << " file(s), " << _dirs.size()
+                   << " dir(s), " << s.reflinked << " reflinked, " << s.copied << " copied, " << s.reused
+                   << " unchanged in " << s.ms << " ms";
+    return ok;
+}
+
+// Remove whatever the store holds that the snapshot does not know
+void WorkspaceSnapshot::prune(const std::string& store) const {
+    std::error_code ec;
+    std::vector<fs::path> stale;
+    for (fs::recursive_directory_iterator it(store, ec), end; it != end; it.increment(ec)) {
+        if (ec) break;
+        const std::string rel = it->path().lexically_relative(store).string();
+        const fs::file_type type = it->symlink_status(ec).type();
+        const bool dir = type == fs::file_type::directory;
+        bool known;
+        if (dir) {
+            known = _dirs.count(rel) != 0;
+        } else {
+            auto f = _files.find(rel);
+            known = f != _files.end() && S_ISREG(f->second.mode) && type == fs::file_type::regular;
+        }
+        if (known) continue;
+        stale.push_back(it->path());
+        if (dir) it.disable_recursion_pending();
+    }
+    for (const auto& p : stale) fs::remove_all(p, ec);
+}
+
+// Put a deleted or replaced entry back from the store
+bool WorkspaceSnapshot::restore(const std::string& rel, const FileState& state, Stats& s) {
+    const std::string dst = _root + "/" + rel;
+    if (S_ISLNK(state.mode)) return symlink(state.target.c_str(), dst.c_str()) == 0;
+    struct stat saved;
+    std::string src = _store + "/" + rel;
+    return stat(src.c_str(), &saved) == 0 && clone_file(src, dst, saved, s.bytes);
+}
+
+bool WorkspaceSnapshot::rollback(Stats* stats) {
+    if (!active()) return false;
+    auto t0 = std::chrono::steady_clock::now();
+    Stats s;
+    s.files = _files.size();
+    bool ok = true;
+
+    // Pass 1: stat the live tree; remove what is new or changed type, restore
+    // modified files and permissions in place
+    std::unordered_set<std::string> seen;
+    seen.reserve(_files.size() + _dirs.size());
+    std::vector<std::string> newDirs;
+    walk(_root, [&](const std::string& rel, const struct stat& st) {
+        const std::string path = _root + "/" + rel;
+        if (S_ISDIR(st.st_mode)) {
+            auto dir = _dirs.find(rel);
+            if (dir == _dirs.end()) {
+                newDirs.push_back(rel);
+                return;
+            }
+            seen.insert(rel);
+            if ((st.st_mode & 07777) != dir->second) chmod(path.c_str(), dir->second);
+            return;
+        }
+        auto it = _files.find(rel);
+        const bool sameType = it != _files.end() && (it->second.mode & S_IFMT) == (st.st_mode & S_IFMT);
+        if (!sameType || (S_ISLNK(st.st_mode) && link_target(path) != it->second.target)) {
+            // New, or replaced by another kind of entry or link: pass 2 puts the old one back
+            if (unlink(path.c_str()) == 0 && it == _files.end()) ++s.removed;
+            return;
+        }
+        seen.insert(rel);
+        if (S_ISLNK(st.st_mode)) return;
+        const FileState& was = it->second;
+        if (was.size == static_cast<std::uint64_t>(st.st_size) && was.mtimeNs == mtime_ns(st)) {
+            if (was.mode == st.st_mode) return;
+            // Only the permissions changed
+            if (chmod(path.c_str(), was.mode & 07777) == 0) ++s.restored;
+            else ok = false;
+            return;
+        }
+        if (!restore(rel, was, s)) {
+            ok = false;
+            return;
+        }
+        ++s.restored;
+    });
+
+    // Directories created since the snapshot, deepest first; their content
+    // was new too and is gone by now unless it was ignored
+    std::sort(newDirs.begin(), newDirs.end(),
+              [](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+    for (const auto& d : newDirs) {
+        if (rmdir((_root + "/" + d).c_str()) == 0) ++s.removed;
+        else ESH_LOG_WARN() << "Rollback kept new directory " << d << ": " << std::strerror(errno);
+    }
+
+    // Pass 2: bring back directories, then files and links deleted since the snapshot
+    std::vector<std::string> missingDirs;
+    for (const auto& kv : _dirs) {
+        if (!seen.count(kv.first)) missingDirs.push_back(kv.first);
+    }
+    std::sort(missingDirs.begin(), missingDirs.end(),
+              [](const std::string& a, const std::string& b) { return a.size() < b.size(); });
+    for (const auto& d : missingDirs) {
+        // Writable until its content is back; the saved mode is set below
+        if (mkdir((_root + "/" + d).c_str(), 0700) != 0 && errno != EEXIST) ok = false;
+        else ++s.restored;
+    }
+    for (const auto& kv : _files) {
+        if (seen.count(kv.first)) continue;
+        if (!restore(kv.first, kv.second, s)) {
+            ok = false;
+            continue;
+        }
+        ++s.restored;
+    }
+    for (const auto& d : missingDirs) chmod((_root + "/" + d).c_str(), _dirs[d]);
+
+    s.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    ESH_LOG_INFO() << "Workspace rollback: " << s.restored << " restored, " << s.removed
+                   << " removed in " << s.ms << " ms";
+    if (stats) *stats = s;
+    return ok;
+}
+
+void WorkspaceSnapshot::discard() {
+    if (!_store.empty()) {
+        std::error_code ec;
+        fs::remove_all(_store, ec);
+    }
+    _files.clear();
+    _dirs.clear();
+    _root.clear();
+    _store.clear();
+}
+
+} // namespace esh
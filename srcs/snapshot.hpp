@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace esh {
+
+// Point-in-time copy of the exam workspace that can be rolled back.
+// Files are cloned into a store directory with FICLONE (reflink, copy-on-write
+// on btrfs/xfs) and fall back to copy_file_range elsewhere; symlinks and
+// directories are recorded with their target and permissions. Taking a
+// snapshot again into the same store keeps the stored copy of every file whose
+// size, mtime and mode did not change, so only modified files are copied. Rollback only
+// stats the tree and copies back the files whose size or mtime changed, so its
+// cost grows with the number of changed files, not with the workspace size.
+// Everything under root that the snapshot does not know is deleted by a
+// rollback: root has to be a directory the shell owns, never a home.
+class WorkspaceSnapshot {
+public:
+    struct Stats {
+        std::size_t files = 0;      // files covered by the snapshot
+        std::size_t reflinked = 0;  // cloned without copying data
+        std::size_t copied = 0;     // copied through copy_file_range / read+write
+        std::size_t reused = 0;     // unchanged since the store's copy, not copied again
+        std::size_t restored = 0;   // rollback: changed or deleted entries put back
+        std::size_t removed = 0;    // rollback: files, links and directories created since the snapshot
+        std::uint64_t bytes = 0;    // data bytes copied
+        double ms = 0;
+    };
+
+    // fnmatch() patterns for whole path components that are neither saved
+    // nor rolled back
+    void ignore(const std::string& pattern);
+
+    // Called after each file with the stats so far; returning false cancels
+    using Progress = std::function<bool(const Stats&)>;
+
+    // A cancelled take leaves no active snapshot but keeps the store, so the
+    // next take only copies what is missing or changed
+    bool take(const std::string& root, const std::string& store, Stats* stats = nullptr,
+              const Progress& progress = nullptr);
+    bool rollback(Stats* stats = nullptr);
+    void discard();
+
+    bool active() const noexcept { return !_root.empty(); }
+    const std::string& root() const noexcept { return _root; }
+
+private:
+    struct FileState {
+        std::uint64_t size = 0;
+        std::int64_t mtimeNs = 0;
+        std::uint32_t mode = 0;   // st_mode: type and permissions
+        std::string target;       // symlinks
+    };
+
+    bool ignored(const std::string& name) const;
+    bool restore(const std::string& rel, const FileState& state, Stats& s);
+    void prune(const std::string& store) const;
+    template <typename Fn> void walk(const std::string& root, Fn fn) const;
+
+    std::string _root;
+    std::string _store;
+    std::unordered_map<std::string, FileState> _files;   // regular files and symlinks
+    std::unordered_map<std::string, std::uint32_t> _dirs;   // permissions
+    std::vector<std::string> _ignore;
+};
+
+} // namespace esh
@@ -0,0 +1,130 @@
+#include "template.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+
+namespace esh {
+
+Template::Template(std::string source)
+: _source(std::move(source)) {
+    const std::string_view src(_source);
+    std::size_t lit = 0;
+    std::size_t i = 0;
+    while ((i = src.find("{{", i)) != std::string_view::npos) {
+        std::size_t end = src.find("}}", i + 2);
+        if (end == std::string_view::npos) break;
+
+        std::size_t s = i + 2, e = end;
+        while (s < e && std::isspace(static_cast<unsigned char>(src[s]))) ++s;
+        while (e > s && std::isspace(static_cast<unsigned char>(src[e - 1]))) --e;
+        std::string_view key = src.substr(s, e - s);
+
+        if (i > lit) _segments.push_back({lit, i - lit, -1});
+        auto it = _index.find(key);
+        int id;
+        if (it == _index.end()) {
+            id = static_cast<int>(_fallback.size());
+            _index.emplace(key, id);
+            _fallback.push_back("{{" + std::string(key) + "}}");
+        } else {
+            id = it->second;
+        }
+        _segments.push_back({0, 0, id});
+        i = lit = end + 2;
+    }
+    if (lit < src.size()) _segments.push_back({lit, src.size() - lit, -1});
+}
+
+Template::Bindings::Bindings(const Template& tpl)
+: _tpl(&tpl), _values(tpl.slotCount()), _bound(tpl.slotCount(), false) {}
+
+Template::Bindings& Template::Bindings::set(int slot, std::string_view value) {
+    if (slot >= 0 && static_cast<std::size_t>(slot) < _values.size()) {
+        _values[slot] = value;
+        _bound[slot] = true;
+    }
+    return *this;
+}
+
+Template::Bindings& Template::Bindings::set(std::string_view name, std::string_view value) {
+    return set(_tpl->slot(name), value);
+}
+
+Template::Bindings Template::bind(const std::map<std::string, std::string>& vars) const {
+    Bindings b(*this);
+    for (const auto& kv : vars) b.set(kv.first, kv.second);
+    return b;
+}
+
+int Template::slot(std::string_view name) const {
+    auto it = _index.find(name);
+    return it == _index.end() ? -1 : it->second;
+}
+
+std::string_view Template::piece(const Segment& s, const Bindings& b) const {
+    if (s.slot < 0) return std::string_view(_source).substr(s.offset, s.length);
+    if (b._bound[s.slot]) return b._values[s.slot];
+    return _fallback[s.slot];
+}
+
+std::size_t Template::renderedSize(const Bindings& b) const {
+    std::size_t n = 0;
+    for (const auto& s : _segments) n += piece(s, b).size();
+    return n;
+}
+
+std::string Template::render(const Bindings& b) const {
+    std::string out;
+    out.resize(renderedSize(b));
+    char* p = &out[0];
+    for (const auto& s : _segments) {
+        std::string_view v = piece(s, b);
+        p = std::copy(v.begin(), v.end(), p);
+    }
+    return out;
+}
+
+void Template::render(const Bindings& b, std::ostream& os) const {
+    for (const auto& s : _segments) {
+        std::string_view v = piece(s, b);
+        os.write(v.data(), static_cast<std::streamsize>(v.size()));
+    }
+}
+
+bool Template::render(const Bindings& b, int fd) const {
+    const std::size_t kBatch = std::min<std::size_t>(IOV_MAX, 256);
+    std::vector<struct iovec> iov;
+    iov.reserve(std::min(kBatch, _segments.size()));
+
+    auto flush = [&]() -> bool {
+        std::size_t first = 0;
+        while (first < iov.size()) {
+            ssize_t n = writev(fd, iov.data() + first, static_cast<int>(iov.size() - first));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            // Skip fully written vectors, trim a partially written one
+            std::size_t left = static_cast<std::size_t>(n);
+            while (first < iov.size() && left >= iov[first].iov_len) left -= iov[first++].iov_len;
+            if (left) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+            }
+        }
+        iov.clear();
+        return true;
+    };
+
+    for (const auto& s : _segments) {
+        std::string_view v = piece(s, b);
+        if (v.empty()) continue;
+        iov.push_back({const_cast<char*>(v.data()), v.size()});
+        if (iov.size() == kBatch && !flush()) return false;
+    }
+    return flush();
+}
+
+} // namespace esh
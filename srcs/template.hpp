@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <ostream>
+#include <cstddef>
+
+namespace esh {
+
+// {{key}} template compiled once into literal and slot segments.
+// Rendering walks the segment list: the output size is known up front, so
+// render() allocates exactly once, and the streaming overloads never build
+// the whole result in memory.
+// Unbound placeholders are rendered back as {{key}} (key trimmed).
+class Template {
+public:
+    explicit Template(std::string source);
+    // _index views into _source, which a copy or move would not carry along
+    // (short strings move their bytes): a template stays where it was built
+    Template(const Template&) = delete;
+    Template& operator=(const Template&) = delete;
+
+    // Values for every slot; views must outlive rendering
+    class Bindings {
+    public:
+        Bindings& set(std::string_view name, std::string_view value);
+        Bindings& set(int slot, std::string_view value);
+    private:
+        friend class Template;
+        explicit Bindings(const Template& tpl);
+        const Template* _tpl;
+        std::vector<std::string_view> _values;
+        std::vector<bool> _bound;
+    };
+
+    Bindings bind() const { return Bindings(*this); }
+    Bindings bind(const std::map<std::string, std::string>& vars) const;
+
+    // Slot index for a placeholder name, -1 if the template does not use it
+    int slot(std::string_view name) const;
+    std::size_t slotCount() const noexcept { return _fallback.size(); }
+
+    std::size_t renderedSize(const Bindings& b) const;
+    std::string render(const Bindings& b) const;
+    void render(const Bindings& b, std::ostream& os) const;
+    // Streams with writev() in batches; returns false on a write error
+    bool render(const Bindings& b, int fd) const;
+
+private:
+    struct Segment {
+        std::size_t offset;   // literal: position in _source
+        std::size_t length;
+        int slot;             // -1 for a literal
+    };
+    std::string_view piece(const Segment& s, const Bindings& b) const;
+
+    std::string _source;
+    std::vector<Segment> _segments;
+    std::unordered_map<std::string_view, int> _index;   // keys view into _source
+    std::vector<std::string> _fallback;                 // "{{key}}" per slot
+};
+
+} // namespace esh
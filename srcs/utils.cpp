@@ -1,4 +1,7 @@
+#include "template.hpp"
+#include "alloc.hpp"
 #include <unistd.h>
+#include <fcntl.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -31,28 +34,12 @@ std::map<std::string, std::string> get_env_map() {
 
 // Render a template with {{key}} placeholders replaced by vars[key].
 // Unknown placeholders are left as-is. Spaces around keys are trimmed.
+// One-shot convenience: callers rendering the same template repeatedly should
+// keep an esh::Template around instead of reparsing it here.
 std::string render_template(const std::string& tpl, const std::map<std::string, std::string>& vars) {
-    std::string out;
-    out.reserve(tpl.size());
-    for (size_t i = 0; i < tpl.size();) {
-        if (tpl[i] == '{' && i + 1 < tpl.size() && tpl[i + 1] == '{') {
-            size_t end = tpl.find("}}", i + 2);
-            if (end != std::string::npos) {
-                std::string key = tpl.substr(i + 2, end - (i + 2));
-                // trim key
-                size_t s = 0; while (s < key.size() && std::isspace(static_cast<unsigned char>(key[s]))) ++s;
-                size_t e = key.size(); while (e > s && std::isspace(static_cast<unsigned char>(key[e - 1]))) --e;
-                key = key.substr(s, e - s);
-                auto it = vars.find(key);
-                if (it != vars.end()) out += it->second;
-                else out += "{{" + key + "}}";
-                i = end + 2;
-                continue;
-            }
-        }
-        out += tpl[i++];
-    }
-    return out;
+    ESH_ALLOC_SCOPE("render_template");
+    esh::Template t(tpl);
+    return t.render(t.bind(vars));
 }
 
 std::string trim(const std::string& s) {
@@ -72,6 +59,21 @@ void sleep_ms(unsigned ms) {
     usleep(ms * 1000);
 }
 
+// Second field of /proc/self/statm, in pages; read once a second, so no streams
+std::size_t resident_bytes() {
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    char buf[128];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    char* end = nullptr;
+    std::strtoull(buf, &end, 10);
+    unsigned long long pages = std::strtoull(end, nullptr, 10);
+    return static_cast<std::size_t>(pages) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
 bool read_line(const std::string& prompt, std::string& out) {
     char* in = readline(prompt.c_str());
     if (!in) return false; // EOF (Ctrl+D)
@@ -98,6 +100,10 @@ std::vector<std::string> list_files_recursive(const std::string& root, const std
     };
     for (fs::recursive_directory_iterator it(base, fs::directory_options::skip_permission_denied, ec), end; it != end; it.increment(ec)) {
         if (ec) continue;
+        if (it->is_directory(ec)) {
+            if (it->path().filename().string().rfind('.', 0) == 0) it.disable_recursion_pending();
+            continue;
+        }
         if (!it->is_regular_file(ec)) continue;
         if (has_ext(it->path())) out.push_back(it->path().string());
     }
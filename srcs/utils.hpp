@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <cstddef>
 #include <map>
 #include <vector>
 
@@ -13,10 +14,12 @@ std::string render_template(const std::string& tpl, const std::map<std::string,
 std::string trim(const std::string& s);
 void clear_screen();
 void sleep_ms(unsigned ms);
+// Resident set size of this process in bytes (0 when unknown)
+std::size_t resident_bytes();
 // Read one line using readline. Returns false on EOF (Ctrl+D). On success, stores into out.
 bool read_line(const std::string& prompt, std::string& out);
 
-// File helpers
+// File helpers (hidden directories such as .git are not descended into)
 std::vector<std::string> list_files_recursive(const std::string& root, const std::vector<std::string>& exts);
 std::vector<std::string> read_file_lines(const std::string& path);
 std::string read_text_file(const std::string& path);
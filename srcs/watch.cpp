@@ -0,0 +1,371 @@
+#include "watch.hpp"
+#include "log.hpp"
+#include "loop.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esh {
+
+static const std::uint32_t kWatchMask =
+    IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB;
+
+FileWatcher::FileWatcher() {}
+
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+void FileWatcher::ignore(const std::string& pattern) {
+    _ignore.push_back(pattern);
+}
+
+void FileWatcher::setSink(Sink sink, std::chrono::milliseconds interval) {
+    _sink = std::move(sink);
+    _interval = interval;
+}
+
+bool FileWatcher::ignored(const char* name) const {
+    for (const auto& p : _ignore) {
+        if (fnmatch(p.c_str(), name, FNM_PERIOD) == 0) return true;
+    }
+    return false;
+}
+
+std::string FileWatcher::describe(std::uint32_t mask) {
+    std::string out;
+    auto add = [&](std::uint32_t bit, const char* name) {
+        if (!(mask & bit)) return;
+        if (!out.empty()) out += ',';
+        out += name;
+    };
+    add(IN_CREATE, "created");
+    add(IN_CLOSE_WRITE, "written");
+    add(IN_ATTRIB, "attrib");
+    add(IN_MOVED_FROM | IN_MOVED_TO, "moved");
+    add(IN_DELETE, "deleted");
+    return out;
+}
+
+bool FileWatcher::start(const std::string& root, EventLoop* loop) {
+    stop();
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) {
+        ESH_LOG_WARN() << "inotify unavailable: " << std::strerror(errno);
+        return false;
+    }
+    _root = root;
+    _loop = loop;
+    _lastDrain = std::chrono::system_clock::now();
+    // Root first, so changes at the top are seen while the scanner walks the rest
+    addWatch("");
+    _wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_loop) _loop->watchFd(_fd, [this] { onReadable(); });
+    else _reader = std::thread(&FileWatcher::readerLoop, this);
+    _scanning = true;
+    _scanner = std::thread(&FileWatcher::scannerLoop, this);
+    return true;
+}
+
+void FileWatcher::stop() {
+    if (_fd < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        _stopping = true;
+    }
+    _scanCv.notify_all();
+    if (_scanner.joinable()) _scanner.join();
+    if (_loop) {
+        _loop->unwatchFd(_fd);
+        _loop->removeTimer(_flushTimer);
+        _flushTimer = -1;
+        _loop = nullptr;
+        drain();
+        flush();
+    } else {
+        std::uint64_t one = 1;
+        if (write(_wakeFd, &one, sizeof(one)) < 0) {
+            ESH_LOG_WARN() << "Cannot wake file watcher";
+        }
+        if (_reader.joinable()) _reader.join();
+    }
+    if (_overflows.load()) {
+        ESH_LOG_WARN() << "File watcher queue overflowed " << _overflows.load() << " time(s); the tree was rescanned";
+    }
+    close(_wakeFd);
+    close(_fd);
+    _fd = -1;
+    _wakeFd = -1;
+    std::lock_guard<std::mutex> lock(_mx);
+    _dirs.clear();
+    _newDirs.clear();
+    _rescanWanted = false;
+    _stopping = false;
+}
+
+std::size_t FileWatcher::watchCount() const {
+    std::lock_guard<std::mutex> lock(_mx);
+    return _dirs.size();
+}
+
+void FileWatcher::addWatch(const std::string& dir) {
+    std::string full = dir.empty() ? _root : _root + "/" + dir;
+    int wd = inotify_add_watch(_fd, full.c_str(), kWatchMask | IN_ONLYDIR);
+    if (wd < 0) {
+        ESH_LOG_WARN() << "inotify_add_watch failed for " << full << ": " << std::strerror(errno);
+        return;
+    }
+    // An already watched directory keeps its wd; the path is refreshed
+    std::lock_guard<std::mutex> lock(_mx);
+    _dirs[wd] = dir;
+}
+
+// Caller holds _mx
+void FileWatcher::note(const std::string& path, std::uint32_t mask, std::chrono::system_clock::time_point now) {
+    if (_pending.empty()) _firstPending = std::chrono::steady_clock::now();
+    Stat& st = _pending[path];
+    if (st.count++ == 0) st.first = now;
+    st.mask |= mask;
+    st.last = now;
+}
+
+// Runs on the scanner thread. For directories that appear after start, files
+// created before the watch was in place are reported as created; after an
+// overflow, files changed since the last complete read count as written.
+void FileWatcher::addTree(const std::string& dir, bool reportFiles, std::chrono::system_clock::time_point since) {
+    namespace fs = std::filesystem;
+    addWatch(dir);
+
+    std::error_code ec;
+    fs::path base = dir.empty() ? fs::path(_root) : fs::path(_root) / dir;
+    const bool checkTimes = since != std::chrono::system_clock::time_point::max();
+    const auto sinceNs = std::chrono::duration_cast<std::chrono::nanoseconds>(since.time_since_epoch()).count();
+    for (fs::recursive_directory_iterator it(base, fs::directory_options::skip_permission_denied, ec), end;
+         it != end && !_stopping.load(); it.increment(ec)) {
+        if (ec) break;
+        std::string name = it->path().filename().string();
+        if (ignored(name.c_str())) {
+            if (it->is_directory(ec)) it.disable_recursion_pending();
+            continue;
+        }
+        std::string rel = fs::relative(it->path(), _root, ec).string();
+        if (it->is_directory(ec)) {
+            addWatch(rel);
+            continue;
+        }
+        std::uint32_t mask = 0;
+        if (reportFiles) {
+            mask = IN_CREATE;
+        } else if (checkTimes) {
+            struct stat st;
+            if (lstat(it->path().c_str(), &st) != 0) continue;
+            auto ns = [](const struct timespec& ts) { return ts.tv_sec * 1000000000ll + ts.tv_nsec; };
+            if (ns(st.st_mtim) >= sinceNs) mask = IN_CLOSE_WRITE;
+            else if (ns(st.st_ctim) >= sinceNs) mask = IN_ATTRIB;
+        }
+        if (!mask) continue;
+        std::lock_guard<std::mutex> lock(_mx);
+        note(rel, mask, std::chrono::system_clock::now());
+    }
+}
+
+void FileWatcher::scannerLoop() {
+    addTree("", false);
+    ESH_LOG_INFO() << "Watching " << _root << " (" << watchCount() << " directories)";
+    _scanning = false;
+    std::unique_lock<std::mutex> lock(_mx);
+    while (!_stopping) {
+        _scanCv.wait(lock, [&] { return _stopping || _rescanWanted || !_newDirs.empty(); });
+        if (_stopping) break;
+        std::vector<std::string> dirs;
+        dirs.swap(_newDirs);
+        const bool rescan = _rescanWanted;
+        const auto since = _rescanSince;
+        _rescanWanted = false;
+        lock.unlock();
+
+        if (rescan) {
+            _scanning = true;
+            ESH_LOG_WARN() << "File watcher queue overflowed, rescanning " << _root;
+            addTree("", false, since);
+            _scanning = false;
+        }
+        for (const auto& d : dirs) addTree(d, true);
+        wakeFlush();
+        lock.lock();
+    }
+}
+
+// What the scanner noted has to reach the sink like any event batch
+void FileWatcher::wakeFlush() {
+    if (_loop) {
+        _loop->post([this] { armFlush(); });
+        return;
+    }
+    std::uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) < 0) ESH_LOG_WARN() << "Cannot wake file watcher";
+}
+
+// Caller holds _mx
+void FileWatcher::renameDirs(const std::string& from, const std::string& to) {
+    for (auto& kv : _dirs) {
+        std::string& d = kv.second;
+        if (d == from) d = to;
+        else if (d.size() > from.size() && d.compare(0, from.size(), from) == 0 && d[from.size()] == '/')
+            d = to + d.substr(from.size());
+    }
+}
+
+// Caller holds _mx: dir left the tree, its watches are dropped
+void FileWatcher::removeDirs(const std::string& dir) {
+    for (auto it = _dirs.begin(); it != _dirs.end();) {
+        const std::string& d = it->second;
+        if (d == dir || (d.size() > dir.size() && d.compare(0, dir.size(), dir) == 0 && d[dir.size()] == '/')) {
+            inotify_rm_watch(_fd, it->first);
+            it = _dirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Read everything available on the (non-blocking) inotify fd and coalesce it.
+// A directory renamed inside the tree keeps its watches under the new path;
+// one moved out of the tree loses them.
+std::size_t FileWatcher::drain() {
+    alignas(struct inotify_event) char buf[64 * 1024];
+    const auto begun = std::chrono::system_clock::now();
+    std::size_t n = 0;
+    std::unordered_map<std::uint32_t, std::string> movedFrom;   // cookie -> old directory path
+    bool overflow = false;
+    std::vector<std::string> newDirs;
+    for (;;) {
+        ssize_t len = read(_fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard<std::mutex> lock(_mx);
+        for (char* p = buf; p < buf + len;) {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            ++n;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                ++_overflows;
+                overflow = true;
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                _dirs.erase(ev->wd);
+                continue;
+            }
+            auto it = _dirs.find(ev->wd);
+            if (it == _dirs.end() || ev->len == 0 || ignored(ev->name)) continue;
+
+            std::string path = it->second.empty() ? std::string(ev->name) : it->second + "/" + ev->name;
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & IN_MOVED_FROM) {
+                    movedFrom[ev->cookie] = path;
+                } else if (ev->mask & IN_MOVED_TO) {
+                    auto from = movedFrom.find(ev->cookie);
+                    if (from != movedFrom.end()) {
+                        renameDirs(from->second, path);
+                        movedFrom.erase(from);
+                    } else {
+                        newDirs.push_back(path);
+                    }
+                } else if (ev->mask & IN_CREATE) {
+                    newDirs.push_back(path);
+                }
+            }
+            note(path, ev->mask & kWatchMask, now);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        for (const auto& kv : movedFrom) removeDirs(kv.second);
+        newDirs.insert(newDirs.end(), _newDirs.begin(), _newDirs.end());
+        _newDirs.swap(newDirs);
+        if (overflow && !_rescanWanted) {
+            // Events were lost after the previous read emptied the queue
+            _rescanWanted = true;
+            _rescanSince = _lastDrain;
+        }
+        _lastDrain = begun;
+        if (!_newDirs.empty() || _rescanWanted) _scanCv.notify_one();
+    }
+    _events += n;
+    return n;
+}
+
+void FileWatcher::flush() {
+    std::lock_guard<std::mutex> flushLock(_flushMx);
+    std::unordered_map<std::string, Stat> batch;
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        batch.swap(_pending);
+    }
+    if (!_sink) return;
+    for (const auto& kv : batch) _sink(kv.first, kv.second);
+}
+
+// Loop mode: coalesce what arrived and arm a one-shot timer for the batch deadline
+void FileWatcher::onReadable() {
+    drain();
+    armFlush();
+}
+
+void FileWatcher::armFlush() {
+    if (!_loop || _flushTimer >= 0) return;
+    {
+        std::lock_guard<std::mutex> lock(_mx);
+        if (_pending.empty()) return;
+    }
+    _flushTimer = _loop->addTimer(_interval, std::chrono::milliseconds(0), [this] {
+        _flushTimer = -1;
+        flush();
+    });
+}
+
+void FileWatcher::readerLoop() {
+    for (;;) {
+        // Sleep until an event arrives, or until the pending batch is due
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(_mx);
+            if (!_pending.empty()) {
+                auto due = _firstPending + _interval;
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::max<long long>(0, left.count()));
+            }
+        }
+        struct pollfd fds[2] = {{_fd, POLLIN, 0}, {_wakeFd, POLLIN, 0}};
+        int r = poll(fds, 2, timeout);
+        if (r < 0 && errno != EINTR) break;
+        if (fds[1].revents & POLLIN) {
+            // The scanner noted files, or stop()
+            std::uint64_t count;
+            if (read(_wakeFd, &count, sizeof(count)) < 0) count = 0;
+            if (_stopping.load()) break;
+        }
+        if (fds[0].revents & POLLIN) drain();
+
+        bool due;
+        {
+            std::lock_guard<std::mutex> lock(_mx);
+            due = !_pending.empty() && std::chrono::steady_clock::now() >= _firstPending + _interval;
+        }
+        if (due) flush();
+    }
+    drain();
+    flush();
+}
+
+} // namespace esh
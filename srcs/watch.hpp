@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+namespace esh {
+
+class EventLoop;
+
+// Recursive inotify watcher for the exam working directory.
+// Events are coalesced per path (count, first/last time) and handed to a sink
+// once per flush interval, so a `make` storm of thousands of events per
+// second turns into one callback per touched file. The tree walks (at start
+// and after a queue overflow) run on a scanner thread, never on the caller's.
+class FileWatcher {
+public:
+    struct Stat {
+        std::uint32_t count = 0;
+        std::uint32_t mask = 0;   // OR of the inotify masks seen
+        std::chrono::system_clock::time_point first;
+        std::chrono::system_clock::time_point last;
+    };
+    using Sink = std::function<void(const std::string& path, const Stat& stat)>;
+
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // fnmatch() patterns for whole path components whose events are dropped,
+    // e.g. our own log files; a matching directory is not descended into
+    void ignore(const std::string& pattern);
+    void setSink(Sink sink, std::chrono::milliseconds interval = std::chrono::milliseconds(500));
+
+    // Watch root and every directory below it. With a loop the inotify fd and
+    // the flush deadline are served by it (sink runs on the loop thread),
+    // otherwise a reader thread is started. Returns once root itself is
+    // watched; the directories below it are added in the background.
+    bool start(const std::string& root, EventLoop* loop = nullptr);
+    void stop();
+
+    // Hand everything coalesced so far to the sink
+    void flush();
+
+    std::size_t watchCount() const;
+    // True until the scanner thread has walked the tree
+    bool scanning() const noexcept { return _scanning.load(); }
+    std::uint64_t eventCount() const noexcept { return _events.load(); }
+    std::uint64_t overflowCount() const noexcept { return _overflows.load(); }
+
+    static std::string describe(std::uint32_t mask);
+
+private:
+    void readerLoop();
+    void onReadable();
+    void armFlush();
+    void wakeFlush();
+    std::size_t drain();
+    void scannerLoop();
+    // Watch dir and the directories below it. Files are reported as created
+    // when reportFiles is set, or as written when changed at or after since.
+    void addTree(const std::string& dir, bool reportFiles,
+                 std::chrono::system_clock::time_point since = std::chrono::system_clock::time_point::max());
+    void addWatch(const std::string& dir);
+    void renameDirs(const std::string& from, const std::string& to);
+    void removeDirs(const std::string& dir);
+    void note(const std::string& path, std::uint32_t mask, std::chrono::system_clock::time_point now);
+    bool ignored(const char* name) const;
+
+    int _fd = -1;
+    int _wakeFd = -1;   // eventfd: scanner results or stop() for the reader thread
+    std::string _root;
+    std::thread _reader;
+    std::thread _scanner;
+    std::atomic<bool> _scanning{false};
+    std::atomic<bool> _stopping{false};
+    bool _rescanWanted = false;                        // guarded by _mx, like the two below
+    std::chrono::system_clock::time_point _rescanSince;
+    std::vector<std::string> _newDirs;                 // created or moved in, to walk
+    std::condition_variable _scanCv;
+    EventLoop* _loop = nullptr;
+    int _flushTimer = -1;
+
+    std::unordered_map<int, std::string> _dirs;        // wd -> directory path
+    std::unordered_map<std::string, Stat> _pending;    // coalesced since last flush
+    mutable std::mutex _mx;
+    std::mutex _flushMx;                               // serializes sink calls
+
+    std::vector<std::string> _ignore;
+    Sink _sink;
+    std::chrono::milliseconds _interval{500};
+    std::chrono::steady_clock::time_point _firstPending;
+    std::chrono::system_clock::time_point _lastDrain;  // no event was lost before this
+
+    std::atomic<std::uint64_t> _events{0};
+    std::atomic<std::uint64_t> _overflows{0};
+};
+
+} // namespace esh
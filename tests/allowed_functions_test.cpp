@@ -0,0 +1,75 @@
+// checkAllowedFunctions on the programs make test compiles from tests/fixtures
+#include "test.hpp"
+#include "../srcs/allowed_functions.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Names reported as forbidden, sorted
+std::vector<std::string> forbidden(const std::string& fixture, const std::vector<std::string>& allowed,
+                                   norm::Report& report) {
+    std::string error;
+    esh::checkAllowedFunctions({"tests/fixtures/" + fixture}, allowed, report, &error);
+    CHECK_EQ(error, std::string());
+    std::vector<std::string> names;
+    for (const auto& is : report.issues()) {
+        if (is.rule == norm::Rule::ForbiddenFunction) names.push_back(report.name(is.arg));
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::string joined(const std::vector<std::string>& names) {
+    std::string out;
+    for (const auto& n : names) out += (out.empty() ? "" : " ") + n;
+    return out;
+}
+
+} // namespace
+
+TEST(printf_rewritten_to_puts_is_allowed) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("printf.elf", {"printf"}, report)), std::string());
+}
+
+TEST(puts_reported_when_printf_is_not_allowed) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("printf.elf", {"write"}, report)), std::string("printf putchar puts"));
+}
+
+TEST(ctype_macros_are_allowed) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("ctype.elf", {"write", "isalpha", "toupper"}, report)), std::string());
+}
+
+TEST(ctype_tables_reported_without_the_function) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("ctype.elf", {"write", "isalpha"}, report)), std::string("__ctype_toupper_loc"));
+}
+
+TEST(forbidden_call_reported) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("malloc.elf", {"write", "free"}, report)), std::string("malloc"));
+}
+
+TEST(static_binary_reported) {
+    norm::Report report;
+    CHECK_EQ(joined(forbidden("printf-static.elf", {"printf"}, report)), std::string());
+    CHECK_EQ(report.size(), std::size_t(1));
+    CHECK(!report.empty() && report.issues()[0].rule == norm::Rule::StaticBinary);
+}
+
+TEST(static_binary_does_not_allow_libc_for_the_others) {
+    norm::Report report;
+    std::string error;
+    esh::checkAllowedFunctions({"tests/fixtures/printf-static.elf", "tests/fixtures/malloc.elf"}, {"write"}, report,
+                               &error);
+    std::vector<std::string> names;
+    for (const auto& is : report.issues()) {
+        if (is.rule == norm::Rule::ForbiddenFunction) names.push_back(report.name(is.arg));
+    }
+    std::sort(names.begin(), names.end());
+    CHECK_EQ(joined(names), std::string("free malloc"));
+}
@@ -0,0 +1,100 @@
+// DebugTools::hexdumpTo against a plain snprintf rendering of the same layout
+#include "test.hpp"
+#include "../srcs/debug.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string reference(const unsigned char* p, std::size_t size, const esh::HexdumpOptions& opt) {
+    const std::size_t width = opt.width;
+    const bool wide = opt.baseOffset + size > 0xffffffffull;
+    std::string out;
+    char tmp[32];
+    auto offset = [&](std::uint64_t off) {
+        std::snprintf(tmp, sizeof(tmp), wide ? "%016llx" : "%08llx", static_cast<unsigned long long>(off));
+        out += tmp;
+    };
+    bool starred = false;
+    for (std::size_t i = 0; i < size; i += width) {
+        const std::size_t n = std::min(width, size - i);
+        if (opt.collapse && i >= width && n == width && std::memcmp(p + i, p + i - width, width) == 0) {
+            if (!starred) out += "*\n";
+            starred = true;
+            continue;
+        }
+        starred = false;
+        offset(opt.baseOffset + i);
+        out += ' ';
+        for (std::size_t j = 0; j < width; ++j) {
+            if (j % 8 == 0) out += ' ';
+            if (j < n) {
+                std::snprintf(tmp, sizeof(tmp), "%02x ", p[i + j]);
+                out += tmp;
+            } else {
+                out += "   ";
+            }
+        }
+        out += " |";
+        for (std::size_t j = 0; j < n; ++j) out += p[i + j] >= 0x20 && p[i + j] < 0x7f ? static_cast<char>(p[i + j]) : '.';
+        out += "|\n";
+    }
+    offset(opt.baseOffset + size);
+    out += '\n';
+    return out;
+}
+
+// Every chunk handed to the sink is whole lines within 64 KiB
+std::string dump(const std::vector<unsigned char>& data, const esh::HexdumpOptions& opt, bool& chunksOk) {
+    std::string out;
+    chunksOk = true;
+    esh::DebugTools::hexdumpTo([&](const char* chunk, std::size_t len) {
+        if (len == 0 || len > 64 * 1024 || chunk[len - 1] != '\n') chunksOk = false;
+        out.append(chunk, len);
+        return true;
+    }, data.data(), data.size(), opt);
+    return out;
+}
+
+} // namespace
+
+// A line followed by an equal one prints the line then "*". Leading with a
+// varying number of single lines shifts where the 64 KiB buffer fills up,
+// so one of the dumps has a "*" due right at its end (wide offsets leave
+// the least room there); make test BUILD=asan catches a write past it.
+TEST(hexdump_wide_offsets_with_repeated_lines) {
+    for (std::size_t width : {7, 12, 16}) {
+        for (std::size_t singles = 0; singles < 4 * width + 32; ++singles) {
+            std::vector<unsigned char> data;
+            std::size_t line = 0;
+            auto push = [&](std::size_t id) {
+                for (std::size_t j = 0; j < width; ++j) data.push_back(static_cast<unsigned char>(id * 31 + j));
+            };
+            for (; line < singles; ++line) push(line);
+            for (; data.size() < 24 * 1024; ++line) {
+                push(line);
+                push(line);
+            }
+            esh::HexdumpOptions opt;
+            opt.width = width;
+            opt.baseOffset = 1ull << 32;
+            bool chunksOk = false;
+            std::string got = dump(data, opt, chunksOk);
+            CHECK(chunksOk);
+            CHECK(got == reference(data.data(), data.size(), opt));
+        }
+    }
+}
+
+TEST(hexdump_matches_layout) {
+    std::vector<unsigned char> data(100);
+    for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<unsigned char>(i < 48 ? 'A' : i * 7);
+    esh::HexdumpOptions opt;
+    bool chunksOk = false;
+    std::string got = dump(data, opt, chunksOk);
+    CHECK(chunksOk);
+    CHECK_EQ(got, reference(data.data(), data.size(), opt));
+    CHECK(got.find("\n*\n") != std::string::npos);
+}
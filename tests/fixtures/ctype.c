@@ -0,0 +1,15 @@
+/* isalpha and toupper are glibc macros over __ctype_b_loc and __ctype_toupper_loc */
+#include <ctype.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+	char c;
+
+	(void)argc;
+	c = argv[0][0];
+	if (isalpha(c))
+		c = toupper(c);
+	write(1, &c, 1);
+	return 0;
+}
@@ -0,0 +1,18 @@
+/* Calls malloc and free on top of write */
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(void)
+{
+	char *s;
+
+	s = malloc(3);
+	if (!s)
+		return 1;
+	s[0] = 'o';
+	s[1] = 'k';
+	s[2] = '\n';
+	write(1, s, 3);
+	free(s);
+	return 0;
+}
@@ -0,0 +1,10 @@
+/* Only printf in the source: at -O2 GCC calls puts and putchar instead */
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+	printf("hello\n");
+	printf("%c", argv[0][0]);
+	printf("%d\n", argc);
+	return 0;
+}
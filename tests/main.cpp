@@ -0,0 +1,37 @@
+// esh-test: runs every TEST case; make test builds the fixtures first and
+// runs it from the repository root
+#include "test.hpp"
+#include <cstring>
+
+namespace esh {
+namespace test {
+
+std::vector<Case>& cases() {
+    static std::vector<Case> all;
+    return all;
+}
+
+int& failures() {
+    static int n = 0;
+    return n;
+}
+
+} // namespace test
+} // namespace esh
+
+// esh-test [filter]: only the cases whose name contains filter
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+    int failed = 0, run = 0;
+    for (const auto& c : esh::test::cases()) {
+        if (!std::strstr(c.name, filter)) continue;
+        int before = esh::test::failures();
+        c.fn();
+        ++run;
+        bool ok = esh::test::failures() == before;
+        if (!ok) ++failed;
+        std::cout << (ok ? "ok   " : "FAIL ") << c.name << "\n";
+    }
+    std::cout << run - failed << "/" << run << " passed\n";
+    return failed ? 1 : 0;
+}
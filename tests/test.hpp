@@ -0,0 +1,47 @@
+#pragma once
+// Minimal harness for make test: TEST(name) registers a case, CHECK and
+// CHECK_EQ report a failure and let the case go on
+#include <iostream>
+#include <vector>
+
+namespace esh {
+namespace test {
+
+struct Case {
+    const char* name;
+    void (*fn)();
+};
+
+std::vector<Case>& cases();
+int& failures();
+
+struct Registrar {
+    Registrar(const char* name, void (*fn)()) { cases().push_back({name, fn}); }
+};
+
+} // namespace test
+} // namespace esh
+
+#define TEST(name)                                                  \
+    static void name();                                             \
+    static esh::test::Registrar name##_registrar(#name, &name);     \
+    static void name()
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            ++esh::test::failures();                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                    \
+    do {                                                                                  \
+        auto&& check_a_ = (a);                                                            \
+        auto&& check_b_ = (b);                                                            \
+        if (!(check_a_ == check_b_)) {                                                    \
+            ++esh::test::failures();                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " \
+                      << check_a_ << " != " << check_b_ << "\n";                          \
+        }                                                                                 \
+    } while (0)
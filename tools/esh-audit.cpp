@@ -0,0 +1,144 @@
+// esh-audit: inspect and compact the exam shell audit journal (.shell_audit)
+//
+//   esh-audit replay  [file]   print every record in order
+//   esh-audit verify  [file]   check checksums, report corruption and a torn tail
+//   esh-audit compact [file]   drop duplicate file/env events per session and
+//                              rewrite the journal atomically; refused while a
+//                              shell has the journal open
+#include "../srcs/journal.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string format_time(std::uint64_t ns) {
+    std::time_t t = static_cast<std::time_t>(ns / 1000000000ull);
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+static int usage() {
+    std::cerr << "usage: esh-audit <replay|verify|compact> [file]\n";
+    return 2;
+}
+
+static std::string describe(const esh::Journal::Damage& d) {
+    std::string out;
+    if (d.corruptBytes) out += std::to_string(d.corruptBytes) + " corrupt byte(s) skipped";
+    if (d.tornTail) out += std::string(out.empty() ? "" : ", ") + "torn tail";
+    return out;
+}
+
+static int do_replay(const std::string& path) {
+    esh::Journal::Damage damage;
+    bool ok = esh::Journal::replay(path, [&](const esh::Journal::Record& r) {
+        std::cout << "[" << format_time(r.timeNs) << "] "
+                  << esh::auditEventName(r.type) << " " << r.payload << "\n";
+    }, &damage);
+    if (!ok) {
+        std::cerr << path << ": not a journal\n";
+        return 1;
+    }
+    std::string problems = describe(damage);
+    if (!problems.empty()) std::cerr << path << ": " << problems << "\n";
+    return problems.empty() ? 0 : 1;
+}
+
+static int do_verify(const std::string& path) {
+    std::size_t n = 0;
+    esh::Journal::Damage damage;
+    if (!esh::Journal::replay(path, [&](const esh::Journal::Record&) { ++n; }, &damage)) {
+        std::cerr << path << ": not a journal\n";
+        return 1;
+    }
+    struct stat st;
+    long long size = ::stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+    std::string problems = describe(damage);
+    std::cout << path << ": " << n << " record(s), " << size << " byte(s)"
+              << (problems.empty() ? "" : " (" + problems + ")") << "\n";
+    return problems.empty() ? 0 : 1;
+}
+
+// Within a session only the last event per file path / env key matters
+static int compact_locked(const std::string& path) {
+    std::vector<esh::Journal::Record> in;
+    esh::Journal::Damage damage;
+    if (!esh::Journal::replay(path, [&](const esh::Journal::Record& r) { in.push_back(r); }, &damage)) {
+        std::cerr << path << ": not a journal\n";
+        return 1;
+    }
+    std::vector<esh::Journal::Record> out;
+    out.reserve(in.size());
+    std::size_t sessionBegin = 0;
+    auto flushSession = [&](std::size_t end) {
+        std::set<std::string> seenFiles, seenEnv;
+        std::vector<bool> keep(end - sessionBegin, true);
+        for (std::size_t i = end; i-- > sessionBegin;) {
+            const auto& r = in[i];
+            if (r.type == static_cast<std::uint8_t>(esh::AuditEvent::FileChange)) {
+                keep[i - sessionBegin] = seenFiles.insert(r.payload.substr(0, r.payload.find('\t'))).second;
+            } else if (r.type == static_cast<std::uint8_t>(esh::AuditEvent::EnvChange)) {
+                keep[i - sessionBegin] = seenEnv.insert(r.payload.substr(0, r.payload.find('='))).second;
+            }
+        }
+        for (std::size_t i = sessionBegin; i < end; ++i) {
+            if (keep[i - sessionBegin]) out.push_back(in[i]);
+        }
+        sessionBegin = end;
+    };
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        if (in[i].type == static_cast<std::uint8_t>(esh::AuditEvent::SessionStart) && i > sessionBegin) {
+            flushSession(i);
+        }
+    }
+    flushSession(in.size());
+
+    if (!esh::Journal::rewrite(path, out)) {
+        std::cerr << path << ": rewrite failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::string problems = describe(damage);
+    std::cout << path << ": " << in.size() << " -> " << out.size() << " record(s)"
+              << (problems.empty() ? "" : ", dropped " + problems) << "\n";
+    return 0;
+}
+
+static int do_compact(const std::string& path) {
+    // A running shell holds a shared lock and appends through its own fd: a
+    // rename under it would send its records to the replaced file
+    int lockFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (lockFd < 0) {
+        std::cerr << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << path << ": in use by a running shell, not compacting\n";
+        ::close(lockFd);
+        return 1;
+    }
+    int rc = compact_locked(path);
+    ::close(lockFd);
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) return usage();
+    std::string cmd = argv[1];
+    std::string path = argc == 3 ? argv[2] : ".shell_audit";
+    if (cmd == "replay") return do_replay(path);
+    if (cmd == "verify") return do_verify(path);
+    if (cmd == "compact") return do_compact(path);
+    return usage();
+}
@@ -0,0 +1,188 @@
+// esh-symbolize: turns the raw addresses of an exam-shell crash report into
+// function names, offline, using the memory map saved with the report and
+// the symbol tables of the binaries it names
+//
+//   esh-symbolize [-a] [report]   the last crash (-a: every crash) in report,
+//                                 .exam-shell.crash by default
+#include "../srcs/elf.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+struct Mapping {
+    std::uint64_t start;
+    std::uint64_t end;
+    std::uint64_t offset;
+    std::string path;
+};
+
+struct Report {
+    std::vector<std::string> header;   // signal, pid, exe... lines
+    std::uint64_t pc = 0;
+    std::vector<std::uint64_t> frames;
+    std::vector<Mapping> maps;
+    std::vector<std::string> records;
+};
+
+std::string demangle(std::string_view name) {
+    std::string mangled(name);
+    int status = 0;
+    char* out = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || !out) return mangled;
+    std::string result(out);
+    std::free(out);
+    return result;
+}
+
+std::string basename_of(const std::string& path) {
+    std::size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// "start-end perms offset dev inode [path]"; anonymous mappings are skipped
+bool parse_mapping(const std::string& line, Mapping& m) {
+    std::istringstream in(line);
+    std::string range, perms, offset, dev, inode;
+    if (!(in >> range >> perms >> offset >> dev >> inode)) return false;
+    std::getline(in >> std::ws, m.path);
+    std::size_t dash = range.find('-');
+    if (dash == std::string::npos || m.path.empty() || m.path[0] != '/') return false;
+    m.start = std::strtoull(range.c_str(), nullptr, 16);
+    m.end = std::strtoull(range.c_str() + dash + 1, nullptr, 16);
+    m.offset = std::strtoull(offset.c_str(), nullptr, 16);
+    return true;
+}
+
+std::vector<Report> parse(std::istream& in) {
+    std::vector<Report> reports;
+    enum { kNone, kHeader, kRegisters, kBacktrace, kMaps, kRecords } section = kNone;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line == "*** exam-shell crash ***") {
+            reports.emplace_back();
+            section = kHeader;
+            continue;
+        }
+        if (reports.empty() || line == "*** end ***") {
+            section = kNone;
+            continue;
+        }
+        Report& r = reports.back();
+        if (line == "registers:") section = kRegisters;
+        else if (line == "backtrace:") section = kBacktrace;
+        else if (line == "maps:") section = kMaps;
+        else if (line == "pending log records:") section = kRecords;
+        else if (section == kHeader) {
+            if (line.compare(0, 4, "pc: ") == 0) r.pc = std::strtoull(line.c_str() + 4, nullptr, 16);
+            r.header.push_back(line);
+        } else if (section == kBacktrace) {
+            std::size_t sp = line.rfind(' ');
+            if (sp != std::string::npos) r.frames.push_back(std::strtoull(line.c_str() + sp + 1, nullptr, 16));
+        } else if (section == kMaps) {
+            Mapping m;
+            if (parse_mapping(line, m)) r.maps.push_back(std::move(m));
+        } else if (section == kRecords && line.compare(0, 1, "(") != 0) {
+            r.records.push_back(line);
+        }
+    }
+    return reports;
+}
+
+class Symbolizer {
+public:
+    explicit Symbolizer(const std::vector<Mapping>& maps) : _maps(maps) {}
+
+    // Return addresses point after the call: look up addr - 1 for those
+    std::string describe(std::uint64_t addr, bool returnAddress) {
+        const std::uint64_t lookup = returnAddress ? addr - 1 : addr;
+        for (const auto& m : _maps) {
+            if (lookup < m.start || lookup >= m.end) continue;
+            const esh::ElfFile* elf = load(m.path);
+            std::uint64_t vaddr = 0;
+            const esh::ElfFile::Function* fn = nullptr;
+            if (elf && elf->vaddrOf(lookup - m.start + m.offset, vaddr)) fn = elf->functionAt(vaddr);
+            std::ostringstream out;
+            if (fn) out << demangle(fn->name) << "+0x" << std::hex << (vaddr - fn->addr + (returnAddress ? 1 : 0));
+            else out << "??";
+            out << " (" << basename_of(m.path) << ")";
+            return out.str();
+        }
+        return "??";
+    }
+
+private:
+    const esh::ElfFile* load(const std::string& path) {
+        auto it = _elves.find(path);
+        if (it != _elves.end()) return it->second.get();
+        auto elf = std::make_unique<esh::ElfFile>();
+        std::string error;
+        if (!elf->open(path, &error, true)) {
+            std::cerr << "esh-symbolize: " << path << ": " << error << "\n";
+            elf.reset();
+        }
+        return (_elves[path] = std::move(elf)).get();
+    }
+
+    const std::vector<Mapping>& _maps;
+    std::map<std::string, std::unique_ptr<esh::ElfFile>> _elves;
+};
+
+void print(const Report& r) {
+    for (const auto& line : r.header) std::cout << line << "\n";
+    Symbolizer sym(r.maps);
+    if (r.pc) std::cout << "fault at 0x" << std::hex << r.pc << std::dec << " " << sym.describe(r.pc, false) << "\n";
+    std::cout << "backtrace:\n";
+    for (std::size_t i = 0; i < r.frames.size(); ++i) {
+        // The faulting frame holds an exact pc, not a return address
+        const bool exact = r.frames[i] == r.pc;
+        std::cout << "  #" << i << " 0x" << std::hex << r.frames[i] << std::dec << " "
+                  << sym.describe(r.frames[i], !exact) << "\n";
+    }
+    if (!r.records.empty()) {
+        std::cout << "pending log records:\n";
+        for (const auto& line : r.records) std::cout << line << "\n";
+    }
+}
+
+int usage() {
+    std::cerr << "usage: esh-symbolize [-a] [report]\n";
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool all = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "a")) != -1) {
+        if (opt == 'a') all = true;
+        else return usage();
+    }
+    if (argc - optind > 1) return usage();
+    const std::string path = optind < argc ? argv[optind] : ".exam-shell.crash";
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "esh-symbolize: cannot open " << path << "\n";
+        return 1;
+    }
+    std::vector<Report> reports = parse(in);
+    if (reports.empty()) {
+        std::cerr << "esh-symbolize: no crash report in " << path << "\n";
+        return 1;
+    }
+    for (std::size_t i = all ? 0 : reports.size() - 1; i < reports.size(); ++i) {
+        if (i != (all ? 0 : reports.size() - 1)) std::cout << "\n";
+        print(reports[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// esh-top: live metrics of the exam shells running on this host, read from
+// their shared-memory segments (/dev/shm/esh-metrics.<pid>) without talking
+// to them
+//
+//   esh-top [-1] [-i seconds]         one row per shell, refreshed (-1: once)
+//   esh-top [-1] [-i seconds] <pid>   every metric of one shell
+#include "../srcs/metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+
+using esh::metrics::Sample;
+using esh::metrics::SegmentView;
+using esh::metrics::Type;
+
+namespace {
+
+struct Shell {
+    SegmentView view;
+    std::vector<Sample> now;
+    std::vector<Sample> prev;   // previous refresh, for rates
+};
+
+const Sample* find(const std::vector<Sample>& samples, const char* name) {
+    for (const auto& s : samples) {
+        if (s.name == name) return &s;
+    }
+    return nullptr;
+}
+
+double value(const std::vector<Sample>& samples, const char* name) {
+    const Sample* s = find(samples, name);
+    return s ? s->value : 0;
+}
+
+// Per second since the previous refresh; 0 on the first one
+double rate(const Shell& sh, const char* name, double seconds) {
+    if (sh.prev.empty() || seconds <= 0) return 0;
+    return std::max(0.0, value(sh.now, name) - value(sh.prev, name)) / seconds;
+}
+
+// Upper bound of the bucket holding the q-quantile; the last bound for +Inf
+double quantile(const Sample& h, double q) {
+    if (h.value <= 0 || h.bounds.empty()) return 0;
+    std::uint64_t want = static_cast<std::uint64_t>(q * h.value + 0.5), seen = 0;
+    for (std::size_t i = 0; i < h.buckets.size(); ++i) {
+        seen += h.buckets[i];
+        if (seen >= std::max<std::uint64_t>(want, 1)) return static_cast<double>(h.bounds[std::min(i, h.bounds.size() - 1)]);
+    }
+    return static_cast<double>(h.bounds.back());
+}
+
+std::string human_bytes(double b) {
+    const char* units[] = {"B", "K", "M", "G"};
+    int u = 0;
+    while (b >= 1024 && u < 3) {
+        b /= 1024;
+        ++u;
+    }
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(u ? 1 : 0) << b << units[u];
+    return os.str();
+}
+
+std::string uptime(const esh::metrics::Segment& seg) {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    std::uint64_t now = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+    std::uint64_t s = now > seg.startNs ? (now - seg.startNs) / 1000000000ull : 0;
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%llu:%02llu:%02llu", static_cast<unsigned long long>(s / 3600),
+                  static_cast<unsigned long long>(s / 60 % 60), static_cast<unsigned long long>(s % 60));
+    return buf;
+}
+
+bool alive(int pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// Opens segments that appeared since the last refresh and forgets vanished ones
+void rescan(std::map<std::string, Shell>& shells) {
+    std::vector<std::string> names = SegmentView::list();
+    for (auto it = shells.begin(); it != shells.end();) {
+        if (std::find(names.begin(), names.end(), it->first) == names.end()) it = shells.erase(it);
+        else ++it;
+    }
+    for (const auto& name : names) {
+        if (shells.count(name)) continue;
+        Shell sh;
+        if (sh.view.open(name)) shells.emplace(name, std::move(sh));
+    }
+}
+
+void print_table(std::map<std::string, Shell>& shells, double seconds, std::ostream& out) {
+    out << std::left << std::setw(8) << "PID" << std::setw(10) << "UP" << std::right << std::setw(7) << "CMDS"
+        << std::setw(7) << "CMD/s" << std::setw(7) << "GRADES" << std::setw(8) << "p50 ms" << std::setw(6) << "LOGQ"
+        << std::setw(7) << "LOG/s" << std::setw(6) << "DROP" << std::setw(9) << "NORM f/s" << std::setw(5) << "JOBS"
+        << std::setw(8) << "RSS" << "  LABEL\n";
+    for (auto& kv : shells) {
+        Shell& sh = kv.second;
+        const esh::metrics::Segment& seg = *sh.view.get();
+        const Sample* grade = find(sh.now, "esh_grade_duration_ms");
+        std::string label(seg.label, strnlen(seg.label, sizeof(seg.label)));
+        if (!alive(seg.pid)) label += " (dead)";
+        out << std::left << std::setw(8) << seg.pid << std::setw(10) << uptime(seg) << std::right << std::fixed
+            << std::setprecision(0) << std::setw(7) << value(sh.now, "esh_commands_total")
+            << std::setprecision(1) << std::setw(7) << rate(sh, "esh_commands_total", seconds)
+            << std::setprecision(0) << std::setw(7) << (grade ? grade->value : 0)
+            << std::setw(8) << (grade ? quantile(*grade, 0.5) : 0)
+            << std::setw(6) << value(sh.now, "esh_log_queue_depth")
+            << std::setprecision(1) << std::setw(7) << rate(sh, "esh_log_records_total", seconds)
+            << std::setprecision(0) << std::setw(6) << value(sh.now, "esh_log_records_dropped_total")
+            << std::setprecision(1) << std::setw(9) << rate(sh, "esh_norm_files_total", seconds)
+            << std::setprecision(0) << std::setw(5) << value(sh.now, "esh_jobs_active")
+            << std::setw(8) << human_bytes(value(sh.now, "esh_rss_bytes")) << "  " << label << "\n";
+    }
+    if (shells.empty()) out << "(no exam shell running)\n";
+}
+
+void print_detail(Shell& sh, double seconds, std::ostream& out) {
+    const esh::metrics::Segment& seg = *sh.view.get();
+    out << "pid " << seg.pid << (alive(seg.pid) ? "" : " (dead)") << ", up " << uptime(seg) << ", "
+        << std::string(seg.label, strnlen(seg.label, sizeof(seg.label))) << "\n\n";
+    for (const auto& s : sh.now) {
+        out << std::left << std::setw(32) << s.name << std::right << std::fixed;
+        if (s.type == Type::Histogram) {
+            out << " count " << std::setprecision(0) << s.value << "  avg " << std::setprecision(1)
+                << (s.value > 0 ? static_cast<double>(s.sum) / s.value : 0) << std::setprecision(0)
+                << "  p50 " << quantile(s, 0.5) << "  p90 " << quantile(s, 0.9) << "  p99 " << quantile(s, 0.99);
+        } else {
+            out << std::setw(14) << std::setprecision(0) << s.value;
+            if (s.type == Type::Counter) out << std::setw(10) << std::setprecision(1) << rate(sh, s.name.c_str(), seconds) << "/s";
+        }
+        out << "\n  " << s.help << "\n";
+    }
+}
+
+int usage() {
+    std::cerr << "usage: esh-top [-1] [-i seconds] [pid]\n";
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool once = false;
+    double interval = 1.0;
+    int pid = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-1") once = true;
+        else if (arg == "-i" && i + 1 < argc) interval = std::atof(argv[++i]);
+        else if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos) pid = std::atoi(arg.c_str());
+        else return usage();
+    }
+    if (interval <= 0) return usage();
+
+    const bool tty = isatty(STDOUT_FILENO) && !once;
+    std::map<std::string, Shell> shells;
+    auto last = std::chrono::steady_clock::now();
+    for (bool first = true;; first = false) {
+        rescan(shells);
+        if (pid) {
+            auto it = shells.find(esh::metrics::kShmPrefix + std::to_string(pid));
+            if (it == shells.end()) {
+                std::cerr << "esh-top: no metrics for pid " << pid << "\n";
+                return 1;
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = first ? 0 : std::chrono::duration<double>(now - last).count();
+        last = now;
+        for (auto& kv : shells) {
+            kv.second.prev.swap(kv.second.now);
+            esh::metrics::snapshot(*kv.second.view.get(), kv.second.now);
+            if (first) kv.second.prev.clear();
+        }
+
+        std::ostringstream frame;
+        if (pid) print_detail(shells.at(esh::metrics::kShmPrefix + std::to_string(pid)), seconds, frame);
+        else print_table(shells, seconds, frame);
+        std::cout << (tty ? "\033[H\033[J" : "") << frame.str() << std::flush;
+        if (once) return 0;
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+}